@@ -22,6 +22,11 @@ struct sco_desc {
     void (*cleanup)(void *stack, size_t stack_size, void *udata);
     void *udata;
 };
+struct sco_pending {
+    struct sco_desc desc;
+    int64_t id;
+    struct sco_pending *next;
+};
 struct sco_symbol {
     void *cfa;            // Canonical Frame Address
     void *ip;             // Instruction Pointer
@@ -1761,6 +1766,10 @@ static __thread struct sco_map sco_paused = { 0 };
 static __thread size_t sco_npaused = 0;
 static __thread bool sco_exit_to_main_requested = false;
 static __thread void(*sco_user_entry)(void *udata);
+static __thread size_t sco_npending = 0;
+static __thread struct sco_pending *sco_pending_head = NULL;
+static __thread struct sco_pending *sco_pending_tail = NULL;
+static __thread int64_t sco_pending_id = 0;
 
 static atomic_int_fast64_t sco_next_id = 0;
 static atomic_bool sco_locker = 0;
@@ -1825,9 +1834,37 @@ static void sco_return_to_main(bool final) {
     llco_switch(0, final);
 }
 
+static void sco_entry(void *udata);
+
+static void sco_start_pending(bool final) {
+    struct sco_pending *pending = sco_pending_head;
+    sco_pending_head = pending->next;
+    if (!sco_pending_head) {
+        sco_pending_tail = NULL;
+    }
+    sco_npending--;
+    struct llco_desc llco_desc = {
+        .entry = sco_entry,
+        .cleanup = pending->desc.cleanup,
+        .stack = pending->desc.stack,
+        .stack_size = pending->desc.stack_size,
+        .udata = pending->desc.udata,
+    };
+    sco_user_entry = pending->desc.entry;
+    sco_pending_id = pending->id;
+    // The current coroutine, if any, has already been scheduled or paused.
+    sco_cur = NULL;
+    llco_start(&llco_desc, final);
+}
+
 static void sco_switch(bool resumed_from_main, bool final) {
     if (sco_nrunners == 0) {
         // No more runners.
+        if (sco_npending > 0 && !sco_exit_to_main_requested) {
+            // Start the next pending coroutine before any yielders.
+            sco_start_pending(final);
+            return;
+        }
         if (sco_nyielders == 0 || sco_exit_to_main_requested ||
             (!resumed_from_main && sco_npaused > 0)) {
             sco_return_to_main(final);
@@ -1853,7 +1890,12 @@ static void sco_entry(void *udata) {
     struct sco scostk = { 0 };
     struct sco *co = &scostk;
     co->llco = llco_current();
-    co->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    if (sco_pending_id) {
+        co->id = sco_pending_id;
+        sco_pending_id = 0;
+    } else {
+        co->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    }
     co->udata = udata;
     co->prev = co;
     co->next = co;
@@ -1894,6 +1936,21 @@ void sco_start(struct sco_desc *desc) {
     llco_start(&llco_desc, false);
 }
 
+SCO_EXTERN
+int64_t sco_start_later(struct sco_pending *pending) {
+    sco_init();
+    pending->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    pending->next = NULL;
+    if (sco_pending_tail) {
+        sco_pending_tail->next = pending;
+    } else {
+        sco_pending_head = pending;
+    }
+    sco_pending_tail = pending;
+    sco_npending++;
+    return pending->id;
+}
+
 SCO_EXTERN
 int64_t sco_id(void) {
     return sco_cur ? sco_cur->id : 0;
@@ -1970,7 +2027,7 @@ void *sco_udata(void) {
 
 SCO_EXTERN
 size_t sco_info_scheduled(void) {
-    return sco_nyielders;
+    return sco_nyielders + sco_npending;
 }
 
 SCO_EXTERN
@@ -1996,11 +2053,13 @@ size_t sco_info_detached(void) {
     return ndetached;
 }
 
-// Returns true if there are any coroutines running, yielding, or paused.
+// Returns true if there are any coroutines running, yielding, pending, or
+// paused.
 SCO_EXTERN
 bool sco_active(void) {
     // Notice that detached coroutinues are not included.
-    return (sco_nyielders + sco_npaused + sco_nrunners + !!sco_cur) > 0;
+    return (sco_nyielders + sco_npaused + sco_nrunners + sco_npending + 
+        !!sco_cur) > 0;
 }
 
 SCO_EXTERN
@@ -24,6 +24,20 @@ struct sco_desc {
 // Starts a new coroutine with the provided description.
 void sco_start(struct sco_desc *desc);
 
+// A coroutine that is waiting to be started. See sco_start_later().
+struct sco_pending {
+    struct sco_desc desc;
+    int64_t id;
+    struct sco_pending *next;
+};
+
+// Queues a new coroutine with the provided description. Unlike sco_start(),
+// the caller keeps running. The coroutine is started by the scheduler after
+// the running coroutines and before the yielding ones. The pending structure
+// must remain valid until the coroutine has started.
+// Returns the identifier of the new coroutine.
+int64_t sco_start_later(struct sco_pending *pending);
+
 // Causes the calling coroutine to relinquish the CPU.
 // This operation should be called from a coroutine, otherwise it does nothing.
 void sco_yield(void);
@@ -43,7 +57,8 @@ void sco_pause(void);
 // README for an example.
 void sco_resume(int64_t id);
 
-// Returns true if there are any coroutines running, yielding, or paused.
+// Returns true if there are any coroutines running, yielding, pending, or
+// paused.
 bool sco_active(void);
 
 // Detach a coroutine from a thread.
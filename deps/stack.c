@@ -271,6 +271,35 @@ static void stack_release_group(struct stack_group *group, bool nofreelist) {
 }
 #endif
 
+#ifndef _WIN32
+// Returns the capacity of the next group, which is double the newest group.
+static size_t stack_next_cap(struct stack_mgr0 *mgr) {
+    struct stack_group *group = mgr->group_tail->prev;
+    size_t cap = group->cap ? group->cap * 2 : mgr->defcap;
+    return cap > mgr->maxcap ? mgr->maxcap : cap;
+}
+
+// Allocate a group and add it to the end of the manager group list. The
+// system may refuse to map a large group at once, in which case smaller
+// groups are tried, down to mincap.
+static struct stack_group *stack_push_new_group(struct stack_mgr0 *mgr,
+    size_t cap, size_t mincap)
+{
+    while (1) {
+        struct stack_group *group = stack_group_new(mgr->stacksz, mgr->pagesz,
+            cap, mgr->gapsz, mgr->useguards);
+        if (group) {
+            stack_push_group(mgr, group);
+            return group;
+        }
+        if (cap <= mincap) {
+            return NULL;
+        }
+        cap = cap / 2 < mincap ? mincap : cap / 2;
+    }
+}
+#endif
+
 static int stack_get_(struct stack_mgr0 *mgr, struct stack0 *stack) {
     if (mgr->onlymalloc) {
         void *addr = malloc(mgr->stacksz);
@@ -297,16 +326,10 @@ static int stack_get_(struct stack_mgr0 *mgr, struct stack0 *stack) {
     }
     group = mgr->group_tail->prev;
     if (group->pos == group->cap) {
-        size_t cap = group->cap ? group->cap * 2 : mgr->defcap;
-        if (cap > mgr->maxcap) {
-            cap = mgr->maxcap;
-        }
-        group = stack_group_new(mgr->stacksz, mgr->pagesz, cap, mgr->gapsz, 
-            mgr->useguards);
+        group = stack_push_new_group(mgr, stack_next_cap(mgr), mgr->defcap);
         if (!group) {
             return -1;
         }
-        stack_push_group(mgr, group);
     }
     char *addr = group->stack0 + (group->stacksz+group->gapsz) * group->pos;
     if (group->guards) {
@@ -394,6 +417,41 @@ void stack_put(struct stack_mgr *mgr, struct stack *stack) {
     stack_put_((void*)mgr, (void*)stack);
 }
 
+static int stack_reserve_(struct stack_mgr0 *mgr, size_t n) {
+    if (mgr->onlymalloc) {
+        return 0;
+    }
+#ifndef _WIN32
+    // Freed stacks are always used first.
+    if (!mgr->nostackfreelist) {
+        struct stack_freed *fstack = mgr->free_head->next;
+        while (n > 0 && fstack != mgr->free_tail) {
+            fstack = fstack->next;
+            n--;
+        }
+    }
+    struct stack_group *group = mgr->group_tail->prev;
+    if (n <= group->cap - group->pos) {
+        return 0;
+    }
+    // Allocate one group for the remaining stacks, rather than growing the
+    // groups a few stacks at a time.
+    size_t cap = stack_next_cap(mgr);
+    if (cap < n) {
+        cap = n < mgr->maxcap ? n : mgr->maxcap;
+    }
+    if (!stack_push_new_group(mgr, cap, mgr->defcap)) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+STACK_API
+int stack_reserve(struct stack_mgr *mgr, size_t n) {
+    return stack_reserve_((void*)mgr, n);
+}
+
 static size_t stack_size_(struct stack0 *stack) {
     return stack->size;
 }
@@ -31,6 +31,12 @@ void stack_mgr_destroy(struct stack_mgr *mgr);
 int stack_get(struct stack_mgr *mgr, struct stack *stack);
 void stack_put(struct stack_mgr *mgr, struct stack *stack);
 
+// Prepare for the next n calls to stack_get(). When the freed stacks and the
+// newest group cannot hold them, a single group that is large enough for the
+// remainder, up to maxcap, is allocated now.
+// Returns 0 on success or -1 if out of memory.
+int stack_reserve(struct stack_mgr *mgr, size_t n);
+
 // The base address of the stack.
 void *stack_addr(struct stack *stack);
 
@@ -19,6 +19,8 @@ NECO_SIGSTKSZ        // Size of signal stack on main thread
 NECO_BURST           // Number of read attempts before waiting, def: disabled
 NECO_MAXWORKERS      // Max number of worker threads, def: 64
 NECO_MAXIOWORKERS    // Max number of io threads, def: 2
+NECO_MAXGAIWORKERS   // Max number of getaddrinfo threads, def: 8
+NECO_CHANSEGSIZE     // Size of each segment for unbounded channels, def: 4096
 
 // Additional options that activate features
 
@@ -33,6 +35,7 @@ NECO_USEREADWORKERS   // Use read workers, disabled by default
 NECO_USEWRITEWORKERS  // Use write workers, enabled by default on Linux
 NECO_NOREADWORKERS    // Disable all read workers
 NECO_NOWRITEWORKERS   // Disable all write workers
+NECO_NOGAICACHE       // Do not cache or share getaddrinfo results
 */
 
 // Windows and Webassembly have limited features.
@@ -46,6 +49,7 @@ NECO_NOWRITEWORKERS   // Disable all write workers
 #define NECO_USEHEAPSTACK
 #define NECO_NOSIGNALS
 #define NECO_NOWORKERS
+#define DEF_CHANSEGSIZE   4096
 #else
 #define DEF_STACKSIZE     8388608
 #define DEF_DEFCAP        4
@@ -56,6 +60,8 @@ NECO_NOWRITEWORKERS   // Disable all write workers
 #define DEF_MAXWORKERS    64
 #define DEF_MAXRINGSIZE   32
 #define DEF_MAXIOWORKERS  2
+#define DEF_MAXGAIWORKERS 8
+#define DEF_CHANSEGSIZE   4096
 #endif
 
 #ifdef __linux__
@@ -91,6 +97,12 @@ NECO_NOWRITEWORKERS   // Disable all write workers
 #ifndef NECO_MAXIOWORKERS
 #define NECO_MAXIOWORKERS DEF_MAXIOWORKERS
 #endif
+#ifndef NECO_MAXGAIWORKERS
+#define NECO_MAXGAIWORKERS DEF_MAXGAIWORKERS
+#endif
+#ifndef NECO_CHANSEGSIZE
+#define NECO_CHANSEGSIZE DEF_CHANSEGSIZE
+#endif
 
 #ifdef NECO_TESTING
 #if NECO_BURST <= 0
@@ -176,6 +188,11 @@ struct sco_desc {
     void (*cleanup)(void *stack, size_t stack_size, void *udata);
     void *udata;
 };
+struct sco_pending {
+    struct sco_desc desc;
+    int64_t id;
+    struct sco_pending *next;
+};
 struct sco_symbol {
     void *cfa;            // Canonical Frame Address
     void *ip;             // Instruction Pointer
@@ -1915,6 +1932,10 @@ static __thread struct sco_map sco_paused = { 0 };
 static __thread size_t sco_npaused = 0;
 static __thread bool sco_exit_to_main_requested = false;
 static __thread void(*sco_user_entry)(void *udata);
+static __thread size_t sco_npending = 0;
+static __thread struct sco_pending *sco_pending_head = NULL;
+static __thread struct sco_pending *sco_pending_tail = NULL;
+static __thread int64_t sco_pending_id = 0;
 
 static atomic_int_fast64_t sco_next_id = 0;
 static atomic_bool sco_locker = 0;
@@ -1979,9 +2000,37 @@ static void sco_return_to_main(bool final) {
     llco_switch(0, final);
 }
 
+static void sco_entry(void *udata);
+
+static void sco_start_pending(bool final) {
+    struct sco_pending *pending = sco_pending_head;
+    sco_pending_head = pending->next;
+    if (!sco_pending_head) {
+        sco_pending_tail = NULL;
+    }
+    sco_npending--;
+    struct llco_desc llco_desc = {
+        .entry = sco_entry,
+        .cleanup = pending->desc.cleanup,
+        .stack = pending->desc.stack,
+        .stack_size = pending->desc.stack_size,
+        .udata = pending->desc.udata,
+    };
+    sco_user_entry = pending->desc.entry;
+    sco_pending_id = pending->id;
+    // The current coroutine, if any, has already been scheduled or paused.
+    sco_cur = NULL;
+    llco_start(&llco_desc, final);
+}
+
 static void sco_switch(bool resumed_from_main, bool final) {
     if (sco_nrunners == 0) {
         // No more runners.
+        if (sco_npending > 0 && !sco_exit_to_main_requested) {
+            // Start the next pending coroutine before any yielders.
+            sco_start_pending(final);
+            return;
+        }
         if (sco_nyielders == 0 || sco_exit_to_main_requested ||
             (!resumed_from_main && sco_npaused > 0)) {
             sco_return_to_main(final);
@@ -2007,7 +2056,12 @@ static void sco_entry(void *udata) {
     struct sco scostk = { 0 };
     struct sco *co = &scostk;
     co->llco = llco_current();
-    co->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    if (sco_pending_id) {
+        co->id = sco_pending_id;
+        sco_pending_id = 0;
+    } else {
+        co->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    }
     co->udata = udata;
     co->prev = co;
     co->next = co;
@@ -2048,6 +2102,21 @@ void sco_start(struct sco_desc *desc) {
     llco_start(&llco_desc, false);
 }
 
+SCO_EXTERN
+int64_t sco_start_later(struct sco_pending *pending) {
+    sco_init();
+    pending->id = atomic_fetch_add(&sco_next_id, 1) + 1;
+    pending->next = NULL;
+    if (sco_pending_tail) {
+        sco_pending_tail->next = pending;
+    } else {
+        sco_pending_head = pending;
+    }
+    sco_pending_tail = pending;
+    sco_npending++;
+    return pending->id;
+}
+
 SCO_EXTERN
 int64_t sco_id(void) {
     return sco_cur ? sco_cur->id : 0;
@@ -2124,7 +2193,7 @@ void *sco_udata(void) {
 
 SCO_EXTERN
 size_t sco_info_scheduled(void) {
-    return sco_nyielders;
+    return sco_nyielders + sco_npending;
 }
 
 SCO_EXTERN
@@ -2150,11 +2219,13 @@ size_t sco_info_detached(void) {
     return ndetached;
 }
 
-// Returns true if there are any coroutines running, yielding, or paused.
+// Returns true if there are any coroutines running, yielding, pending, or
+// paused.
 SCO_EXTERN
 bool sco_active(void) {
     // Notice that detached coroutinues are not included.
-    return (sco_nyielders + sco_npaused + sco_nrunners + !!sco_cur) > 0;
+    return (sco_nyielders + sco_npaused + sco_nrunners + sco_npending + 
+        !!sco_cur) > 0;
 }
 
 SCO_EXTERN
@@ -2477,6 +2548,35 @@ static void stack_release_group(struct stack_group *group, bool nofreelist) {
 }
 #endif
 
+#ifndef _WIN32
+// Returns the capacity of the next group, which is double the newest group.
+static size_t stack_next_cap(struct stack_mgr0 *mgr) {
+    struct stack_group *group = mgr->group_tail->prev;
+    size_t cap = group->cap ? group->cap * 2 : mgr->defcap;
+    return cap > mgr->maxcap ? mgr->maxcap : cap;
+}
+
+// Allocate a group and add it to the end of the manager group list. The
+// system may refuse to map a large group at once, in which case smaller
+// groups are tried, down to mincap.
+static struct stack_group *stack_push_new_group(struct stack_mgr0 *mgr,
+    size_t cap, size_t mincap)
+{
+    while (1) {
+        struct stack_group *group = stack_group_new(mgr->stacksz, mgr->pagesz,
+            cap, mgr->gapsz, mgr->useguards);
+        if (group) {
+            stack_push_group(mgr, group);
+            return group;
+        }
+        if (cap <= mincap) {
+            return NULL;
+        }
+        cap = cap / 2 < mincap ? mincap : cap / 2;
+    }
+}
+#endif
+
 static int stack_get_(struct stack_mgr0 *mgr, struct stack0 *stack) {
     if (mgr->onlymalloc) {
         void *addr = malloc(mgr->stacksz);
@@ -2503,16 +2603,10 @@ static int stack_get_(struct stack_mgr0 *mgr, struct stack0 *stack) {
     }
     group = mgr->group_tail->prev;
     if (group->pos == group->cap) {
-        size_t cap = group->cap ? group->cap * 2 : mgr->defcap;
-        if (cap > mgr->maxcap) {
-            cap = mgr->maxcap;
-        }
-        group = stack_group_new(mgr->stacksz, mgr->pagesz, cap, mgr->gapsz, 
-            mgr->useguards);
+        group = stack_push_new_group(mgr, stack_next_cap(mgr), mgr->defcap);
         if (!group) {
             return -1;
         }
-        stack_push_group(mgr, group);
     }
     char *addr = group->stack0 + (group->stacksz+group->gapsz) * group->pos;
     if (group->guards) {
@@ -2600,6 +2694,41 @@ void stack_put(struct stack_mgr *mgr, struct stack *stack) {
     stack_put_((void*)mgr, (void*)stack);
 }
 
+static int stack_reserve_(struct stack_mgr0 *mgr, size_t n) {
+    if (mgr->onlymalloc) {
+        return 0;
+    }
+#ifndef _WIN32
+    // Freed stacks are always used first.
+    if (!mgr->nostackfreelist) {
+        struct stack_freed *fstack = mgr->free_head->next;
+        while (n > 0 && fstack != mgr->free_tail) {
+            fstack = fstack->next;
+            n--;
+        }
+    }
+    struct stack_group *group = mgr->group_tail->prev;
+    if (n <= group->cap - group->pos) {
+        return 0;
+    }
+    // Allocate one group for the remaining stacks, rather than growing the
+    // groups a few stacks at a time.
+    size_t cap = stack_next_cap(mgr);
+    if (cap < n) {
+        cap = n < mgr->maxcap ? n : mgr->maxcap;
+    }
+    if (!stack_push_new_group(mgr, cap, mgr->defcap)) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+STACK_API
+int stack_reserve(struct stack_mgr *mgr, size_t n) {
+    return stack_reserve_((void*)mgr, n);
+}
+
 static size_t stack_size_(struct stack0 *stack) {
     return stack->size;
 }
@@ -2862,7 +2991,9 @@ bool worker_submit(struct worker *worker, int64_t pin, void(*work)(void *udata),
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <dlfcn.h>
 #include <sys/syscall.h>
 #endif
@@ -2877,6 +3008,8 @@ bool worker_submit(struct worker *worker, int64_t pin, void(*work)(void *udata),
 #elif defined(__linux__)
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #define NECO_POLL_EPOLL
 #elif defined(__EMSCRIPTEN__) || defined(_WIN32) || defined(__COSMOCC__)
 // #warning Webassembly has no polling
@@ -3108,6 +3241,7 @@ void neco_errconv_to_sys(int);
 static bool env_paniconerror = false;
 static int env_canceltype = NECO_CANCEL_ASYNC;
 static int env_cancelstate = NECO_CANCEL_ENABLE;
+static int env_mutexmode = NECO_MUTEX_DEFAULT;
 static void *(*malloc_)(size_t) = NULL;
 static void *(*realloc_)(void*, size_t) = NULL;
 static void (*free_)(void*) = NULL;
@@ -3198,6 +3332,16 @@ void neco_env_setcancelstate(int state) {
     env_cancelstate = state;
 }
 
+/// Globally set the default mode for all new mutexes.
+///
+/// _This should only be run once at program startup and before the first 
+/// neco_start function is called_.
+/// @see GlobalFuncs
+/// @see neco_mutex_setmode()
+void neco_env_setmutexmode(int mode) {
+    env_mutexmode = mode;
+}
+
 // return either a BSD kqueue or Linux epoll type.
 static int evqueue(void) {
 #if defined(NECO_POLL_EPOLL) 
@@ -3209,11 +3353,55 @@ static int evqueue(void) {
 #endif
 }
 
+#ifdef __linux__
+// The splice(2) declaration requires _GNU_SOURCE, so use the system call.
+#define SPLICE_MOVE      1
+#define SPLICE_NONBLOCK  2
+#define SPLICE_CHUNKSIZE 65536
+
+static ssize_t sys_splice(int fd_in, int fd_out, size_t len) {
+    return syscall(SYS_splice, fd_in, NULL, fd_out, NULL, len, 
+        SPLICE_MOVE|SPLICE_NONBLOCK);
+}
+#endif
+
+#ifdef __linux__
+// The accept4(2) declaration requires _GNU_SOURCE, so use the system call.
+static int sys_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+    int flags)
+{
+    return (int)syscall(SYS_accept4, sockfd, addr, addrlen, flags);
+}
+#endif
+
+#ifdef __linux__
+// The recvmmsg(2) and sendmmsg(2) declarations, and struct mmsghdr, require
+// _GNU_SOURCE, so use the system calls. The kernel's mmsghdr layout is 
+// needed for stepping through a partially sent batch.
+struct kmmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+static int sys_recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags)
+{
+    return (int)syscall(SYS_recvmmsg, fd, msgvec, vlen, flags, NULL);
+}
+
+static int sys_sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags)
+{
+    return (int)syscall(SYS_sendmmsg, fd, msgvec, vlen, flags);
+}
+#endif
+
 #define read0 read
 #define recv0 recv
 #define write0 write
 #define send0 send
 #define accept0 accept
+#define sys_accept40 sys_accept4
 #define connect0 connect
 #define socket0 socket
 #define bind0 bind
@@ -3224,6 +3412,14 @@ static int evqueue(void) {
 #define pthread_create0 pthread_create
 #define pthread_detach0 pthread_detach
 #define pipe0 pipe
+#define readv0 readv
+#define writev0 writev
+#define sendfile0 sendfile
+#define sys_splice0 sys_splice
+#define recvmsg0 recvmsg
+#define sendmsg0 sendmsg
+#define sys_recvmmsg0 sys_recvmmsg
+#define sys_sendmmsg0 sys_sendmmsg
 #define malloc0 neco_malloc
 #define realloc0 neco_realloc
 #define free0 neco_free
@@ -3301,6 +3497,15 @@ static void colist_push_back(struct colist *list, struct coroutine *co) {
     list->tail.prev = (struct coroutine*)link;
 }
 
+static void colist_push_front(struct colist *list, struct coroutine *co) {
+    remove_from_list(co);
+    struct colink *link = (void*)co;
+    ((struct colink*)list->head.next)->prev = (struct coroutine*)link;
+    link->next = list->head.next;
+    link->prev = (struct coroutine*)&list->head;
+    list->head.next = (struct coroutine*)link;
+}
+
 static struct coroutine *colist_pop_front(struct colist *list) {
     struct coroutine *co = list->head.next;
     if (co == (struct coroutine*)&list->tail) {
@@ -3336,12 +3541,19 @@ struct coroutine {
     int64_t starterid;            // identifer of the starter coroutine
     bool paused;                  // coroutine is paused
     bool deadlined;               // coroutine operation was deadlined
+    bool queued;                  // registered before start (neco_start_many)
+    struct sco_pending pending;   // queued start (neco_start_many)
 
     struct cleanup *cleanup;      // cancelation cleanup stack
 
     bool rlocked;
     bool suspended;
 
+    int64_t npauses;              // number of times the coroutine paused
+
+    int64_t sweight;              // semaphore weight that is being acquired
+    bool granted;                 // woken by a mutex or semaphore releaser
+
     int64_t pool_ts;              // timestamp when added to a pool
 
     char *cmsg;                   // channel message data from sender
@@ -3361,19 +3573,83 @@ struct coroutine {
 
     struct neco_chan *gen;        // self generator (actually a channel)
 
+    struct neco_group *group;     // group that this coroutine belongs to
+    struct coroutine *gprev;      // group member list links
+    struct coroutine *gnext;
+    int64_t gcancelgen;           // group cancel generation
+    bool gcancelpending;          // group cancel waiting for cancel enable
+
+    struct coslot *slots;         // coroutine-local storage, indexed by key
+    int nslots;                   // number of slots
+
+    struct arenachunk *arena;     // neco_alloc chunks, current chunk first
+
+    struct neco_context *ctx;     // attached context
+    struct coroutine *cxprev;     // context member list links
+    struct coroutine *cxnext;
+    int64_t cxgen;                // context cancel generation
+
     // For the rt->all comap, which stores all active coroutines
     AAT_FIELDS(struct coroutine,  all_left, all_right, all_level)
 
     // Deadline for pause. All paused will have this set to something.
     int64_t deadline;
     AAT_FIELDS(struct coroutine, dl_left, dl_right, dl_level)
-
-    // File event node
-    int evfd;
-    enum evkind evkind;
-    AAT_FIELDS(struct coroutine, evleft, evright, evlevel)
 } aligned16;
 
+// neco_context carries a deadline and a cancel signal. It's attached to a
+// coroutine and inherited by the coroutines that it starts. Contexts form a
+// tree, where canceling a context also cancels all of its descendants.
+struct neco_context {
+    int64_t rtid;                  // runtime id
+    int rc;                        // reference count
+    bool canceled;                 // context was canceled
+    int64_t deadline;              // effective deadline, including parents
+    struct neco_context *parent;   // parent context (retained)
+    struct neco_context *children; // child contexts (not retained)
+    struct neco_context *sibprev;  // sibling links for parent's children
+    struct neco_context *signext;
+    struct coroutine *head;        // attached coroutines (cxprev, cxnext)
+    struct coroutine *tail;
+};
+
+// ctxcanceled returns true if the coroutine's context, or any of its
+// parents, was canceled. Coroutines with a disabled cancel state are not
+// affected.
+static bool ctxcanceled(struct coroutine *co) {
+    if (co->cancelstate != NECO_CANCEL_ENABLE) {
+        return false;
+    }
+    for (struct neco_context *ctx = co->ctx; ctx; ctx = ctx->parent) {
+        if (ctx->canceled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// codeadline returns the deadline, or the context deadline if it's sooner.
+static int64_t codeadline(struct coroutine *co, int64_t deadline) {
+    if (co->ctx && co->ctx->deadline < deadline) {
+        return co->ctx->deadline;
+    }
+    return deadline;
+}
+
+// evwaiter is a single registration of a coroutine that is waiting on a file
+// event. It lives on the stack of the waiting coroutine, which allows for one
+// coroutine to wait on multiple file events at the same time.
+struct evwaiter {
+    int fd;                       // file descriptor
+    enum evkind kind;             // event kind
+    int64_t id;                   // unique registration id (rt->evid)
+    struct coroutine *co;         // the waiting coroutine
+    int idx;                      // case index, used with 'ret_idx'
+    int *ret_idx;                 // first fired case index (or NULL)
+    int *ready;                   // fired event kinds are added here (or NULL)
+    AAT_FIELDS(struct evwaiter, evleft, evright, evlevel)
+};
+
 #if defined(__GNUC__)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -3397,16 +3673,16 @@ static int dl_compare(struct coroutine *a, struct coroutine *b) {
 AAT_DEF(static, dlqueue, struct coroutine)
 AAT_IMPL(dlqueue, struct coroutine, dl_left, dl_right, dl_level, dl_compare)
 
-static int evcompare(struct coroutine *a, struct coroutine *b) {
-    // order by evfd, evkind, id
+static int evcompare(struct evwaiter *a, struct evwaiter *b) {
+    // order by fd, kind, id
     return
-        a->evfd < b->evfd ? -1 : a->evfd > b->evfd ? 1 :
-        a->evkind < b->evkind ? -1 : a->evkind > b->evkind ? 1 :
+        a->fd < b->fd ? -1 : a->fd > b->fd ? 1 :
+        a->kind < b->kind ? -1 : a->kind > b->kind ? 1 :
         a->id < b->id ? -1 : a->id > b->id;
 }
 
-AAT_DEF(static, evaat, struct coroutine)
-AAT_IMPL(evaat, struct coroutine, evleft, evright, evlevel, evcompare)
+AAT_DEF(static, evaat, struct evwaiter)
+AAT_IMPL(evaat, struct evwaiter, evleft, evright, evlevel, evcompare)
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic pop
@@ -3520,28 +3796,28 @@ static struct coroutine *comap_delete(struct comap *map, struct coroutine *key){
 #endif
 
 struct evmap {
-    struct coroutine *roots[EVMAP_NSHARDS];
+    struct evwaiter *roots[EVMAP_NSHARDS];
     int count;
 };
 
-#define evmap_getaat(co) (&map->roots[mix13(co->evfd) & (EVMAP_NSHARDS-1)])
+#define evmap_getaat(w) (&map->roots[mix13((w)->fd) & (EVMAP_NSHARDS-1)])
 
-static struct coroutine *evmap_insert(struct evmap *map, struct coroutine *co) {
-    struct coroutine *prev = evaat_insert(evmap_getaat(co), co);
+static struct evwaiter *evmap_insert(struct evmap *map, struct evwaiter *w) {
+    struct evwaiter *prev = evaat_insert(evmap_getaat(w), w);
     map->count++;
     return prev;
 }
 
-static struct coroutine *evmap_iter(struct evmap *map, struct coroutine *key){
+static struct evwaiter *evmap_iter(struct evmap *map, struct evwaiter *key) {
     return evaat_iter(evmap_getaat(key), key);
 }
 
-static struct coroutine *evmap_next(struct evmap *map, struct coroutine *key){
+static struct evwaiter *evmap_next(struct evmap *map, struct evwaiter *key) {
     return evaat_next(evmap_getaat(key), key);
 }
 
-static struct coroutine *evmap_delete(struct evmap *map, struct coroutine *key){
-    struct coroutine *prev = evaat_delete(evmap_getaat(key), key);
+static struct evwaiter *evmap_delete(struct evmap *map, struct evwaiter *key) {
+    struct evwaiter *prev = evaat_delete(evmap_getaat(key), key);
     map->count--;
     return prev;
 }
@@ -3567,6 +3843,29 @@ int neco_gai_lasterr(void) {
 static atomic_int_fast64_t next_runtime_id = 1;
 
 // The neco runtime
+////////////////////////////////////////////////////////////////////////////////
+// slab - Per-runtime free lists of runtime-internal objects, such as 
+// coroutines, channels, and streams, by power of two size classes. 
+// Frees push to the free list for the object's size class, up to a limit,
+// and allocations pop from it. Objects larger than the biggest size class
+// go straight to the allocator.
+// The free list link is stored in the last word of each block, which leaves
+// the header of a freed object, such as a channel's runtime id, untouched.
+////////////////////////////////////////////////////////////////////////////////
+
+#define SLAB_MINSHIFT  6          // smallest class is 64 bytes
+#define SLAB_NCLASSES  7          // largest class is 4096 bytes
+#define SLAB_MAXBYTES  262144     // max bytes of free objects for each class
+
+#ifndef NECO_PIPEPOOLSIZE
+#define NECO_PIPEPOOLSIZE 16
+#endif
+
+struct slab {
+    void *free;                    // free list, linked through last word
+    int nfree;                     // number of objects in free list
+};
+
 struct runtime {
     int64_t id;                    // unique runtime identifier
     struct stack_mgr stkmgr;       // stack memory manager
@@ -3575,6 +3874,9 @@ struct runtime {
     struct comap all;              // all running coroutines.
     struct coroutine *deadlines;   // paused coroutines (aat root)
     size_t ndeadlines;             // total number of paused coroutines
+    struct chantimer *timers;      // armed channel timers (aat root)
+    size_t ntimers;                // number of armed channel timers
+    int64_t timerid;               // unique timer id incrementer
     size_t ntotal;                 // total number of coroutines ever created
     size_t nsleepers;
     size_t nlocked;
@@ -3585,8 +3887,9 @@ struct runtime {
     size_t nworkers;               // number of background workers
     size_t nsuspended;             // number of suspended coroutines
 
-    struct evmap evwaiters;        // coroutines waiting on events (aat root)
-    size_t nevwaiters;
+    struct evmap evwaiters;        // registered file event waiters
+    size_t nevwaiters;             // number of coroutines waiting on events
+    int64_t evid;                  // unique event waiter id incrementer
 
     // list of coroutines waiting to be resumed by the scheduler
     int nresumers;
@@ -3599,10 +3902,38 @@ struct runtime {
     int qfd;                       // queue file descriptor (epoll or kqueue)
     int64_t qfdcreated;            // when the queue was created
 
-    // zerochan pool (reusables)
-    struct neco_chan **zchanpool;  // pool of zero sized channels
-    int zchanpoollen;              // number of zero sized channels in pool
-    int zchanpoolcap;              // capacity of pool
+    // object slabs (reusables)
+    struct slab slabs[SLAB_NCLASSES]; // free objects for each size class
+
+#ifdef __linux__
+    // splice pipe pool (reusables)
+    int pipepool[NECO_PIPEPOOLSIZE][2]; // empty pipes for neco_copy
+    int npipepool;                 // number of pipes in pool
+#endif
+
+    // outbound connection pool, created on first use
+    struct connpool *connpool;
+
+    // name resolution
+    struct gaiflight *gaiflights;  // in-flight lookups
+    struct gaientry *gaicache;     // cached results, newest first
+    int ngaicache;                 // number of cached results
+
+    // channel segment pool (reusables)
+    struct chanseg *segpool;       // pool of segments for unbounded channels
+    int nsegpool;                  // number of segments in pool
+
+    int64_t ctxgen;                // context cancel generation
+
+    // coroutine-local storage keys
+    struct cokey *keys;            // keys, indexed by slot
+    int nkeys;                     // number of keys (used and unused)
+    int keyscap;                   // capacity of keys
+    int64_t keygen;                // key generation incrementer
+
+    // contention profiling
+    bool ctenabled;                // contention profiling is enabled
+    struct ctentry *ctentries;     // aat of profiled object/callsite entries
 
     struct colist sigwaiters;      // signal waiting coroutines
     size_t nsigwaiters;
@@ -3641,6 +3972,74 @@ static void rt_release(void) {
     rt = NULL;
 }
 
+// Returns the size class for an allocation, or -1 if it's too big.
+static int slab_class(size_t size) {
+    int class = 0;
+    while (((size_t)1 << (class+SLAB_MINSHIFT)) < size) {
+        class++;
+        if (class == SLAB_NCLASSES) {
+            return -1;
+        }
+    }
+    return class;
+}
+
+#ifdef NECO_TESTING
+// Do not hide the allocation failures that are injected by the tests.
+#define SLAB_BYPASS (neco_fail_neco_malloc_counter > 0)
+#else
+#define SLAB_BYPASS false
+#endif
+
+#define slab_link(ptr, class) \
+    ((void**)((char*)(ptr) + ((size_t)1 << ((class)+SLAB_MINSHIFT)) - \
+        sizeof(void*)))
+
+// Allocate a runtime-internal object. 
+// The object must be freed with slab_free() using the same size.
+static void *slab_alloc(size_t size) {
+    int class = slab_class(size);
+    if (!POOL_ENABLED || class == -1) {
+        return malloc0(size);
+    }
+    struct slab *slab = &rt->slabs[class];
+    if (slab->free && !SLAB_BYPASS) {
+        void *ptr = slab->free;
+        slab->free = *slab_link(ptr, class);
+        slab->nfree--;
+        return ptr;
+    }
+    return malloc0((size_t)1 << (class+SLAB_MINSHIFT));
+}
+
+static void slab_free(void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    int class = slab_class(size);
+    if (!POOL_ENABLED || !rt || class == -1 || rt->slabs[class].nfree >= 
+        SLAB_MAXBYTES >> (class+SLAB_MINSHIFT))
+    {
+        free0(ptr);
+        return;
+    }
+    struct slab *slab = &rt->slabs[class];
+    *slab_link(ptr, class) = slab->free;
+    slab->free = ptr;
+    slab->nfree++;
+}
+
+static void rt_freeslabs(void) {
+    for (int i = 0; i < SLAB_NCLASSES; i++) {
+        while (rt->slabs[i].free) {
+            void *ptr = rt->slabs[i].free;
+            rt->slabs[i].free = *slab_link(ptr, i);
+            free0(ptr);
+        }
+        rt->slabs[i].nfree = 0;
+    }
+}
+
 // coself returns the currently running coroutine.
 static struct coroutine *coself(void) {
     return (struct coroutine*)sco_udata();
@@ -3680,10 +4079,57 @@ static void yield_for_sched_resume(void) {
     coyield();
 }
 
-static struct coroutine *evexists(int fd, enum evkind kind) {
-    struct coroutine *key = &(struct coroutine){ .evfd = fd, .evkind = kind };
-    struct coroutine *iter = evmap_iter(&rt->evwaiters, key);
-    return iter && iter->evfd == fd && iter->evkind == kind ? iter : NULL;
+static struct evwaiter *evexists(int fd, enum evkind kind) {
+    struct evwaiter *key = &(struct evwaiter){ .fd = fd, .kind = kind };
+    struct evwaiter *iter = evmap_iter(&rt->evwaiters, key);
+    return iter && iter->fd == fd && iter->kind == kind ? iter : NULL;
+}
+
+// chantimer is a runtime-owned timer that feeds the current time into its
+// channel each time the deadline is reached. Timers are kept in the runtime
+// 'timers' aat, ordered by deadline, and fired by the scheduler. This allows
+// for any number of timers without needing a sleeping coroutine for each.
+// Runtime-internal timers have no channel and call 'func' instead.
+struct chantimer {
+    struct neco_chan *chan; // the channel being fed
+    void (*func)(struct chantimer *timer, int64_t now); // or, the callback
+    int64_t id;             // unique timer id, for ordering
+    int64_t deadline;       // next time to fire
+    int64_t interval;       // repeat interval (tickers), zero for timers
+    bool armed;             // timer is in the runtime timers queue
+    AAT_FIELDS(struct chantimer, left, right, level)
+};
+
+static int timer_compare(struct chantimer *a, struct chantimer *b) {
+    // order by deadline, id
+    return 
+        a->deadline < b->deadline ? -1 : a->deadline > b->deadline ? 1 :
+        a->id < b->id ? -1 : a->id > b->id;
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+AAT_DEF(static, tmqueue, struct chantimer)
+AAT_IMPL(tmqueue, struct chantimer, left, right, level, timer_compare)
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+static void chantimer_arm(struct chantimer *timer, int64_t deadline) {
+    timer->deadline = deadline;
+    tmqueue_insert(&rt->timers, timer);
+    rt->ntimers++;
+    timer->armed = true;
+}
+
+static void chantimer_disarm(struct chantimer *timer) {
+    if (timer->armed) {
+        tmqueue_delete(&rt->timers, timer);
+        rt->ntimers--;
+        timer->armed = false;
+    }
 }
 
 #if defined(_WIN32)
@@ -3741,14 +4187,14 @@ static void *costackaddr(struct coroutine *co) {
 // Create a new coroutines with the provided coroutine function and stack size.
 // Returns NULL if out of memory.
 static struct coroutine *coroutine_new(void) {
-    struct coroutine *co = malloc0(sizeof(struct coroutine));
+    struct coroutine *co = slab_alloc(sizeof(struct coroutine));
     if (!co) {
         return NULL;
     }
     memset(co, 0, sizeof(struct coroutine));
     co->kind = COROUTINE;
     if (!costackget(co)) {
-        free0(co);
+        slab_free(co, sizeof(struct coroutine));
         return NULL;
     }
     co->next = co;
@@ -3773,11 +4219,15 @@ static struct neco_chan *chan_fastmake(size_t data_size, size_t capacity,
 static void chan_fastrelease(struct neco_chan *chan);
 static void chan_fastretain(struct neco_chan *chan);
 
+static void arena_free(struct coroutine *co, bool all);
+
 static void coroutine_free(struct coroutine *co) {
     if (co) {
         cofreeargs(co);
+        free0(co->slots);
+        arena_free(co, true);
         costackfree(co);
-        free0(co);
+        slab_free(co, sizeof(struct coroutine));
     }
 }
 
@@ -3818,15 +4268,24 @@ static void cleanup(void *stack, size_t stack_size, void *udata) {
 
 static void coentry(void *udata) {
     struct coroutine *co = udata;
-    co->id = sco_id();
-    if (rt->costarter) {
-        rt->costarter->lastid = co->id;
-        co->starterid = rt->costarter->id;
+    if (co->queued) {
+        // Started by neco_start_many, which already registered it. It may
+        // have been canceled while waiting to start.
+        co->queued = false;
+        if (co->canceled && co->canceltype == NECO_CANCEL_ASYNC) {
+            coexit(true);
+        }
     } else {
-        co->starterid = 0;
+        co->id = sco_id();
+        if (rt->costarter) {
+            rt->costarter->lastid = co->id;
+            co->starterid = rt->costarter->id;
+        } else {
+            co->starterid = 0;
+        }
+        rt->ntotal++;
+        comap_insert(&rt->all, co);
     }
-    rt->ntotal++;
-    comap_insert(&rt->all, co);
     if (co->coroutine) {
         co->coroutine(co->argc, co->argv);
     }
@@ -3834,21 +4293,39 @@ static void coentry(void *udata) {
 }
 
 
-static int start(void(*coroutine)(int, void**), int argc, va_list *args,
-    void *argv[], neco_gen **gen, size_t gen_data_size)
-{
-    struct coroutine *co;
+// Returns a coroutine from the pool, or a new one when the pool is empty.
+// Returns NULL if out of memory.
+static struct coroutine *coroutine_get(void) {
 #ifndef NECO_NOPOOL
-    co = colist_pop_front(&rt->pool);
+    struct coroutine *co = colist_pop_front(&rt->pool);
     if (co) {
         rt->npool--;
         co->pool_ts = 0;
-    } else {
-        co = coroutine_new();
+        return co;
     }
+#endif
+    return coroutine_new();
+}
+
+// Returns an unused coroutine back to the pool.
+static void coroutine_put(struct coroutine *co) {
+    cofreeargs(co);
+#ifndef NECO_NOPOOL
+    colist_push_back(&rt->pool, co);
+    rt->npool++;
 #else
-    co = coroutine_new();
+    coroutine_free(co);
 #endif
+}
+
+static void group_join(struct neco_group *group, struct coroutine *co);
+static void ctx_attach(struct coroutine *co, struct neco_context *ctx);
+
+static int start(void(*coroutine)(int, void**), int argc, va_list *args,
+    void *argv[], neco_gen **gen, size_t gen_data_size, 
+    struct neco_group *group, const void *closure, size_t closure_size)
+{
+    struct coroutine *co = coroutine_get();
     if (!co) {
         goto fail;
     }
@@ -3878,14 +4355,31 @@ static int start(void(*coroutine)(int, void**), int argc, va_list *args,
     for (int i = 0; i < argc; i++) {
         co->argv[i] = args ? va_arg(*args, void*) : argv[i];
     }
+    size_t stack_size = costacksize(co);
+    if (closure) {
+        // Copy the closure to the top of the coroutine stack and then hide
+        // that space from the coroutine by shrinking the stack.
+        stack_size -= (closure_size+15) & ~(size_t)15;
+        co->argv[0] = (char*)costackaddr(co) + stack_size;
+        memcpy(co->argv[0], closure, closure_size);
+    }
     struct sco_desc desc = {
         .stack = costackaddr(co),
-        .stack_size = costacksize(co),
+        .stack_size = stack_size,
         .entry = coentry,
         .cleanup = cleanup,
         .udata = co,
     };
-    rt->costarter = coself();
+    if (group) {
+        co->gcancelgen = 0;
+        group_join(group, co);
+    }
+    struct coroutine *starter = coself();
+    if (starter && starter->ctx) {
+        // Inherit the context of the starter.
+        ctx_attach(co, starter->ctx);
+    }
+    rt->costarter = starter;
     sco_start(&desc);
     return NECO_OK;
 fail:
@@ -4125,14 +4619,20 @@ static void rt_sched_event_step(int64_t timeout) {
             // Now that we have an event type (read or write) and a file
             // descriptor, it's time to wake up the coroutines that are waiting
             // on that event.
-            struct coroutine *key = &(struct coroutine) { 
-                .evfd = fd, 
-                .evkind = kind,
+            struct evwaiter *key = &(struct evwaiter) { 
+                .fd = fd, 
+                .kind = kind,
             };
-            struct coroutine *co = evmap_iter(&rt->evwaiters, key);
-            while (co && co->evfd == fd && co->evkind == kind) {
-                sco_resume(co->id);
-                co = evmap_next(&rt->evwaiters, co);
+            struct evwaiter *w = evmap_iter(&rt->evwaiters, key);
+            while (w && w->fd == fd && w->kind == kind) {
+                if (w->ret_idx && *w->ret_idx == -1) {
+                    *w->ret_idx = w->idx;
+                }
+                if (w->ready) {
+                    *w->ready |= (int)w->kind;
+                }
+                sco_resume(w->co->id);
+                w = evmap_next(&rt->evwaiters, w);
             }
         }
     }
@@ -4155,6 +4655,17 @@ int64_t i64_add_clamp(int64_t a, int64_t b) {
 
 #define MAX_TIMEOUT 500000000 // 500 ms
 
+static void chantimer_fire(struct chantimer *timer, int64_t now);
+
+// Fire all channel timers that have reached their deadline.
+static void rt_sched_timer_step(int64_t now) {
+    struct chantimer *timer = tmqueue_first(&rt->timers);
+    while (timer && timer->deadline <= now) {
+        chantimer_fire(timer, now);
+        timer = tmqueue_first(&rt->timers);
+    }
+}
+
 // Handle paused couroutines.
 static void rt_sched_paused_step(void) {
     // Resume all the paused coroutines that are waiting for immediate 
@@ -4187,6 +4698,14 @@ static void rt_sched_paused_step(void) {
             timeout = timeout0;
         }
     }
+    if (timeout > 0 && rt->ntimers > 0) {
+        // Same for the channel timer with the minimum deadline.
+        int64_t min_deadline = tmqueue_first(&rt->timers)->deadline;
+        int64_t timeout0 = i64_add_clamp(min_deadline, -getnow());
+        if (timeout0 < timeout) {
+            timeout = timeout0;
+        }
+    }
     timeout = CLAMP(timeout, 0, MAX_TIMEOUT);
     
 #ifndef NECO_NOWORKERS
@@ -4234,6 +4753,12 @@ static void rt_sched_paused_step(void) {
         sco_resume(co->id);
         co = dlqueue_next(&rt->deadlines, co);
     }
+
+    // Fire the channel timers. This happens after the deadliners are marked
+    // so that a timed out receiver does not swallow a tick.
+    if (rt->ntimers > 0) {
+        rt_sched_timer_step(now);
+    }
 }
 
 // Resource collection step
@@ -4275,7 +4800,7 @@ static int rt_scheduler(void) {
     // magic happens.
     int ret = NECO_OK;
     while (sco_active()) {
-        if (sco_info_paused() > 0) {
+        if (sco_info_paused() > 0 || rt->ntimers > 0) {
             rt_sched_paused_step();
         }
         rt_rc_step();
@@ -4293,14 +4818,13 @@ static int rt_scheduler(void) {
     return ret;
 }
 
-static void rt_freezchanpool(void) {
-    for (int i = 0; i < rt->zchanpoollen; i++) {
-        free0(rt->zchanpool[i]);
-    }
-    if (rt->zchanpool) {
-        free0(rt->zchanpool);
-    }
-}
+static void rt_freesegpool(void);
+#ifdef __linux__
+static void rt_freepipepool(void);
+#endif
+static void rt_freecontention(void);
+static void rt_freeconnpool(void);
+static void rt_freegaicache(void);
 
 static struct stack_opts stack_opts_make(void) {
     return (struct stack_opts) { 
@@ -4379,7 +4903,7 @@ static int run(void(*coroutine)(int, void**), int nargs, va_list *args,
 #endif
 
     // Start the main coroutine. Actually, it's just queued to run first.
-    ret = start(coroutine, nargs, args, argv, 0, 0);
+    ret = start(coroutine, nargs, args, argv, 0, 0, 0, 0, 0);
     if (ret != NECO_OK) {
         goto fail;
     }
@@ -4389,12 +4913,20 @@ static int run(void(*coroutine)(int, void**), int nargs, va_list *args,
 
 fail:
     stack_mgr_destroy(&rt->stkmgr);
-    rt_freezchanpool();
+    rt_freesegpool();
+#ifdef __linux__
+    rt_freepipepool();
+#endif
+    rt_freecontention();
+    rt_freeconnpool();
+    rt_freegaicache();
+    free0(rt->keys);
     rt_restore_signal_handlers();
     rt_release_dlhandles();
 #ifndef NECO_NOWORKERS
     worker_free(rt->worker);
 #endif
+    rt_freeslabs();
     rt_release();
     return ret;
 }
@@ -4409,7 +4941,7 @@ static int startv(void(*coroutine)(int argc, void *argv[]), int argc,
     if (!rt) {
         ret = run(coroutine, argc, args, argv);
     } else {
-        ret = start(coroutine, argc, args, argv, gen, gen_data_size);
+        ret = start(coroutine, argc, args, argv, gen, gen_data_size, 0, 0, 0);
     }
     return ret;
 }
@@ -4459,44 +4991,216 @@ int neco_startv(void(*coroutine)(int argc, void *argv[]), int argc,
     return ret;
 }
 
-static int yield(void) {
+// The largest closure that can be copied onto a coroutine stack.
+#define CLOSURE_MAX (NECO_STACKSIZE/8)
+
+static int start_closure(void(*coroutine)(int argc, void *argv[]), 
+    const void *data, size_t size)
+{
+    if (!coroutine || (!data && size > 0) || size > CLOSURE_MAX) {
+        return NECO_INVAL;
+    }
     if (!rt) {
         return NECO_PERM;
     }
-    coyield();
-    return NECO_OK;
+    return start(coroutine, 1, 0, &(void*){0}, 0, 0, 0, data ? data : "", 
+        size);
 }
 
-/// Cause the calling coroutine to relinquish the CPU.
-/// The coroutine is moved to the end of the queue.
+/// Starts a new coroutine with a copy of the provided closure.
+///
+/// The closure bytes are copied onto the new coroutine's own stack, which
+/// avoids a heap allocation and frees the caller from keeping the data alive
+/// after this call returns. The coroutine receives a single argument that
+/// points to its copy, aligned to 16 bytes. The copy remains valid until the
+/// coroutine exits.
+///
+/// **Example**
+///
+/// ```
+/// struct conn { int fd; int64_t started; };
+///
+/// void handle(int argc, void *argv[]) {
+///     struct conn *conn = argv[0];
+///     ...
+/// }
+///
+/// struct conn conn = { .fd = fd, .started = neco_now() };
+/// neco_start_closure(handle, &conn, sizeof(conn));
+/// ```
+///
+/// @param coroutine The coroutine that will soon run
+/// @param data The closure data to copy
+/// @param size Size of the closure data, no more than 1/8th of the stack size
 /// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
 /// @return NECO_PERM Operation called outside of a coroutine
-int neco_yield(void) {
-    int ret = yield();
+int neco_start_closure(void(*coroutine)(int argc, void *argv[]), 
+    const void *data, size_t size)
+{
+    int ret = start_closure(coroutine, data, size);
     error_guard(ret);
     return ret;
 }
 
-// cofind returns the coroutine belonging to the provided identifier.
-static struct coroutine *cofind(int64_t id) {
-    struct coroutine *co = NULL;
-    if (rt) {
-        co = comap_search(&rt->all, &(struct coroutine){ .id = id });
+static int start_many(void(*coroutine)(int argc, void *argv[]), int n,
+    int argc, void(*argsfn)(int index, void *argv[], void *udata), 
+    void *udata)
+{
+    if (!coroutine || n < 0 || argc < 0 || (argc > 0 && !argsfn)) {
+        return NECO_INVAL;
     }
-    return co;
-}
-
-// pause the currently running coroutine with the provided deadline.
-static void copause(int64_t deadline) {
-    struct coroutine *co = coself();
-    // Cannot pause an already canceled or deadlined coroutine.
-    if (!co->canceled && !co->deadlined) {
-        co->deadline = deadline;
-        if (co->deadline < INT64_MAX) {
-            dlqueue_insert(&rt->deadlines, co);
-            rt->ndeadlines++;
-        }
-        co->paused = true;
+    if (!rt) {
+        return NECO_PERM;
+    }
+    // Reserve every coroutine, stack, and argument array up front so that
+    // either all children are started or none are. The stacks that are not
+    // covered by the pool are allocated by the stack manager at once.
+    if (n > rt->npool && 
+        stack_reserve(&rt->stkmgr, (size_t)(n - rt->npool)) == -1)
+    {
+        return NECO_NOMEM;
+    }
+    struct colist reserved;
+    colist_init(&reserved);
+    for (int i = 0; i < n; i++) {
+        struct coroutine *co = coroutine_get();
+        if (!co) {
+            goto fail;
+        }
+        if (argc <= (int)(sizeof(co->aargv)/sizeof(void*))) {
+            co->argv = co->aargv;
+        } else {
+            co->argv = malloc0((size_t)argc * sizeof(void*));
+            if (!co->argv) {
+                coroutine_put(co);
+                goto fail;
+            }
+        }
+        colist_push_back(&reserved, co);
+    }
+    struct coroutine *starter = coself();
+    for (int i = 0; i < n; i++) {
+        struct coroutine *co = colist_pop_front(&reserved);
+        co->coroutine = coroutine;
+        co->canceltype = env_canceltype;
+        co->cancelstate = env_cancelstate;
+        co->argc = argc;
+        memset(co->argv, 0, (size_t)argc * sizeof(void*));
+        if (argsfn) {
+            argsfn(i, co->argv, udata);
+        }
+        if (starter->ctx) {
+            ctx_attach(co, starter->ctx);
+        }
+        // The child is registered now, but the scheduler switches to it for
+        // the first time only after the starter yields or blocks.
+        co->pending.desc = (struct sco_desc) {
+            .stack = costackaddr(co),
+            .stack_size = costacksize(co),
+            .entry = coentry,
+            .cleanup = cleanup,
+            .udata = co,
+        };
+        co->id = sco_start_later(&co->pending);
+        co->starterid = starter->id;
+        co->queued = true;
+        starter->lastid = co->id;
+        rt->ntotal++;
+        comap_insert(&rt->all, co);
+    }
+    return NECO_OK;
+fail:
+    while (!colist_is_empty(&reserved)) {
+        coroutine_put(colist_pop_front(&reserved));
+    }
+    return NECO_NOMEM;
+}
+
+/// Starts many coroutines at once.
+///
+/// This is like calling neco_startv() n times, except that the caller does
+/// not switch to each child. All resources for the children are reserved
+/// up front, with the stacks allocated in bulk, and the children are queued.
+/// They begin running, in order, once the caller yields or blocks.
+/// Queued children already have their identifiers and may be joined or
+/// canceled before they start.
+///
+/// **Example**
+///
+/// ```
+/// void fill(int index, void *argv[], void *udata) {
+///     argv[0] = &((struct job*)udata)[index];
+/// }
+///
+/// neco_start_many(worker, 100000, 1, fill, jobs);
+/// ```
+///
+/// @param coroutine The coroutine that each child will run
+/// @param n Number of coroutines to start
+/// @param argc Number of arguments for each coroutine
+/// @param argsfn Function that fills in the arguments for each child
+/// @param udata User data passed to argsfn
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources, no
+/// coroutines were started
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_start_many(void(*coroutine)(int argc, void *argv[]), int n,
+    int argc, void(*argsfn)(int index, void *argv[], void *udata), 
+    void *udata)
+{
+    int ret = start_many(coroutine, n, argc, argsfn, udata);
+    error_guard(ret);
+    return ret;
+}
+
+static int yield(void) {
+    if (!rt) {
+        return NECO_PERM;
+    }
+    coyield();
+    return NECO_OK;
+}
+
+/// Cause the calling coroutine to relinquish the CPU.
+/// The coroutine is moved to the end of the queue.
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_yield(void) {
+    int ret = yield();
+    error_guard(ret);
+    return ret;
+}
+
+// cofind returns the coroutine belonging to the provided identifier.
+static struct coroutine *cofind(int64_t id) {
+    struct coroutine *co = NULL;
+    if (rt) {
+        co = comap_search(&rt->all, &(struct coroutine){ .id = id });
+    }
+    return co;
+}
+
+// pause the currently running coroutine with the provided deadline.
+static void copause(int64_t deadline) {
+    struct coroutine *co = coself();
+    if (co->ctx) {
+        if (ctxcanceled(co)) {
+            return;
+        }
+        deadline = codeadline(co, deadline);
+    }
+    // Cannot pause an already canceled or deadlined coroutine.
+    if (!co->canceled && !co->deadlined) {
+        co->deadline = deadline;
+        if (co->deadline < INT64_MAX) {
+            dlqueue_insert(&rt->deadlines, co);
+            rt->ndeadlines++;
+        }
+        co->paused = true;
+        co->npauses++;
         sco_pause();
         co->paused = false;
         if (co->deadline < INT64_MAX) {
@@ -4509,10 +5213,13 @@ static void copause(int64_t deadline) {
 
 static int sleep0(int64_t deadline) {
     struct coroutine *co = coself();
+    // The context deadline may end the sleep early.
+    bool ctxdl = codeadline(co, deadline) < deadline;
     rt->nsleepers++;
     copause(deadline);
     rt->nsleepers--;
-    int ret = co->canceled ? NECO_CANCELED : NECO_OK;
+    int ret = co->canceled || ctxcanceled(co) ? NECO_CANCELED : 
+        ctxdl ? NECO_TIMEDOUT : NECO_OK;
     co->canceled = false;
     co->deadlined = false;
     return ret;
@@ -4601,7 +5308,7 @@ static int64_t starterid(void) {
 // co->canceled and co->deadlined flags to false, and returns the appropriate
 // error code. This is typically used from *_dl operations.
 static int checkdl(struct coroutine *co, int64_t deadline) {
-    if (!co->canceled && !co->deadlined && deadline == INT64_MAX) {
+    if (!co->canceled && !co->deadlined && deadline == INT64_MAX && !co->ctx) {
         // Most cases.
         return NECO_OK;
     }
@@ -4609,6 +5316,10 @@ static int checkdl(struct coroutine *co, int64_t deadline) {
     bool deadlined = co->deadlined;
     co->canceled = false;
     co->deadlined = false;
+    if (co->ctx) {
+        canceled = canceled || ctxcanceled(co);
+        deadline = codeadline(co, deadline);
+    }
     if (!canceled && !deadlined && deadline < INT64_MAX && getnow() > deadline){
         deadlined = true;
     }
@@ -4637,6 +5348,23 @@ int64_t neco_starterid(void) {
     return ret;
 }
 
+// Called when the cancel state of a coroutine is enabled again. Cancels that
+// were held back while it was disabled are delivered now.
+static void cancel_enabled(struct coroutine *co) {
+    if (co->gcancelpending) {
+        // The group was canceled in the meantime. The next operation of the
+        // coroutine returns NECO_CANCELED.
+        co->gcancelpending = false;
+        co->canceled = true;
+    }
+    // Let the held back cancelers try again.
+    struct coroutine *cowaiter = colist_pop_front(&co->cancellist);
+    while (cowaiter) {
+        sched_resume(cowaiter);
+        cowaiter = colist_pop_front(&co->cancellist);
+    }
+}
+
 static int cancel_dl(int64_t id, int64_t deadline) {
     struct coroutine *co = coself();
     if (!co) {
@@ -4681,415 +5409,1930 @@ int neco_cancel(int64_t id) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// signals
+// contexts
 ////////////////////////////////////////////////////////////////////////////////
 
-static int signal_watch(int signo) {
-    if (signo < 1 || signo > 31) {
+static void ctx_release(struct neco_context *ctx) {
+    while (ctx && --ctx->rc == 0) {
+        struct neco_context *parent = ctx->parent;
+        if (parent) {
+            if (ctx->sibprev) {
+                ctx->sibprev->signext = ctx->signext;
+            } else {
+                parent->children = ctx->signext;
+            }
+            if (ctx->signext) {
+                ctx->signext->sibprev = ctx->sibprev;
+            }
+        }
+        free0(ctx);
+        // Release the reference that was held on the parent.
+        ctx = parent;
+    }
+}
+
+static void ctx_link(struct neco_context *ctx, struct coroutine *co) {
+    co->cxnext = NULL;
+    co->cxprev = ctx->tail;
+    if (ctx->tail) {
+        ctx->tail->cxnext = co;
+    } else {
+        ctx->head = co;
+    }
+    ctx->tail = co;
+}
+
+static void ctx_unlink(struct neco_context *ctx, struct coroutine *co) {
+    if (co->cxprev) {
+        co->cxprev->cxnext = co->cxnext;
+    } else {
+        ctx->head = co->cxnext;
+    }
+    if (co->cxnext) {
+        co->cxnext->cxprev = co->cxprev;
+    } else {
+        ctx->tail = co->cxprev;
+    }
+    co->cxprev = NULL;
+    co->cxnext = NULL;
+}
+
+static void ctx_attach(struct coroutine *co, struct neco_context *ctx) {
+    ctx->rc++;
+    co->ctx = ctx;
+    co->cxgen = 0;
+    ctx_link(ctx, co);
+}
+
+static void ctx_detach(struct coroutine *co) {
+    struct neco_context *ctx = co->ctx;
+    ctx_unlink(ctx, co);
+    co->ctx = NULL;
+    ctx_release(ctx);
+}
+
+// Wake all paused coroutines that are attached to the context. Members are
+// moved to the tail of the list as they are woken, which allows for safely
+// resuming each one, even when they detach or start new members.
+static void ctx_wake(struct neco_context *ctx, int64_t gen) {
+    while (ctx->head && ctx->head->cxgen != gen) {
+        struct coroutine *member = ctx->head;
+        ctx_unlink(ctx, member);
+        ctx_link(ctx, member);
+        member->cxgen = gen;
+        if (member->paused && member->cancelstate == NECO_CANCEL_ENABLE) {
+            sco_resume(member->id);
+        }
+    }
+}
+
+static void ctx_cancel(struct neco_context *ctx) {
+    ctx->canceled = true;
+    ctx_wake(ctx, ++rt->ctxgen);
+    // Cancel all of the descendants too. The list of children may change 
+    // while the members are being woken, so start over from the first child
+    // that has not yet been canceled.
+    while (1) {
+        struct neco_context *child = ctx->children;
+        while (child && child->canceled) {
+            child = child->signext;
+        }
+        if (!child) {
+            break;
+        }
+        child->rc++;
+        ctx_cancel(child);
+        ctx_release(child);
+    }
+}
+
+static int check_context(struct neco_context *ctx) {
+    if (!ctx) {
+        return NECO_INVAL;
+    } else if (!rt || ctx->rtid != rt->id) {
+        return NECO_PERM;
+    }
+    return NECO_OK;
+}
+
+static int context_make(neco_context **ctx, int64_t deadline) {
+    if (!ctx) {
         return NECO_INVAL;
     }
     struct coroutine *co = coself();
-    if (!co || !rt->mainthread) {
+    if (!co) {
         return NECO_PERM;
     }
-    if ((co->sigwatch & (UINT32_C(1) << signo)) == 0) {
-        co->sigwatch |= UINT32_C(1) << signo;
-        rt->sigwatchers[signo]++;
+    struct neco_context *c = malloc0(sizeof(struct neco_context));
+    if (!c) {
+        return NECO_NOMEM;
+    }
+    memset(c, 0, sizeof(struct neco_context));
+    c->rtid = rt->id;
+    c->rc = 1;
+    c->deadline = codeadline(co, deadline);
+    c->parent = co->ctx;
+    if (c->parent) {
+        c->parent->rc++;
+        c->signext = c->parent->children;
+        if (c->signext) {
+            c->signext->sibprev = c;
+        }
+        c->parent->children = c;
     }
+    *ctx = c;
     return NECO_OK;
 }
 
-
-/// Have the current coroutine watch for a signal.
-///
-/// This can be used to intercept or ignore signals.
+/// Create a new context.
 ///
-/// Signals that can be watched: SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGPIPE,
-/// SIGUSR1, SIGUSR2, SIGALRM
+/// A context carries a deadline and a cancel signal that every blocking Neco
+/// operation honors implicitly. It's attached to a coroutine using
+/// neco_context_set() and is inherited by all coroutines that are started
+/// afterwards by that coroutine.
 ///
-/// Signals that _can not_ be watched: SIGILL, SIGFPE, SIGSEGV, SIGBUS, SIGTRAP
+/// The new context is derived from the context of the current coroutine,
+/// if any. It has the sooner of the two deadlines, and is canceled when its
+/// parent is canceled.
 ///
 /// **Example**
 ///
 /// ```
-/// // Set up this coroutine to watich for the SIGINT (Ctrl-C) and SIGQUIT
-/// // (Ctrl-\) signals.
-/// neco_signal_watch(SIGINT);
-/// neco_signal_watch(SIGQUIT);
-///
-/// printf("Waiting for Ctrl-C or Ctrl-\\ signals...\n");
-/// int sig = neco_signal_wait();
-/// if (sig == SIGINT) {
-///     printf("\nReceived Ctrl-C\n");
-/// } else if (sig == SIGQUIT) {
-///     printf("\nReceived Ctrl-\\\n");
+/// // Give this request and everything it starts 250ms to complete.
+/// neco_context *ctx;
+/// neco_context_make(&ctx, neco_now() + NECO_MILLISECOND*250);
+/// neco_context_set(ctx);
+/// for (int i = 0; i < nbackends; i++) {
+///     neco_start(fetch_backend, 1, &backends[i]);
 /// }
-///
-/// // The neco_signal_unwatch is used to stop watching.
-/// neco_signal_unwatch(SIGINT);
-/// neco_signal_unwatch(SIGQUIT);
+/// ...
+/// // Cancel the stragglers.
+/// neco_context_cancel(ctx);
+/// neco_context_release(ctx);
 /// ```
 ///
-/// @param signo The signal number
+/// @param ctx The new context
+/// @param deadline The deadline, or INT64_MAX for none
 /// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
 /// @return NECO_INVAL An invalid parameter was provided
 /// @return NECO_PERM Operation called outside of a coroutine
-/// @see Signals
-int neco_signal_watch(int signo) {
-    int ret = signal_watch(signo);
+/// @see Contexts
+int neco_context_make(neco_context **ctx, int64_t deadline) {
+    int ret = context_make(ctx, deadline);
     error_guard(ret);
     return ret;
 }
 
-static int signal_unwatch(int signo) {
-    if (signo < 1 || signo > 31) {
-        return NECO_INVAL;
-    }
-    struct coroutine *co = coself();
-    if (!co || !rt->mainthread) {
-        return NECO_PERM;
-    }
-    if ((co->sigwatch & (UINT32_C(1) << signo)) != 0) {
-        co->sigwatch &= ~(UINT32_C(1) << signo);
-        rt->sigwatchers[signo]--;
+static int context_release(neco_context *ctx) {
+    int ret = check_context(ctx);
+    if (ret != NECO_OK) {
+        return ret;
     }
+    ctx_release(ctx);
     return NECO_OK;
 }
 
-/// Stop watching for a siganl to arrive
-/// @param signo The signal number
-/// @return NECO_OK on success or an error
-int neco_signal_unwatch(int signo) {
-    int ret = signal_unwatch(signo);
+/// Release a context.
+///
+/// The context is freed once it's no longer attached to any coroutines.
+/// @param ctx The context
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_context_release(neco_context *ctx) {
+    int ret = context_release(ctx);
     error_guard(ret);
     return ret;
 }
 
-static int signal_wait_dl(int64_t deadline) {
-    struct coroutine *co = coself();
-    if (!rt || !rt->mainthread) {
+static int context_cancel(neco_context *ctx) {
+    int ret = check_context(ctx);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (!coself()) {
         return NECO_PERM;
-    } 
-    if (co->sigwatch == 0) {
-        return NECO_NOSIGWATCH;
     }
-    if (co->canceled) {
-        co->canceled = false;
-        return NECO_CANCELED;
+    if (!ctx->canceled) {
+        ctx->rc++;
+        ctx_cancel(ctx);
+        ctx_release(ctx);
     }
-    co->sigmask = co->sigwatch;
-    colist_push_back(&rt->sigwaiters, co);
-    rt->nsigwaiters++;
-    copause(deadline);
-    remove_from_list(co);
-    rt->nsigwaiters--;
-    int signo = (int)co->sigmask;
-    co->sigmask = 0;
-    int ret = checkdl(co, INT64_MAX);
-    return ret == NECO_OK ? signo : ret;
+    return NECO_OK;
 }
 
-/// Same as neco_signal_wait() but with a deadline parameter. 
-int neco_signal_wait_dl(int64_t deadline) {
-    int ret = signal_wait_dl(deadline);
+/// Cancel a context.
+///
+/// All coroutines attached to the context, or any of its descendants, are
+/// woken and their blocking operations return NECO_CANCELED. Any blocking
+/// operations that follow also return NECO_CANCELED.
+/// Coroutines with their cancel state disabled are not affected.
+/// @param ctx The context
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_context_cancel(neco_context *ctx) {
+    int ret = context_cancel(ctx);
     async_error_guard(ret);
     return ret;
 }
 
-/// Wait for a signal to arrive.
-/// @return A signal number or an error.
-/// @return NECO_PERM
-/// @return NECO_NOSIGWATCH if not currently watching for signals.
-/// @return NECO_CANCELED
-/// @see Signals
-/// @see neco_signal_wait_dl()
-int neco_signal_wait(void) {
-    return neco_signal_wait_dl(INT64_MAX);
-}
-
-static int64_t now0(void) {
-    if (!rt) {
+static int context_set(neco_context *ctx) {
+    if (ctx) {
+        int ret = check_context(ctx);
+        if (ret != NECO_OK) {
+            return ret;
+        }
+    }
+    struct coroutine *co = coself();
+    if (!co) {
         return NECO_PERM;
+    }
+    if (co->ctx == ctx) {
+        return NECO_OK;
+    }
+    if (ctx) {
+        // Attach before detaching, in case the old context holds the only
+        // reference to the new one.
+        struct neco_context *old = co->ctx;
+        if (old) {
+            ctx_unlink(old, co);
+        }
+        ctx_attach(co, ctx);
+        ctx_release(old);
     } else {
-        return getnow();
+        ctx_detach(co);
     }
+    return NECO_OK;
 }
 
-/// Get the current time.
-///
-/// This operation calls gettime(CLOCK_MONOTONIC) to retreive a monotonically
-/// increasing value that is not affected by discontinuous jumps in the system
-/// time.
-///
-/// This value IS NOT the same as the local system time; for that the user
-/// should call gettime(CLOCK_REALTIME).
-///
-/// The main purpose of this function to work with operations that use
-/// deadlines, i.e. functions with the `*_dl()` suffix.
-///
-/// **Example**
+/// Attach a context to the current coroutine, replacing the existing one.
 ///
-/// ```
-/// // Receive a message from a channel using a deadline of one second from now.
-/// int ret = neco_chan_recv_dl(ch, &msg, neco_now() + NECO_SECOND);
-/// if (ret == NECO_TIMEDOUT) {
-///     // The operation timed out
-/// }
-/// ```
-///
-/// @return On success, the current time as nanoseconds.
+/// Use NULL to detach the current context.
+/// @param ctx The context, or NULL
+/// @return NECO_OK Success
 /// @return NECO_PERM Operation called outside of a coroutine
-/// @see Time
-int64_t neco_now(void) {
-    int64_t now = now0();
-    error_guard(now); 
-    return now;
+int neco_context_set(neco_context *ctx) {
+    int ret = context_set(ctx);
+    error_guard(ret);
+    return ret;
 }
 
-#if defined(NECO_TESTING)
-// Allow for tests to set a fail flag for testing event queue failures.
-__thread bool neco_fail_cowait = false;
-#endif
-
-#if defined(NECO_POLL_EPOLL)
-static int wait_dl_addevent(struct coroutine *co, int fd, enum evkind kind) {
-    (void)co;
-    struct epoll_event ev = { 0 };
-    ev.data.fd = fd;
-    if (kind == EVREAD) {
-        ev.events = EPOLLIN | EPOLLONESHOT;
-        ev.events |= evexists(fd, EVWRITE) ? EPOLLOUT : 0;
-    } else {
-        ev.events = EPOLLOUT | EPOLLONESHOT;
-        ev.events |= evexists(fd, EVREAD) ? EPOLLIN : 0;
+static int context_get(neco_context **ctx) {
+    if (!ctx) {
+        return NECO_INVAL;
     }
-    int ret = epoll_ctl0(rt->qfd, EPOLL_CTL_MOD, fd, &ev);
-    if (ret == -1) {
-        ret = epoll_ctl0(rt->qfd, EPOLL_CTL_ADD, fd, &ev);
+    struct coroutine *co = coself();
+    if (!co) {
+        return NECO_PERM;
     }
-    return ret;
+    *ctx = co->ctx;
+    return NECO_OK;
 }
-static void wait_dl_delevent(struct coroutine *co, int fd, enum evkind kind) {
-    // Using oneshot. Nothing to do.
-    (void)co; (void)fd; (void)kind;
+
+/// Get the context that is attached to the current coroutine, or NULL if
+/// there is none. No reference is added to the returned context.
+/// @param ctx The context
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_context_get(neco_context **ctx) {
+    int ret = context_get(ctx);
+    error_guard(ret);
+    return ret;
 }
 
-#elif defined(NECO_POLL_KQUEUE)
-static int wait_dl_addevent(struct coroutine *co, int fd, enum evkind kind) {
-    (void)co;
-    int ret = 0;
-    if (!evexists(fd, kind)) {
-        struct kevent ev = { 
-            .ident = (uintptr_t)fd, 
-            .flags = EV_ADD | EV_ONESHOT,
-            .filter = kind == EVREAD ? EVFILT_READ : EVFILT_WRITE,
-        };
-        ret = kevent0(rt->qfd, &ev, 1, NULL, 0, NULL);
+////////////////////////////////////////////////////////////////////////////////
+// coroutine-local storage
+////////////////////////////////////////////////////////////////////////////////
+
+// A key is the slot index in the low 32 bits and the slot generation in the
+// high 32 bits. The generation stops a value that was set using a deleted
+// key from being seen through a new key that reuses the same slot.
+#define KEY_SLOT(key) ((int)((key) & 0xFFFFFFFF))
+#define KEY_GEN(key) ((key) >> 32)
+
+// Destructors may set new values, so destroying is repeated this many times.
+#define KEY_DESTRUCTOR_ITERATIONS 4
+
+struct cokey {
+    bool used;
+    int64_t gen;
+    void(*destructor)(void *value);
+};
+
+struct coslot {
+    void *value;
+    int64_t gen;
+};
+
+static struct cokey *key_get(int64_t key) {
+    int slot = KEY_SLOT(key);
+    if (key < 0 || slot >= rt->nkeys || !rt->keys[slot].used || 
+        rt->keys[slot].gen != KEY_GEN(key))
+    {
+        return 0;
     }
-    return ret;
+    return &rt->keys[slot];
 }
 
-static void wait_dl_delevent(struct coroutine *co, int fd, enum evkind kind) {
-    // Using oneshot. Nothing to do.
-    (void)co; (void)fd; (void)kind;
+static void coslots_destroy(struct coroutine *co) {
+    for (int i = 0; i < KEY_DESTRUCTOR_ITERATIONS; i++) {
+        bool called = false;
+        for (int j = 0; j < co->nslots; j++) {
+            struct coslot *slot = &co->slots[j];
+            if (!slot->value) {
+                continue;
+            }
+            void *value = slot->value;
+            slot->value = 0;
+            if (j < rt->nkeys && rt->keys[j].used && 
+                rt->keys[j].gen == slot->gen && rt->keys[j].destructor)
+            {
+                rt->keys[j].destructor(value);
+                called = true;
+            }
+        }
+        if (!called) {
+            break;
+        }
+    }
+    // The slots array is kept for the next coroutine that uses this
+    // structure from the pool.
+    memset(co->slots, 0, (size_t)co->nslots * sizeof(struct coslot));
 }
-#endif
 
-// wait_dl makes the current coroutine wait for the file descriptor to be
-// available for reading or writing.
-static int wait_dl(int fd, enum evkind kind, int64_t deadline) {
-    if (kind != EVREAD && kind != EVWRITE) {
+static int key_create(int64_t *key, void(*destructor)(void *value)) {
+    if (!key) {
         return NECO_INVAL;
-    } else if (!rt) {
+    }
+    if (!rt) {
         return NECO_PERM;
     }
-    struct coroutine *co = coself();
-#if !defined(NECO_POLL_EPOLL) && !defined(NECO_POLL_KQUEUE)
-    // Windows and Emscripten only yield, until support for events queues
-    // are enabled.
-    (void)fd; (void)deadline;
-    (void)evmap_insert; (void)evmap_delete; (void)evexists;
-
-    sco_yield();
-#else
-    if (rt->qfd == 0) {
-        // The scheduler currently does not have an event queue for handling
-        // file events. Create one now. This new queue will be shared for the 
-        // entirety of the scheduler. It will be automatically freed when it's
-        // no longer needed, by the scheduler.
-        rt->qfd = evqueue0();
-        if (rt->qfd == -1) {
-            // Error creating the event queue. This is usually due to a system
-            // that is low on resources or is limiting the number of file
-            // descriptors allowed by a program, e.g. ulimit. 
-            rt->qfd = 0;
-            return -1;
+    int slot = 0;
+    while (slot < rt->nkeys && rt->keys[slot].used) {
+        slot++;
+    }
+    if (slot == rt->keyscap) {
+        int cap = rt->keyscap == 0 ? 8 : rt->keyscap * 2;
+        struct cokey *keys = realloc0(rt->keys, (size_t)cap * 
+            sizeof(struct cokey));
+        if (!keys) {
+            return NECO_NOMEM;
         }
-        // The queue was successfully created.
-        rt->qfdcreated = getnow();
+        rt->keys = keys;
+        rt->keyscap = cap;
     }
-
-    int ret = wait_dl_addevent(co, fd, kind);
-    if (ret == -1) {
-        return -1;
+    if (slot == rt->nkeys) {
+        rt->nkeys++;
     }
+    rt->keygen++;
+    rt->keys[slot] = (struct cokey) { 
+        .used = true,
+        .gen = rt->keygen & 0x7FFFFFFF,
+        .destructor = destructor,
+    };
+    *key = (rt->keys[slot].gen << 32) | slot;
+    return NECO_OK;
+}
 
-    co->evfd = fd;
-    co->evkind = kind;
-
-    // Add this coroutine, chaining it to the distinct fd/kind.
-    // This creates a unique record in the evwaiters list
-    evmap_insert(&rt->evwaiters, co);
-    rt->nevwaiters++;
+/// Create a key for coroutine-local storage.
+///
+/// Each coroutine has its own value for the key, which starts out as NULL.
+/// When a coroutine exits, the destructor (if provided) is called for every
+/// non-NULL value that the coroutine holds for the key.
+///
+/// Keys belong to the runtime of the calling thread and should only be used
+/// by coroutines on that runtime.
+/// @param key The new key
+/// @param destructor Optional destructor for values, may be NULL
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see neco_key_delete, neco_getspecific, neco_setspecific
+int neco_key_create(int64_t *key, void(*destructor)(void *value)) {
+    int ret = key_create(key, destructor);
+    error_guard(ret);
+    return ret;
+}
 
-    // Now wait for the scheduler to wake this coroutine up again.
-    copause(deadline);
+static int key_delete(int64_t key) {
+    if (!rt) {
+        return NECO_PERM;
+    }
+    struct cokey *k = key_get(key);
+    if (!k) {
+        return NECO_INVAL;
+    }
+    k->used = false;
+    k->destructor = 0;
+    return NECO_OK;
+}
 
-    // Delete from evwaiters.
-    evmap_delete(&rt->evwaiters, co);
-    rt->nevwaiters--;
+/// Delete a key.
+///
+/// No destructors are called for values that coroutines hold for the key,
+/// freeing those values is the responsibility of the caller.
+/// @param key The key
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_key_delete(int64_t key) {
+    int ret = key_delete(key);
+    error_guard(ret);
+    return ret;
+}
 
-    co->evfd = 0;
-    co->evkind = 0;
+static void *getspecific(int64_t key) {
+    struct coroutine *co = coself();
+    if (!co || !key_get(key)) {
+        return 0;
+    }
+    int slot = KEY_SLOT(key);
+    if (slot >= co->nslots || co->slots[slot].gen != KEY_GEN(key)) {
+        return 0;
+    }
+    return co->slots[slot].value;
+}
 
-    wait_dl_delevent(co, fd, kind);
-#endif
-    return checkdl(co, INT64_MAX);
+/// Get the current coroutine's value for a key.
+/// @param key The key
+/// @return The value, or NULL if there is no value or the key is invalid
+void *neco_getspecific(int64_t key) {
+    return getspecific(key);
 }
 
-/// Same as neco_wait() but with a deadline parameter. 
-int neco_wait_dl(int fd, int mode, int64_t deadline) {
-    int ret = wait_dl(fd, mode, deadline);
-    async_error_guard(ret);
-    return ret;
+static int setspecific(int64_t key, const void *value) {
+    struct coroutine *co = coself();
+    if (!co) {
+        return NECO_PERM;
+    }
+    if (!key_get(key)) {
+        return NECO_INVAL;
+    }
+    int slot = KEY_SLOT(key);
+    if (slot >= co->nslots) {
+        int nslots = co->nslots == 0 ? 8 : co->nslots;
+        while (nslots <= slot) {
+            nslots *= 2;
+        }
+        struct coslot *slots = realloc0(co->slots, (size_t)nslots * 
+            sizeof(struct coslot));
+        if (!slots) {
+            return NECO_NOMEM;
+        }
+        memset(&slots[co->nslots], 0, (size_t)(nslots - co->nslots) * 
+            sizeof(struct coslot));
+        co->slots = slots;
+        co->nslots = nslots;
+    }
+    co->slots[slot].value = (void*)value;
+    co->slots[slot].gen = KEY_GEN(key);
+    return NECO_OK;
 }
 
-/// Wait for a file descriptor to be ready for reading or writing.
-///
-/// Normally one should use neco_read() and neco_write() to read and write
-/// data. But there may be times when you need more involved logic or to use
-/// alternative functions such as `recvmsg()` or `sendmsg()`.
-///
-/// ```
-/// while (1) {
-///     int n = recvmsg(sockfd, msg, MSG_DONTWAIT);
-///     if (n == -1) {
-///         if (errno == EAGAIN) {
-///             // The socket is not ready for reading.
-///             neco_wait(sockfd, NECO_WAIT_READ);
-///             continue;
-///         }
-///         // Socket error.
-///         return;
-///     }
-///     // Message received.
-///     break;
-/// }
-/// ```
-/// 
-/// @param fd The file descriptor
-/// @param mode NECO_WAIT_READ or NECO_WAIT_WRITE
+/// Set the current coroutine's value for a key.
+/// @param key The key
+/// @param value The value
 /// @return NECO_OK Success
 /// @return NECO_NOMEM The system lacked the necessary resources
 /// @return NECO_INVAL An invalid parameter was provided
 /// @return NECO_PERM Operation called outside of a coroutine
-/// @return NECO_ERROR Check errno for more info
-/// @see Posix2
-int neco_wait(int fd, int mode) {
-    return neco_wait_dl(fd, mode, INT64_MAX);
-}
-
-// cowait makes the current coroutine wait for the file descriptor to be
-// available for reading or writing. Any kind of error encountered by this 
-// operation will cause the coroutine to be rescheduled, with the error
-// gracefully being ignored, while leaving the file, coroutine, and scheduler
-// in the state that it was prior to calling the function.
-// Alternatively, the wait_dl can be used if the error is needed. 
-static void cowait(int fd, enum evkind kind, int64_t deadline) {
-    int ret = wait_dl(fd, kind, deadline);
-    if (ret == NECO_CANCELED) {
-        // The cancel flag should be set to true if the wait was canceled, 
-        // because the caller is responsible for handling deadlines and
-        // checking the canceled flag upon return.
-        struct coroutine *co = coself();
-        co->canceled = true;
-    }
-    if (ret != NECO_OK) {
-        coyield();
-    } 
+int neco_setspecific(int64_t key, const void *value) {
+    int ret = setspecific(key, value);
+    error_guard(ret);
+    return ret;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Networking code
+// coroutine arena
 ////////////////////////////////////////////////////////////////////////////////
 
-#if !defined(NECO_NOWORKERS) && defined(NECO_USEREADWORKERS) && \
-    !defined(NECO_NOREADWORKERS)
+#ifndef NECO_ARENACHUNKSIZE
+#define NECO_ARENACHUNKSIZE 4096
+#endif
 
-struct ioread {
-    int fd;
-    void *data;
-    size_t count;
-    ssize_t res;
-    struct runtime *rt;
-    struct coroutine *co;
-} aligned16;
+#define ARENA_ALIGN 16
 
-static void ioread(void *udata) {
-    struct ioread *info = udata;
-    info->res = read0(info->fd, info->data, info->count);
-    if (info->res == -1) {
-        info->res = -errno;
+struct arenachunk {
+    struct arenachunk *next;
+    size_t size;                  // size of data
+    size_t len;                   // number of data bytes in use
+    char _pad[ARENA_ALIGN-(sizeof(void*)+sizeof(size_t)*2)%ARENA_ALIGN];
+    char data[];
+};
+
+// Release the arena chunks of a coroutine. One default sized chunk is kept
+// for the next user of the coroutine, unless 'all' is requested.
+static void arena_free(struct coroutine *co, bool all) {
+    struct arenachunk *keep = 0;
+    while (co->arena) {
+        struct arenachunk *chunk = co->arena;
+        co->arena = chunk->next;
+        if (!all && !keep && chunk->size == NECO_ARENACHUNKSIZE) {
+            keep = chunk;
+        } else {
+            free0(chunk);
+        }
+    }
+    if (keep) {
+        keep->next = 0;
+        keep->len = 0;
+        co->arena = keep;
     }
-    pthread_mutex_lock(&info->rt->iomu);
-    colist_push_back(&info->rt->iolist, info->co);
-    pthread_mutex_unlock(&info->rt->iomu);
 }
 
-static ssize_t read1(int fd, void *data, size_t nbytes) {
-    ssize_t n;
-    bool nowork = true;
+static void *arena_alloc(size_t size) {
+    struct coroutine *co = coself();
+    if (!co || size > SIZE_MAX - sizeof(struct arenachunk) - ARENA_ALIGN) {
+        return 0;
+    }
+    size = (size + (ARENA_ALIGN-1)) & ~(size_t)(ARENA_ALIGN-1);
+    struct arenachunk *chunk = co->arena;
+    if (chunk && chunk->size - chunk->len >= size) {
+        void *ptr = chunk->data + chunk->len;
+        chunk->len += size;
+        return ptr;
+    }
+    size_t chunksize = NECO_ARENACHUNKSIZE;
+    if (size > chunksize/4) {
+        // Large allocations get their own chunk, which goes behind the 
+        // current chunk so that its free space is still used.
+        chunksize = size;
+    }
+    chunk = malloc0(sizeof(struct arenachunk) + chunksize);
+    if (!chunk) {
+        return 0;
+    }
+    chunk->size = chunksize;
+    chunk->len = size;
+    if (chunksize == size && co->arena) {
+        chunk->next = co->arena->next;
+        co->arena->next = chunk;
+    } else {
+        chunk->next = co->arena;
+        co->arena = chunk;
+    }
+    return chunk->data;
+}
+
+/// Allocate memory from the current coroutine's arena.
+///
+/// The memory is owned by the coroutine and is released all at once when 
+/// the coroutine exits. There is no need, nor any way, to free it sooner. 
+/// This is much cheaper than neco_malloc() for request handlers that make
+/// many small allocations.
+///
+/// The returned memory is aligned to 16 bytes and is not zeroed.
+/// @param size Number of bytes
+/// @return Allocated memory, or NULL if out of memory or when called outside
+/// of a coroutine.
+void *neco_alloc(size_t size) {
+    return arena_alloc(size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// signals
+////////////////////////////////////////////////////////////////////////////////
+
+static int signal_watch(int signo) {
+    if (signo < 1 || signo > 31) {
+        return NECO_INVAL;
+    }
+    struct coroutine *co = coself();
+    if (!co || !rt->mainthread) {
+        return NECO_PERM;
+    }
+    if ((co->sigwatch & (UINT32_C(1) << signo)) == 0) {
+        co->sigwatch |= UINT32_C(1) << signo;
+        rt->sigwatchers[signo]++;
+    }
+    return NECO_OK;
+}
+
+
+/// Have the current coroutine watch for a signal.
+///
+/// This can be used to intercept or ignore signals.
+///
+/// Signals that can be watched: SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGPIPE,
+/// SIGUSR1, SIGUSR2, SIGALRM
+///
+/// Signals that _can not_ be watched: SIGILL, SIGFPE, SIGSEGV, SIGBUS, SIGTRAP
+///
+/// **Example**
+///
+/// ```
+/// // Set up this coroutine to watich for the SIGINT (Ctrl-C) and SIGQUIT
+/// // (Ctrl-\) signals.
+/// neco_signal_watch(SIGINT);
+/// neco_signal_watch(SIGQUIT);
+///
+/// printf("Waiting for Ctrl-C or Ctrl-\\ signals...\n");
+/// int sig = neco_signal_wait();
+/// if (sig == SIGINT) {
+///     printf("\nReceived Ctrl-C\n");
+/// } else if (sig == SIGQUIT) {
+///     printf("\nReceived Ctrl-\\\n");
+/// }
+///
+/// // The neco_signal_unwatch is used to stop watching.
+/// neco_signal_unwatch(SIGINT);
+/// neco_signal_unwatch(SIGQUIT);
+/// ```
+///
+/// @param signo The signal number
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Signals
+int neco_signal_watch(int signo) {
+    int ret = signal_watch(signo);
+    error_guard(ret);
+    return ret;
+}
+
+static int signal_unwatch(int signo) {
+    if (signo < 1 || signo > 31) {
+        return NECO_INVAL;
+    }
+    struct coroutine *co = coself();
+    if (!co || !rt->mainthread) {
+        return NECO_PERM;
+    }
+    if ((co->sigwatch & (UINT32_C(1) << signo)) != 0) {
+        co->sigwatch &= ~(UINT32_C(1) << signo);
+        rt->sigwatchers[signo]--;
+    }
+    return NECO_OK;
+}
+
+/// Stop watching for a siganl to arrive
+/// @param signo The signal number
+/// @return NECO_OK on success or an error
+int neco_signal_unwatch(int signo) {
+    int ret = signal_unwatch(signo);
+    error_guard(ret);
+    return ret;
+}
+
+static int signal_wait_dl(int64_t deadline) {
+    struct coroutine *co = coself();
+    if (!rt || !rt->mainthread) {
+        return NECO_PERM;
+    } 
+    if (co->sigwatch == 0) {
+        return NECO_NOSIGWATCH;
+    }
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
+    }
+    co->sigmask = co->sigwatch;
+    colist_push_back(&rt->sigwaiters, co);
+    rt->nsigwaiters++;
+    copause(deadline);
+    remove_from_list(co);
+    rt->nsigwaiters--;
+    int signo = (int)co->sigmask;
+    co->sigmask = 0;
+    int ret = checkdl(co, INT64_MAX);
+    return ret == NECO_OK ? signo : ret;
+}
+
+/// Same as neco_signal_wait() but with a deadline parameter. 
+int neco_signal_wait_dl(int64_t deadline) {
+    int ret = signal_wait_dl(deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait for a signal to arrive.
+/// @return A signal number or an error.
+/// @return NECO_PERM
+/// @return NECO_NOSIGWATCH if not currently watching for signals.
+/// @return NECO_CANCELED
+/// @see Signals
+/// @see neco_signal_wait_dl()
+int neco_signal_wait(void) {
+    return neco_signal_wait_dl(INT64_MAX);
+}
+
+static int64_t now0(void) {
+    if (!rt) {
+        return NECO_PERM;
+    } else {
+        return getnow();
+    }
+}
+
+/// Get the current time.
+///
+/// This operation calls gettime(CLOCK_MONOTONIC) to retreive a monotonically
+/// increasing value that is not affected by discontinuous jumps in the system
+/// time.
+///
+/// This value IS NOT the same as the local system time; for that the user
+/// should call gettime(CLOCK_REALTIME).
+///
+/// The main purpose of this function to work with operations that use
+/// deadlines, i.e. functions with the `*_dl()` suffix.
+///
+/// **Example**
+///
+/// ```
+/// // Receive a message from a channel using a deadline of one second from now.
+/// int ret = neco_chan_recv_dl(ch, &msg, neco_now() + NECO_SECOND);
+/// if (ret == NECO_TIMEDOUT) {
+///     // The operation timed out
+/// }
+/// ```
+///
+/// @return On success, the current time as nanoseconds.
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Time
+int64_t neco_now(void) {
+    int64_t now = now0();
+    error_guard(now); 
+    return now;
+}
+
+#if defined(NECO_TESTING)
+// Allow for tests to set a fail flag for testing event queue failures.
+__thread bool neco_fail_cowait = false;
+#endif
+
+#if defined(NECO_POLL_EPOLL)
+static int wait_dl_addevent(struct coroutine *co, int fd, enum evkind kind) {
+    (void)co;
+    struct epoll_event ev = { 0 };
+    ev.data.fd = fd;
+    if (kind == EVREAD) {
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.events |= evexists(fd, EVWRITE) ? EPOLLOUT : 0;
+    } else {
+        ev.events = EPOLLOUT | EPOLLONESHOT;
+        ev.events |= evexists(fd, EVREAD) ? EPOLLIN : 0;
+    }
+    int ret = epoll_ctl0(rt->qfd, EPOLL_CTL_MOD, fd, &ev);
+    if (ret == -1) {
+        ret = epoll_ctl0(rt->qfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    return ret;
+}
+static void wait_dl_delevent(struct coroutine *co, int fd, enum evkind kind) {
+    // Using oneshot. Nothing to do.
+    (void)co; (void)fd; (void)kind;
+}
+
+#elif defined(NECO_POLL_KQUEUE)
+static int wait_dl_addevent(struct coroutine *co, int fd, enum evkind kind) {
+    (void)co;
+    int ret = 0;
+    if (!evexists(fd, kind)) {
+        struct kevent ev = { 
+            .ident = (uintptr_t)fd, 
+            .flags = EV_ADD | EV_ONESHOT,
+            .filter = kind == EVREAD ? EVFILT_READ : EVFILT_WRITE,
+        };
+        ret = kevent0(rt->qfd, &ev, 1, NULL, 0, NULL);
+    }
+    return ret;
+}
+
+static void wait_dl_delevent(struct coroutine *co, int fd, enum evkind kind) {
+    // Using oneshot. Nothing to do.
+    (void)co; (void)fd; (void)kind;
+}
+#endif
+
+#if defined(NECO_POLL_EPOLL) || defined(NECO_POLL_KQUEUE)
+// evqueue_ensure makes sure that the scheduler has an event queue.
+static int evqueue_ensure(void) {
+    if (rt->qfd == 0) {
+        // The scheduler currently does not have an event queue for handling
+        // file events. Create one now. This new queue will be shared for the 
+        // entirety of the scheduler. It will be automatically freed when it's
+        // no longer needed, by the scheduler.
+        rt->qfd = evqueue0();
+        if (rt->qfd == -1) {
+            // Error creating the event queue. This is usually due to a system
+            // that is low on resources or is limiting the number of file
+            // descriptors allowed by a program, e.g. ulimit. 
+            rt->qfd = 0;
+            return -1;
+        }
+        // The queue was successfully created.
+        rt->qfdcreated = getnow();
+    }
+    return 0;
+}
+
+// evwaiter_add registers the waiter for its file event.
+static int evwaiter_add(struct evwaiter *w) {
+    int ret = wait_dl_addevent(w->co, w->fd, w->kind);
+    if (ret == -1) {
+        return -1;
+    }
+    // Add this waiter, chaining it to the distinct fd/kind.
+    // This creates a unique record in the evwaiters list
+    w->id = rt->evid++;
+    evmap_insert(&rt->evwaiters, w);
+    return 0;
+}
+
+static void evwaiter_del(struct evwaiter *w) {
+    evmap_delete(&rt->evwaiters, w);
+    wait_dl_delevent(w->co, w->fd, w->kind);
+}
+#endif
+
+// wait_dl makes the current coroutine wait for the file descriptor to be
+// available for reading or writing.
+static int wait_dl(int fd, enum evkind kind, int64_t deadline) {
+    if (kind != EVREAD && kind != EVWRITE) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    struct coroutine *co = coself();
+#if !defined(NECO_POLL_EPOLL) && !defined(NECO_POLL_KQUEUE)
+    // Windows and Emscripten only yield, until support for events queues
+    // are enabled.
+    (void)fd; (void)deadline;
+    (void)evmap_insert; (void)evmap_delete; (void)evexists;
+
+    sco_yield();
+#else
+    if (evqueue_ensure() == -1) {
+        return -1;
+    }
+    struct evwaiter w = { .fd = fd, .kind = kind, .co = co };
+    if (evwaiter_add(&w) == -1) {
+        return -1;
+    }
+    rt->nevwaiters++;
+
+    // Now wait for the scheduler to wake this coroutine up again.
+    copause(deadline);
+
+    // Delete from evwaiters.
+    rt->nevwaiters--;
+    evwaiter_del(&w);
+#endif
+    return checkdl(co, INT64_MAX);
+}
+
+/// Same as neco_wait() but with a deadline parameter. 
+int neco_wait_dl(int fd, int mode, int64_t deadline) {
+    int ret = wait_dl(fd, mode, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait for a file descriptor to be ready for reading or writing.
+///
+/// Normally one should use neco_read() and neco_write() to read and write
+/// data. But there may be times when you need more involved logic or to use
+/// alternative functions such as `recvmsg()` or `sendmsg()`.
+///
+/// ```
+/// while (1) {
+///     int n = recvmsg(sockfd, msg, MSG_DONTWAIT);
+///     if (n == -1) {
+///         if (errno == EAGAIN) {
+///             // The socket is not ready for reading.
+///             neco_wait(sockfd, NECO_WAIT_READ);
+///             continue;
+///         }
+///         // Socket error.
+///         return;
+///     }
+///     // Message received.
+///     break;
+/// }
+/// ```
+/// 
+/// @param fd The file descriptor
+/// @param mode NECO_WAIT_READ or NECO_WAIT_WRITE
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_ERROR Check errno for more info
+/// @see Posix2
+int neco_wait(int fd, int mode) {
+    return neco_wait_dl(fd, mode, INT64_MAX);
+}
+
+static int waitmany0(const int fds[], const int modes[], int ready[], 
+    int nfds, struct evwaiter *ws, int64_t deadline)
+{
+    struct coroutine *co = coself();
+#if !defined(NECO_POLL_EPOLL) && !defined(NECO_POLL_KQUEUE)
+    // Windows and Emscripten only yield, until support for events queues
+    // are enabled.
+    (void)ws; (void)deadline;
+    sco_yield();
+    for (int i = 0; i < nfds; i++) {
+        ready[i] = modes[i];
+    }
+    int ret = checkdl(co, INT64_MAX);
+    return ret == NECO_OK ? nfds : ret;
+#else
+    if (evqueue_ensure() == -1) {
+        return -1;
+    }
+    int ret = NECO_OK;
+    int nws = 0;
+    for (int i = 0; i < nfds && ret == NECO_OK; i++) {
+        for (int kind = EVREAD; kind <= EVWRITE; kind++) {
+            if (!(modes[i] & kind)) {
+                continue;
+            }
+            ws[nws] = (struct evwaiter){
+                .fd = fds[i],
+                .kind = (enum evkind)kind,
+                .co = co,
+                .ready = &ready[i],
+            };
+            if (evwaiter_add(&ws[nws]) == -1) {
+                ret = -1;
+                break;
+            }
+            nws++;
+        }
+    }
+    if (ret == NECO_OK) {
+        rt->nevwaiters++;
+        copause(deadline);
+        rt->nevwaiters--;
+    }
+    for (int i = 0; i < nws; i++) {
+        evwaiter_del(&ws[i]);
+    }
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    int nready = 0;
+    for (int i = 0; i < nfds; i++) {
+        nready += ready[i] != 0;
+    }
+    ret = checkdl(co, INT64_MAX);
+    if (ret == NECO_TIMEDOUT && nready > 0) {
+        // An event fired at the same time as the deadline.
+        ret = NECO_OK;
+    }
+    return ret == NECO_OK ? nready : ret;
+#endif
+}
+
+static int waitmany_dl(const int fds[], const int modes[], int ready[], 
+    int nfds, int64_t deadline)
+{
+    if (nfds < 0 || (nfds > 0 && (!fds || !modes || !ready))) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    int nws = 0;
+    for (int i = 0; i < nfds; i++) {
+        if (modes[i] <= 0 || (modes[i] & ~(NECO_WAIT_READ|NECO_WAIT_WRITE))) {
+            return NECO_INVAL;
+        }
+        nws += (modes[i] & NECO_WAIT_READ) ? 1 : 0;
+        nws += (modes[i] & NECO_WAIT_WRITE) ? 1 : 0;
+        ready[i] = 0;
+    }
+    struct coroutine *co = coself();
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
+    }
+    // Allocate space for an event waiter per fd and mode.
+    struct evwaiter stack_ws[8];
+    struct evwaiter *ws = stack_ws;
+    if (nws > 8) {
+        ws = malloc0((size_t)nws * sizeof(struct evwaiter));
+        if (!ws) {
+            return NECO_NOMEM;
+        }
+    }
+    int ret = waitmany0(fds, modes, ready, nfds, ws, deadline);
+    if (ws != stack_ws) {
+        free0(ws);
+    }
+    return ret;
+}
+
+/// Same as neco_waitmany() but with a deadline parameter. 
+int neco_waitmany_dl(const int fds[], const int modes[], int ready[], int nfds,
+    int64_t deadline)
+{
+    int ret = waitmany_dl(fds, modes, ready, nfds, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait for any of multiple file descriptors to be ready for reading or
+/// writing.
+///
+/// This works like neco_wait() but for a set of file descriptors, without
+/// needing a waiting coroutine for each one. The mode for each file 
+/// descriptor is NECO_WAIT_READ, NECO_WAIT_WRITE, or both.
+///
+/// Upon return, each entry in the ready array has the modes that are ready 
+/// for its file descriptor, or zero if not ready.
+///
+/// ```
+/// int modes[N];
+/// int ready[N];
+/// for (int i = 0; i < N; i++) {
+///     modes[i] = NECO_WAIT_READ;
+/// }
+/// int n = neco_waitmany(replicas, modes, ready, N);
+/// for (int i = 0; i < N && n > 0; i++) {
+///     if (ready[i] & NECO_WAIT_READ) {
+///         // read from replicas[i]
+///     }
+/// }
+/// ```
+///
+/// @param fds The file descriptors
+/// @param modes The modes to wait on for each file descriptor
+/// @param ready The modes that are ready for each file descriptor
+/// @param nfds Number of file descriptors
+/// @return The number of file descriptors that are ready
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_ERROR Check errno for more info
+/// @see Posix2
+/// @see neco_wait()
+int neco_waitmany(const int fds[], const int modes[], int ready[], int nfds) {
+    return neco_waitmany_dl(fds, modes, ready, nfds, INT64_MAX);
+}
+
+// cowait makes the current coroutine wait for the file descriptor to be
+// available for reading or writing. Any kind of error encountered by this 
+// operation will cause the coroutine to be rescheduled, with the error
+// gracefully being ignored, while leaving the file, coroutine, and scheduler
+// in the state that it was prior to calling the function.
+// Alternatively, the wait_dl can be used if the error is needed. 
+static void cowait(int fd, enum evkind kind, int64_t deadline) {
+    int ret = wait_dl(fd, kind, deadline);
+    if (ret == NECO_CANCELED) {
+        // The cancel flag should be set to true if the wait was canceled, 
+        // because the caller is responsible for handling deadlines and
+        // checking the canceled flag upon return.
+        struct coroutine *co = coself();
+        co->canceled = true;
+    }
+    if (ret != NECO_OK) {
+        coyield();
+    } 
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Networking code
+////////////////////////////////////////////////////////////////////////////////
+
+#if !defined(NECO_NOWORKERS) && defined(NECO_USEREADWORKERS) && \
+    !defined(NECO_NOREADWORKERS)
+
+struct ioread {
+    int fd;
+    void *data;
+    size_t count;
+    ssize_t res;
+    struct runtime *rt;
+    struct coroutine *co;
+} aligned16;
+
+static void ioread(void *udata) {
+    struct ioread *info = udata;
+    info->res = read0(info->fd, info->data, info->count);
+    if (info->res == -1) {
+        info->res = -errno;
+    }
+    pthread_mutex_lock(&info->rt->iomu);
+    colist_push_back(&info->rt->iolist, info->co);
+    pthread_mutex_unlock(&info->rt->iomu);
+}
+
+static ssize_t read1(int fd, void *data, size_t nbytes) {
+    ssize_t n;
+    bool nowork = true;
+#ifdef NECO_TESTING
+    if (neco_fail_read_counter > 0) {
+        nowork = true;
+    } 
+#endif
+#if NECO_MAXIOWORKERS <= 0
+    nowork = true;
+#endif
+    if (!nowork) {
+        nowork = true;
+        struct coroutine *co = coself();
+        struct ioread info = { 
+            .fd = fd, 
+            .data = data, 
+            .count = nbytes,
+            .co = co,
+            .rt = rt,
+        };
+        int64_t pin = co->id % NECO_MAXIOWORKERS;
+        if (worker_submit(rt->worker, pin, ioread, &info)) {
+            rt->niowaiters++;
+            sco_pause();
+            rt->niowaiters--;
+            n = info.res;
+            if (n < 0) {
+                errno = -n;
+                n = -1;
+            }
+            nowork = false;
+        }
+    }
+    if (nowork) {
+        n = read0(fd, data, nbytes);
+    }
+    return n;
+}
+#else
+#define read1 read0
+#endif
+
+// Called after a read on fd failed with EINTR or EAGAIN. With NECO_BURST,
+// the read is retried that many times, yielding in between, before waiting
+// on the fd. Otherwise the read is always preceded by a wait, so there is
+// nothing to do here.
+static void readretry(int fd, int64_t deadline) {
+#if NECO_BURST >= 0
+    if (rt->burstcount == NECO_BURST) {
+        rt->burstcount = 0;
+        cowait(fd, EVREAD, deadline);
+    } else {
+        rt->burstcount++;
+        sco_yield();
+    }
+#else
+    (void)fd, (void)deadline;
+#endif
+}
+
+static ssize_t read_dl(int fd, void *data, size_t nbytes, int64_t deadline) {
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+#if NECO_BURST < 0
+        cowait(fd, EVREAD, deadline);
+#endif
+        ssize_t n = read1(fd, data, nbytes);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                readretry(fd, deadline);
+                // continue;
+            } else {
+                return -1;
+            }
+        } else {
+            return n;
+        }
+    }
+}
+
+/// Same as neco_read() but with a deadline parameter. 
+ssize_t neco_read_dl(int fd, void *buf, size_t count, int64_t deadline) {
+    ssize_t ret = read_dl(fd, buf, count, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Read from a file descriptor.
+///
+/// This operation attempts to read up to count from file descriptor fd 
+/// into the buffer starting at buf.
+///
+/// This is a Posix wrapper function for the purpose of running in a Neco
+/// coroutine. It's expected that the provided file descriptor is in 
+/// non-blocking state.
+///
+/// @return On success, the number of bytes read is returned (zero indicates
+///         end of file)
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    neco_setnonblock()
+/// @see    https://www.man7.org/linux/man-pages/man2/read.2.html
+ssize_t neco_read(int fd, void *buf, size_t count) {
+    return neco_read_dl(fd, buf, count, INT64_MAX);
+}
+
 #ifdef NECO_TESTING
-    if (neco_fail_read_counter > 0) {
+#define write1 write0
+// Allow for testing partial writes
+__thread int neco_partial_write = 0;
+static ssize_t write2(int fd, const void *data, size_t nbytes) {
+    bool fail = false;
+    if (neco_partial_write) {
+        neco_partial_write--;
+        nbytes = nbytes > 128 ? 128 : nbytes;
+        // nbytes /= 2;
+        fail = neco_partial_write == 0;
+    }
+    if (fail) {
+        errno = EIO;
+        return -1;
+    }
+    return write1(fd, data, nbytes);
+}
+#else
+// In production, a write to a broken stdout or stderr pipe should end the 
+// program immediately.
+inline
+static ssize_t write1(int fd, const void *data, size_t nbytes) {
+    ssize_t n = write0(fd, data, nbytes);
+    if (n == -1 && errno == EPIPE && (fd == 1 || fd == 2)) {
+        // Broken pipe on stdout or stderr
+        _Exit(128+EPIPE);
+    }
+    return n;
+}
+#define write2 write1
+#endif
+
+#if !defined(NECO_NOWORKERS) && defined(NECO_USEWRITEWORKERS) && \
+    !defined(NECO_NOWRITEWORKERS)
+struct iowrite {
+    int fd;
+    const void *data;
+    size_t count;
+    ssize_t res;
+    struct runtime *rt;
+    struct coroutine *co;
+} aligned16;
+
+static void iowrite(void *udata) {
+    struct iowrite *info = udata;
+    info->res = write2(info->fd, info->data, info->count);
+    if (info->res == -1) {
+        info->res = -errno;
+    }
+    pthread_mutex_lock(&info->rt->iomu);
+    colist_push_back(&info->rt->iolist, info->co);
+    pthread_mutex_unlock(&info->rt->iomu);
+}
+
+static ssize_t write3(int fd, const void *data, size_t nbytes) {
+    bool nowork = false;
+    ssize_t n;
+#ifdef NECO_TESTING
+    if (neco_fail_write_counter > 0 || neco_partial_write > 0) {
+        nowork = true;
+    }
+#endif
+#if NECO_MAXIOWORKERS <= 0
+    nowork = true;
+#endif
+    if (!nowork) {
         nowork = true;
+        struct coroutine *co = coself();
+        struct iowrite info = { 
+            .fd = fd, 
+            .data = data, 
+            .count = nbytes,
+            .co = co,
+            .rt = rt,
+        };
+        int64_t pin = co->id % NECO_MAXIOWORKERS;
+        if (worker_submit(rt->worker, pin, iowrite, &info)) {
+            rt->niowaiters++;
+            sco_pause();
+            rt->niowaiters--;
+            n = info.res;
+            if (n < 0) {
+                errno = -n;
+                n = -1;
+            }
+            nowork = false;
+        }
+    }
+    if (nowork) {
+        n = write2(fd, data, nbytes);
+    }
+    return n;
+}
+#else
+#define write3 write2
+#endif
+
+static ssize_t write_dl(int fd, const void *data, size_t nbytes,
+    int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    ssize_t written = 0;
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+        // size_t maxnbytes = CLAMP(nbytes, 0, 8096);
+        // ssize_t n = write2(fd, data, maxnbytes);
+        ssize_t n = write3(fd, data, nbytes);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                cowait(fd, EVWRITE, deadline);
+            } else if (written == 0) {
+                return -1;
+            } else {
+                // There was an error but data has also been written. It's
+                // important to notify the caller about the amount of data
+                // written. The caller will need to then check to see if the
+                // return value is less than nbytes, and if so check
+                // the system errno.
+                return written;
+            }
+        } else if (n > 0) {
+            nbytes -= (size_t)n;
+            written += (size_t)n;
+            data = (char*)data + n;
+        }
+        if (nbytes == 0) {
+            break;
+        }
+        if (n >= 0) {
+            // Some data was written but there's more yet. 
+            // Avoiding starving the other coroutines.
+            coyield();
+        }
+    }
+    return written;
+}
+
+/// Same as neco_write() but with a deadline parameter. 
+ssize_t neco_write_dl(int fd, const void *buf, size_t count,
+    int64_t deadline)
+{
+    ssize_t ret = write_dl(fd, buf, count, deadline);
+    async_error_guard(ret);
+    if (ret >= 0 && (size_t)ret < count) {
+        lasterr = NECO_PARTIALWRITE;
     } 
+    return ret;
+}
+
+/// Write to a file descriptor.
+///
+/// This operation attempts to write all bytes in the buffer starting at buf
+/// to the file referred to by the file descriptor fd.
+///
+/// This is a Posix wrapper function for the purpose of running in a Neco
+/// coroutine. It's expected that the provided file descriptor is in 
+/// non-blocking state.
+///
+/// One difference from the Posix version is that this function will attempt to
+/// write _all_ bytes in buffer. The programmer, at their discretion, may 
+/// considered it as an error when fewer than count is returned. If so, the
+/// neco_lasterr() will return the NECO_PARTIALWRITE.
+///
+/// @return On success, the number of bytes written is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    neco_setnonblock()
+/// @see    https://www.man7.org/linux/man-pages/man2/write.2.html
+ssize_t neco_write(int fd, const void *buf, size_t count) {
+    return neco_write_dl(fd, buf, count, INT64_MAX);
+}
+
+#ifndef _WIN32
+
+static ssize_t readv_dl(int fd, const struct iovec *iov, int iovcnt, 
+    int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+#if NECO_BURST < 0
+        cowait(fd, EVREAD, deadline);
 #endif
-#if NECO_MAXIOWORKERS <= 0
-    nowork = true;
+        ssize_t n = readv0(fd, iov, iovcnt);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                readretry(fd, deadline);
+            } else {
+                return -1;
+            }
+        } else {
+            return n;
+        }
+    }
+}
+
+/// Same as neco_readv() but with a deadline parameter. 
+ssize_t neco_readv_dl(int fd, const struct iovec *iov, int iovcnt, 
+    int64_t deadline)
+{
+    ssize_t ret = readv_dl(fd, iov, iovcnt, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Read from a file descriptor into multiple buffers.
+///
+/// This operation attempts to read from file descriptor fd into the iovcnt
+/// buffers described by iov, filling each buffer before moving to the next.
+///
+/// This is a Posix wrapper function for the purpose of running in a Neco
+/// coroutine. It's expected that the provided file descriptor is in 
+/// non-blocking state.
+///
+/// @return On success, the number of bytes read is returned (zero indicates
+///         end of file)
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    https://www.man7.org/linux/man-pages/man2/readv.2.html
+ssize_t neco_readv(int fd, const struct iovec *iov, int iovcnt) {
+    return neco_readv_dl(fd, iov, iovcnt, INT64_MAX);
+}
+
+// Max number of buffers passed to each writev call.
+#define WRITEV_MAX 64
+
+static ssize_t writev_dl(int fd, const struct iovec *iov, int iovcnt,
+    int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    if (iovcnt < 0 || (iovcnt > 0 && !iov)) {
+        errno = EINVAL;
+        return -1;
+    }
+    // The caller's iov array is not modified. Partial writes are tracked 
+    // using the current buffer and the offset into it, and each writev call
+    // uses a window of the remaining buffers.
+    struct iovec win[WRITEV_MAX];
+    int idx = 0;
+    size_t off = 0;
+    ssize_t written = 0;
+    while (1) {
+        while (idx < iovcnt && off == iov[idx].iov_len) {
+            idx++;
+            off = 0;
+        }
+        if (idx == iovcnt) {
+            break;
+        }
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+        int nwin = 0;
+        for (int i = idx; i < iovcnt && nwin < WRITEV_MAX; i++) {
+            win[nwin].iov_base = (char*)iov[i].iov_base + (i == idx ? off : 0);
+            win[nwin].iov_len = iov[i].iov_len - (i == idx ? off : 0);
+            nwin++;
+        }
+        ssize_t n = writev0(fd, win, nwin);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                cowait(fd, EVWRITE, deadline);
+                continue;
+            } else if (written == 0) {
+                return -1;
+            } else {
+                // There was an error but data has also been written. 
+                // Same as write_dl, return the amount that was written.
+                return written;
+            }
+        }
+        written += n;
+        while (n > 0) {
+            size_t avail = iov[idx].iov_len - off;
+            if ((size_t)n < avail) {
+                off += (size_t)n;
+                n = 0;
+            } else {
+                n -= (ssize_t)avail;
+                idx++;
+                off = 0;
+            }
+        }
+        if (idx < iovcnt) {
+            // Some data was written but there's more yet. 
+            // Avoiding starving the other coroutines.
+            coyield();
+        }
+    }
+    return written;
+}
+
+/// Same as neco_writev() but with a deadline parameter. 
+ssize_t neco_writev_dl(int fd, const struct iovec *iov, int iovcnt,
+    int64_t deadline)
+{
+    ssize_t ret = writev_dl(fd, iov, iovcnt, deadline);
+    async_error_guard(ret);
+    if (ret >= 0) {
+        size_t count = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            count += iov[i].iov_len;
+        }
+        if ((size_t)ret < count) {
+            lasterr = NECO_PARTIALWRITE;
+        }
+    }
+    return ret;
+}
+
+/// Write multiple buffers to a file descriptor.
+///
+/// This operation attempts to write all bytes in the iovcnt buffers 
+/// described by iov, in order, to the file referred to by the file 
+/// descriptor fd. This avoids copying into a single buffer or making one
+/// write call for each buffer.
+///
+/// Same as neco_write(), this function will attempt to write _all_ bytes. 
+/// When fewer bytes are written, neco_lasterr() will return the
+/// NECO_PARTIALWRITE.
+///
+/// @return On success, the number of bytes written is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    https://www.man7.org/linux/man-pages/man2/writev.2.html
+ssize_t neco_writev(int fd, const struct iovec *iov, int iovcnt) {
+    return neco_writev_dl(fd, iov, iovcnt, INT64_MAX);
+}
+
+// Copy from in_fd to out_fd through a user space buffer. This is used when
+// the system does not provide sendfile, or it does not support in_fd.
+static ssize_t sendfile_copy(int out_fd, int in_fd, off_t *offset, 
+    size_t count, int64_t deadline)
+{
+    char buf[16384];
+    size_t len = count < sizeof(buf) ? count : sizeof(buf);
+    ssize_t n = offset ? pread(in_fd, buf, len, *offset) : 
+                         read_dl(in_fd, buf, len, deadline);
+    if (n <= 0) {
+        return n;
+    }
+    ssize_t written = write_dl(out_fd, buf, (size_t)n, deadline);
+    if (offset) {
+        if (written > 0) {
+            *offset += written;
+        }
+    } else if (written > 0 && written < n) {
+        // Move the file position back to the first byte that was not sent.
+        // This is not possible for pipes and sockets, and those bytes are
+        // lost.
+        lseek(in_fd, written - n, SEEK_CUR);
+    }
+    return written;
+}
+
+static ssize_t sendfile_dl(int out_fd, int in_fd, off_t *offset, 
+    size_t count, int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+#ifdef __linux__
+    // The EAGAIN from sendfile(2) may be for either descriptor, so only
+    // regular files, which never block, are sent by the kernel. Anything
+    // else is copied, waiting on in_fd when there is nothing to read.
+    struct stat st;
+    bool usecopy = fstat(in_fd, &st) == 0 && !S_ISREG(st.st_mode);
+#else
+    bool usecopy = true;
 #endif
-    if (!nowork) {
-        nowork = true;
-        struct coroutine *co = coself();
-        struct ioread info = { 
-            .fd = fd, 
-            .data = data, 
-            .count = nbytes,
-            .co = co,
-            .rt = rt,
-        };
-        int64_t pin = co->id % NECO_MAXIOWORKERS;
-        if (worker_submit(rt->worker, pin, ioread, &info)) {
-            rt->niowaiters++;
-            sco_pause();
-            rt->niowaiters--;
-            n = info.res;
-            if (n < 0) {
-                errno = -n;
-                n = -1;
+    ssize_t sent = 0;
+    while ((size_t)sent < count) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+        ssize_t n;
+        if (usecopy) {
+            n = sendfile_copy(out_fd, in_fd, offset, count-(size_t)sent,
+                deadline);
+        } else {
+#ifdef __linux__
+            n = sendfile0(out_fd, in_fd, offset, count-(size_t)sent);
+#else
+            n = -1;
+#endif
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                // continue;
+            } else if (errno == EAGAIN && !usecopy) {
+                cowait(out_fd, EVWRITE, deadline);
+            } else if ((errno == EINVAL || errno == ENOSYS) && !usecopy && 
+                sent == 0)
+            {
+                // The in_fd cannot be used with sendfile. 
+                usecopy = true;
+            } else if (sent == 0) {
+                return -1;
+            } else {
+                // Same as write_dl, return the amount that was sent.
+                return sent;
             }
-            nowork = false;
+            continue;
+        } 
+        if (n == 0) {
+            // End of file
+            break;
+        }
+        sent += n;
+        if ((size_t)sent < count) {
+            // Avoiding starving the other coroutines.
+            coyield();
         }
     }
-    if (nowork) {
-        n = read0(fd, data, nbytes);
+    return sent;
+}
+
+/// Same as neco_sendfile() but with a deadline parameter. 
+ssize_t neco_sendfile_dl(int out_fd, int in_fd, off_t *offset, size_t count,
+    int64_t deadline)
+{
+    ssize_t ret = sendfile_dl(out_fd, in_fd, offset, count, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Transfer data from a file to a file descriptor.
+///
+/// This operation copies up to count bytes from in_fd, which is usually a
+/// regular file, to out_fd, which is usually a socket. On Linux the data
+/// is moved by the kernel using sendfile(2), which avoids copying it through
+/// user space. On other systems, or when in_fd is not supported by 
+/// sendfile(2), the data is copied through a buffer instead.
+///
+/// When offset is not NULL, the data is read starting at *offset and the 
+/// file position of in_fd is not changed. Upon return *offset is set to the
+/// byte following the last byte that was sent. When offset is NULL, the
+/// data is read from the file position of in_fd, which is then updated.
+///
+/// When in_fd is not a regular file, such as a pipe or socket, the data is
+/// always copied through a buffer and the operation waits for in_fd to
+/// become readable. Data read from such an in_fd that could not be sent
+/// because of an error on out_fd is lost.
+///
+/// Like neco_write(), this function will attempt to send _all_ count bytes
+/// and returns fewer only when the end of in_fd is reached or when an error
+/// occurred after some data was sent.
+///
+/// @return On success, the number of bytes sent is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    https://www.man7.org/linux/man-pages/man2/sendfile.2.html
+ssize_t neco_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return neco_sendfile_dl(out_fd, in_fd, offset, count, INT64_MAX);
+}
+
+#ifdef __linux__
+
+static void rt_freepipepool(void) {
+    for (int i = 0; i < rt->npipepool; i++) {
+        close(rt->pipepool[i][0]);
+        close(rt->pipepool[i][1]);
     }
-    return n;
+    rt->npipepool = 0;
+}
+
+// Get an empty non-blocking pipe from the pool, or make a new one.
+static bool pipe_get(int pipefd[2]) {
+    if (rt->npipepool > 0) {
+        rt->npipepool--;
+        pipefd[0] = rt->pipepool[rt->npipepool][0];
+        pipefd[1] = rt->pipepool[rt->npipepool][1];
+        return true;
+    }
+    if (pipe0(pipefd) == -1) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (fcntl(pipefd[i], F_SETFD, FD_CLOEXEC) == -1 || 
+            neco_setnonblock(pipefd[i], true, 0) == -1)
+        {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Return a pipe to the pool. Only pipes that are empty may be returned.
+static void pipe_put(int pipefd[2], bool empty) {
+    if (empty && rt->npipepool < NECO_PIPEPOOLSIZE) {
+        rt->pipepool[rt->npipepool][0] = pipefd[0];
+        rt->pipepool[rt->npipepool][1] = pipefd[1];
+        rt->npipepool++;
+    } else {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+}
+
+// Copy using splice(2) from src, through a pipe, to dst.
+// Returns 1 when the file descriptors do not support splice, in which case
+// the caller should continue with a buffered copy.
+static int copy_splice(struct coroutine *co, int dst, int src, size_t max,
+    int64_t deadline, ssize_t *copied)
+{
+    int pipefd[2];
+    if (!pipe_get(pipefd)) {
+        return 1;
+    }
+    size_t inpipe = 0;
+    bool eof = false;
+    int ret = 0;
+    while (ret == 0 && (inpipe > 0 || (!eof && (size_t)*copied < max))) {
+        int dlret = checkdl(co, deadline);
+        if (dlret != NECO_OK) {
+            errno = dlret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            ret = -1;
+            break;
+        }
+        if (inpipe == 0) {
+            size_t len = max - (size_t)*copied;
+            len = len < SPLICE_CHUNKSIZE ? len : SPLICE_CHUNKSIZE;
+            ssize_t n = sys_splice0(src, pipefd[1], len);
+            if (n == -1) {
+                if (errno == EAGAIN) {
+                    cowait(src, EVREAD, deadline);
+                } else if (errno == EINTR) {
+                    // continue;
+                } else if (errno == EINVAL || errno == ENOSYS) {
+                    ret = 1;
+                } else {
+                    ret = -1;
+                }
+            } else if (n == 0) {
+                eof = true;
+            } else {
+                inpipe = (size_t)n;
+            }
+        } else {
+            ssize_t n = sys_splice0(pipefd[0], dst, inpipe);
+            if (n == -1) {
+                if (errno == EAGAIN) {
+                    cowait(dst, EVWRITE, deadline);
+                } else if (errno == EINTR) {
+                    // continue;
+                } else if (errno == EINVAL) {
+                    // The dst does not support splice. Move the data that
+                    // is already in the pipe before the caller continues
+                    // with a buffered copy.
+                    char buf[16384];
+                    while (inpipe > 0) {
+                        size_t len = inpipe < sizeof(buf) ? inpipe : 
+                            sizeof(buf);
+                        ssize_t nr = read(pipefd[0], buf, len);
+                        if (nr <= 0) {
+                            break;
+                        }
+                        ssize_t nw = write_dl(dst, buf, (size_t)nr, deadline);
+                        if (nw > 0) {
+                            *copied += nw;
+                        }
+                        if (nw != nr) {
+                            break;
+                        }
+                        inpipe -= (size_t)nr;
+                    }
+                    ret = inpipe == 0 ? 1 : -1;
+                } else {
+                    ret = -1;
+                }
+            } else {
+                inpipe -= (size_t)n;
+                *copied += n;
+                if (inpipe == 0) {
+                    // Avoiding starving the other coroutines.
+                    coyield();
+                }
+            }
+        }
+    }
+    pipe_put(pipefd, inpipe == 0);
+    return ret;
+}
+
+#endif
+
+static ssize_t copy_buffered(int dst, int src, size_t max, int64_t deadline,
+    ssize_t *copied)
+{
+    char buf[16384];
+    while ((size_t)*copied < max) {
+        size_t len = max - (size_t)*copied;
+        len = len < sizeof(buf) ? len : sizeof(buf);
+        ssize_t n = read_dl(src, buf, len, deadline);
+        if (n <= 0) {
+            return n;
+        }
+        ssize_t written = write_dl(dst, buf, (size_t)n, deadline);
+        if (written > 0) {
+            *copied += written;
+        }
+        if (written != n) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static ssize_t copy_dl(int dst, int src, size_t max, int64_t deadline) {
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    ssize_t copied = 0;
+    int ret = 1;
+#ifdef __linux__
+    ret = copy_splice(co, dst, src, max, deadline, &copied);
+#endif
+    if (ret == 1) {
+        ret = copy_buffered(dst, src, max, deadline, &copied);
+    }
+    if (ret == -1 && copied == 0) {
+        return -1;
+    }
+    return copied;
+}
+
+/// Same as neco_copy() but with a deadline parameter. 
+ssize_t neco_copy_dl(int dst, int src, size_t max, int64_t deadline) {
+    ssize_t ret = copy_dl(dst, src, max, deadline);
+    async_error_guard(ret);
+    return ret;
 }
-#else
-#define read1 read0
-#endif
 
-static ssize_t read_dl(int fd, void *data, size_t nbytes, int64_t deadline) {
+/// Copy data from one file descriptor to another.
+///
+/// This operation copies from src to dst until the end of src is reached
+/// or max bytes have been copied. Use SIZE_MAX for no limit.
+///
+/// On Linux the data is moved by the kernel with splice(2), through a pipe
+/// that is reused by the runtime, which avoids copying the data through user
+/// space. Otherwise, or when either file descriptor does not support 
+/// splice(2), the data is copied through a buffer instead.
+///
+/// Both file descriptors are expected to be in non-blocking state.
+///
+/// @param dst Destination file descriptor
+/// @param src Source file descriptor
+/// @param max Maximum number of bytes to copy
+/// @return On success, the number of bytes copied is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error. When an error occurs after some data has 
+///         been copied, the number of bytes copied is returned instead.
+/// @see    Posix
+ssize_t neco_copy(int dst, int src, size_t max) {
+    return neco_copy_dl(dst, src, max, INT64_MAX);
+}
+
+static ssize_t recvmsg_dl(int fd, struct msghdr *msg, int flags, 
+    int64_t deadline)
+{
     struct coroutine *co = coself();
     if (!co) {
         errno = EPERM;
@@ -5104,19 +7347,10 @@ static ssize_t read_dl(int fd, void *data, size_t nbytes, int64_t deadline) {
 #if NECO_BURST < 0
         cowait(fd, EVREAD, deadline);
 #endif
-        ssize_t n = read1(fd, data, nbytes);
+        ssize_t n = recvmsg0(fd, msg, flags|MSG_DONTWAIT);
         if (n == -1) {
             if (errno == EINTR || errno == EAGAIN) {
-#if NECO_BURST >= 0
-                if (rt->burstcount == NECO_BURST) {
-                    rt->burstcount = 0;
-                    cowait(fd, EVREAD, deadline);
-                } else {
-                    rt->burstcount++;
-                    sco_yield();
-                }
-#endif
-                // continue;
+                readretry(fd, deadline);
             } else {
                 return -1;
             }
@@ -5126,215 +7360,216 @@ static ssize_t read_dl(int fd, void *data, size_t nbytes, int64_t deadline) {
     }
 }
 
-/// Same as neco_read() but with a deadline parameter. 
-ssize_t neco_read_dl(int fd, void *buf, size_t count, int64_t deadline) {
-    ssize_t ret = read_dl(fd, buf, count, deadline);
+/// Same as neco_recvmsg() but with a deadline parameter. 
+ssize_t neco_recvmsg_dl(int fd, struct msghdr *msg, int flags, 
+    int64_t deadline)
+{
+    ssize_t ret = recvmsg_dl(fd, msg, flags, deadline);
     async_error_guard(ret);
     return ret;
 }
 
-/// Read from a file descriptor.
-///
-/// This operation attempts to read up to count from file descriptor fd 
-/// into the buffer starting at buf.
+/// Receive a message from a socket.
 ///
 /// This is a Posix wrapper function for the purpose of running in a Neco
-/// coroutine. It's expected that the provided file descriptor is in 
-/// non-blocking state.
+/// coroutine. The MSG_DONTWAIT flag is always added, and the coroutine 
+/// waits until a message is available.
 ///
-/// @return On success, the number of bytes read is returned (zero indicates
-///         end of file)
+/// @return On success, the number of bytes received is returned.
 /// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
 ///         indicate the error.
 /// @see    Posix
-/// @see    neco_setnonblock()
-/// @see    https://www.man7.org/linux/man-pages/man2/read.2.html
-ssize_t neco_read(int fd, void *buf, size_t count) {
-    return neco_read_dl(fd, buf, count, INT64_MAX);
+/// @see    https://www.man7.org/linux/man-pages/man2/recvmsg.2.html
+ssize_t neco_recvmsg(int fd, struct msghdr *msg, int flags) {
+    return neco_recvmsg_dl(fd, msg, flags, INT64_MAX);
 }
 
-#ifdef NECO_TESTING
-#define write1 write0
-// Allow for testing partial writes
-__thread int neco_partial_write = 0;
-static ssize_t write2(int fd, const void *data, size_t nbytes) {
-    bool fail = false;
-    if (neco_partial_write) {
-        neco_partial_write--;
-        nbytes = nbytes > 128 ? 128 : nbytes;
-        // nbytes /= 2;
-        fail = neco_partial_write == 0;
-    }
-    if (fail) {
-        errno = EIO;
+static ssize_t sendmsg_dl(int fd, const struct msghdr *msg, int flags, 
+    int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
         return -1;
     }
-    return write1(fd, data, nbytes);
-}
-#else
-// In production, a write to a broken stdout or stderr pipe should end the 
-// program immediately.
-inline
-static ssize_t write1(int fd, const void *data, size_t nbytes) {
-    ssize_t n = write0(fd, data, nbytes);
-    if (n == -1 && errno == EPIPE && (fd == 1 || fd == 2)) {
-        // Broken pipe on stdout or stderr
-        _Exit(128+EPIPE);
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+        ssize_t n = sendmsg0(fd, msg, flags|MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                cowait(fd, EVWRITE, deadline);
+            } else {
+                return -1;
+            }
+        } else {
+            return n;
+        }
     }
-    return n;
 }
-#define write2 write1
-#endif
 
-#if !defined(NECO_NOWORKERS) && defined(NECO_USEWRITEWORKERS) && \
-    !defined(NECO_NOWRITEWORKERS)
-struct iowrite {
-    int fd;
-    const void *data;
-    size_t count;
-    ssize_t res;
-    struct runtime *rt;
-    struct coroutine *co;
-} aligned16;
+/// Same as neco_sendmsg() but with a deadline parameter. 
+ssize_t neco_sendmsg_dl(int fd, const struct msghdr *msg, int flags, 
+    int64_t deadline)
+{
+    ssize_t ret = sendmsg_dl(fd, msg, flags, deadline);
+    async_error_guard(ret);
+    return ret;
+}
 
-static void iowrite(void *udata) {
-    struct iowrite *info = udata;
-    info->res = write2(info->fd, info->data, info->count);
-    if (info->res == -1) {
-        info->res = -errno;
-    }
-    pthread_mutex_lock(&info->rt->iomu);
-    colist_push_back(&info->rt->iolist, info->co);
-    pthread_mutex_unlock(&info->rt->iomu);
+/// Send a message on a socket.
+///
+/// This is a Posix wrapper function for the purpose of running in a Neco
+/// coroutine. The MSG_DONTWAIT flag is always added, and the coroutine 
+/// waits until the message can be sent.
+///
+/// Unlike neco_write(), this makes a single send. On a stream socket fewer 
+/// bytes than requested may be sent.
+///
+/// @return On success, the number of bytes sent is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    https://www.man7.org/linux/man-pages/man2/sendmsg.2.html
+ssize_t neco_sendmsg(int fd, const struct msghdr *msg, int flags) {
+    return neco_sendmsg_dl(fd, msg, flags, INT64_MAX);
 }
 
-static ssize_t write3(int fd, const void *data, size_t nbytes) {
-    bool nowork = false;
-    ssize_t n;
-#ifdef NECO_TESTING
-    if (neco_fail_write_counter > 0 || neco_partial_write > 0) {
-        nowork = true;
+#ifdef __linux__
+
+static int recvmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags, int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
     }
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+            return -1;
+        }
+#if NECO_BURST < 0
+        cowait(fd, EVREAD, deadline);
 #endif
-#if NECO_MAXIOWORKERS <= 0
-    nowork = true;
-#endif
-    if (!nowork) {
-        nowork = true;
-        struct coroutine *co = coself();
-        struct iowrite info = { 
-            .fd = fd, 
-            .data = data, 
-            .count = nbytes,
-            .co = co,
-            .rt = rt,
-        };
-        int64_t pin = co->id % NECO_MAXIOWORKERS;
-        if (worker_submit(rt->worker, pin, iowrite, &info)) {
-            rt->niowaiters++;
-            sco_pause();
-            rt->niowaiters--;
-            n = info.res;
-            if (n < 0) {
-                errno = -n;
-                n = -1;
+        int n = sys_recvmmsg0(fd, msgvec, vlen, flags|MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                readretry(fd, deadline);
+            } else {
+                return -1;
             }
-            nowork = false;
+        } else {
+            return n;
         }
     }
-    if (nowork) {
-        n = write2(fd, data, nbytes);
-    }
-    return n;
 }
-#else
-#define write3 write2
-#endif
 
-static ssize_t write_dl(int fd, const void *data, size_t nbytes,
-    int64_t deadline)
+/// Same as neco_recvmmsg() but with a deadline parameter. 
+int neco_recvmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen,
+    int flags, int64_t deadline)
+{
+    int ret = recvmmsg_dl(fd, msgvec, vlen, flags, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Receive multiple messages from a socket.
+///
+/// This waits until at least one message is available and then receives 
+/// as many as are ready, up to vlen, using a single system call. The size
+/// of each message is stored in the msg_len field of its mmsghdr.
+///
+/// Only available on Linux.
+///
+/// @return On success, the number of messages received is returned.
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see    Posix
+/// @see    https://www.man7.org/linux/man-pages/man2/recvmmsg.2.html
+int neco_recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags)
+{
+    return neco_recvmmsg_dl(fd, msgvec, vlen, flags, INT64_MAX);
+}
+
+static int sendmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags, int64_t deadline)
 {
     struct coroutine *co = coself();
     if (!co) {
         errno = EPERM;
         return -1;
     }
-    ssize_t written = 0;
-    while (1) {
+    struct kmmsghdr *msgs = (struct kmmsghdr*)msgvec;
+    unsigned int sent = 0;
+    while (sent < vlen) {
         int ret = checkdl(co, deadline);
         if (ret != NECO_OK) {
             errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
             return -1;
         }
-        // size_t maxnbytes = CLAMP(nbytes, 0, 8096);
-        // ssize_t n = write2(fd, data, maxnbytes);
-        ssize_t n = write3(fd, data, nbytes);
+        int n = sys_sendmmsg0(fd, (struct mmsghdr*)&msgs[sent], vlen-sent, 
+            flags|MSG_DONTWAIT);
         if (n == -1) {
             if (errno == EINTR || errno == EAGAIN) {
                 cowait(fd, EVWRITE, deadline);
-            } else if (written == 0) {
+            } else if (sent == 0) {
                 return -1;
             } else {
-                // There was an error but data has also been written. It's
-                // important to notify the caller about the amount of data
-                // written. The caller will need to then check to see if the
-                // return value is less than nbytes, and if so check
-                // the system errno.
-                return written;
+                // Same as write_dl, return the number that were sent.
+                break;
+            }
+        } else {
+            sent += (unsigned int)n;
+            if (sent < vlen) {
+                // Avoiding starving the other coroutines.
+                coyield();
             }
-        } else if (n > 0) {
-            nbytes -= (size_t)n;
-            written += (size_t)n;
-            data = (char*)data + n;
-        }
-        if (nbytes == 0) {
-            break;
-        }
-        if (n >= 0) {
-            // Some data was written but there's more yet. 
-            // Avoiding starving the other coroutines.
-            coyield();
         }
     }
-    return written;
+    return (int)sent;
 }
 
-/// Same as neco_write() but with a deadline parameter. 
-ssize_t neco_write_dl(int fd, const void *buf, size_t count,
-    int64_t deadline)
+/// Same as neco_sendmmsg() but with a deadline parameter. 
+int neco_sendmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen,
+    int flags, int64_t deadline)
 {
-    ssize_t ret = write_dl(fd, buf, count, deadline);
+    int ret = sendmmsg_dl(fd, msgvec, vlen, flags, deadline);
     async_error_guard(ret);
-    if (ret >= 0 && (size_t)ret < count) {
-        lasterr = NECO_PARTIALWRITE;
-    } 
     return ret;
 }
 
-/// Write to a file descriptor.
+/// Send multiple messages on a socket.
 ///
-/// This operation attempts to write all bytes in the buffer starting at buf
-/// to the file referred to by the file descriptor fd.
-///
-/// This is a Posix wrapper function for the purpose of running in a Neco
-/// coroutine. It's expected that the provided file descriptor is in 
-/// non-blocking state.
+/// The messages are sent in batches, using as few system calls as possible.
+/// Like neco_write(), this function will attempt to send _all_ vlen 
+/// messages, and returns fewer only when an error occurred after some were
+/// sent. The number of bytes sent for each message is stored in the msg_len
+/// field of its mmsghdr.
 ///
-/// One difference from the Posix version is that this function will attempt to
-/// write _all_ bytes in buffer. The programmer, at their discretion, may 
-/// considered it as an error when fewer than count is returned. If so, the
-/// neco_lasterr() will return the NECO_PARTIALWRITE.
+/// Only available on Linux.
 ///
-/// @return On success, the number of bytes written is returned.
+/// @return On success, the number of messages sent is returned.
 /// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
 ///         indicate the error.
 /// @see    Posix
-/// @see    neco_setnonblock()
-/// @see    https://www.man7.org/linux/man-pages/man2/write.2.html
-ssize_t neco_write(int fd, const void *buf, size_t count) {
-    return neco_write_dl(fd, buf, count, INT64_MAX);
+/// @see    https://www.man7.org/linux/man-pages/man2/sendmmsg.2.html
+int neco_sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, 
+    int flags)
+{
+    return neco_sendmmsg_dl(fd, msgvec, vlen, flags, INT64_MAX);
 }
 
+#endif
+
+#endif
+
 #ifdef _WIN32
 
 static int wsa_err_to_errno(int wsaerr) {
@@ -5388,6 +7623,25 @@ int accept1(int sock, struct sockaddr *addr, socklen_t *len) {
 #define accept1 accept0
 #endif
 
+// Accept a single connection without waiting, returning it in non-blocking
+// mode.
+static int accept_nowait(int sockfd, struct sockaddr *addr, 
+    socklen_t *addrlen)
+{
+#ifdef __linux__
+    // Have the kernel hand back a ready to use socket, saving the two
+    // fcntl calls per connection.
+    return sys_accept40(sockfd, addr, addrlen, SOCK_NONBLOCK|SOCK_CLOEXEC);
+#else
+    int fd = accept1(sockfd, addr, addrlen);
+    if (fd != -1 && neco_setnonblock(fd, true, 0) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
 static int accept_dl(int sockfd, struct sockaddr *addr, socklen_t *addrlen, 
     int64_t deadline)
 {
@@ -5402,7 +7656,7 @@ static int accept_dl(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
             errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
             return -1;
         }
-        int fd = accept1(sockfd, addr, addrlen);
+        int fd = accept_nowait(sockfd, addr, addrlen);
         if (fd == -1) {
             if (errno == EINTR || errno == EAGAIN) {
                 cowait(sockfd, EVREAD, deadline);
@@ -5410,10 +7664,6 @@ static int accept_dl(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
                 return -1;
             }
         } else {
-            if (neco_setnonblock(fd, true, 0) == -1) {
-                close(fd);
-                return -1;
-            }
             return fd;
         }
     }
@@ -5433,7 +7683,8 @@ int neco_accept_dl(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
 /// While in a coroutine, this function should be used instead of the standard
 /// accept() to avoid blocking other coroutines from running concurrently.
 ///
-/// The the accepted file descriptor is returned in non-blocking mode.
+/// The the accepted file descriptor is returned in non-blocking mode. On Linux
+/// it is also close-on-exec.
 ///
 /// @param sockfd Socket file descriptor
 /// @param addr Socket address out
@@ -5446,6 +7697,86 @@ int neco_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
     return neco_accept_dl(sockfd, addr, addrlen, INT64_MAX);
 }
 
+static int accept_many_dl(int sockfd, int *fds, int max, int64_t deadline) {
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return -1;
+    }
+    if (!fds || max <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int n = 0;
+    while (n < max) {
+        if (n == 0) {
+            int ret = checkdl(co, deadline);
+            if (ret != NECO_OK) {
+                errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+                return -1;
+            }
+        }
+        int fd = accept_nowait(sockfd, 0, 0);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (n > 0) {
+                // The queue is drained, or an error occurred after at least
+                // one connection was accepted. Return what was accepted and
+                // let the next call report the error, if it persists.
+                break;
+            } else if (errno == EAGAIN) {
+                cowait(sockfd, EVREAD, deadline);
+                continue;
+            } else {
+                return -1;
+            }
+        }
+        fds[n++] = fd;
+    }
+    return n;
+}
+
+/// Same as neco_accept_many() but with a deadline parameter. 
+int neco_accept_many_dl(int sockfd, int *fds, int max, int64_t deadline) {
+    int ret = accept_many_dl(sockfd, fds, max, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Accept many connections on a socket.
+///
+/// Waits for at least one pending connection and then drains the accept
+/// queue, without yielding, until it is empty or max connections have been
+/// accepted. Use this in place of neco_accept() when the accept loop must
+/// keep up with bursts of incoming connections.
+///
+/// The accepted file descriptors are returned in non-blocking mode.
+///
+/// **Example**
+///
+/// ```c
+/// int fds[64];
+/// while (1) {
+///     int n = neco_accept_many(servefd, fds, 64);
+///     for (int i = 0; i < n; i++) {
+///         neco_start(client, 1, &fds[i]);
+///     }
+/// }
+/// ```
+///
+/// @param sockfd Socket file descriptor
+/// @param fds Array that receives the accepted file descriptors
+/// @param max Capacity of fds
+/// @return On success, the number of accepted connections
+/// @return On error, value -1 (NECO_ERROR) is returned, and errno is set to
+///         indicate the error.
+/// @see Posix
+/// @see neco_accept()
+int neco_accept_many(int sockfd, int *fds, int max) {
+    return neco_accept_many_dl(sockfd, fds, max, INT64_MAX);
+}
+
 static int connect_dl(int fd, const struct sockaddr *addr, socklen_t addrlen, 
     int64_t deadline)
 {
@@ -5711,6 +8042,274 @@ int neco_getstats(neco_stats *stats) {
     return ret;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// contention profiling
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CALLSITE __builtin_return_address(0)
+#else
+#define CALLSITE NULL
+#endif
+
+// ctentry holds the contention profile for a single object and callsite
+// pair. Entries are stored in the runtime 'ctentries' aat.
+struct ctentry {
+    neco_contention ct;
+    AAT_FIELDS(struct ctentry, left, right, level)
+};
+
+static int ctentry_compare(struct ctentry *a, struct ctentry *b) {
+    return a->ct.kind < b->ct.kind ? -1 : a->ct.kind > b->ct.kind ? 1 :
+        (uintptr_t)a->ct.object < (uintptr_t)b->ct.object ? -1 :
+        (uintptr_t)a->ct.object > (uintptr_t)b->ct.object ? 1 :
+        (uintptr_t)a->ct.callsite < (uintptr_t)b->ct.callsite ? -1 :
+        (uintptr_t)a->ct.callsite > (uintptr_t)b->ct.callsite;
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+AAT_DEF(static, ctentries, struct ctentry)
+AAT_IMPL(ctentries, struct ctentry, left, right, level, ctentry_compare)
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+static void rt_freecontention(void) {
+    struct ctentry *entry;
+    while ((entry = ctentries_delete_first(&rt->ctentries))) {
+        free0(entry);
+    }
+}
+
+// ctop is a profiled operation that is in progress.
+struct ctop {
+    int64_t start;        // start time, or zero when profiling is disabled
+    int64_t npauses;      // pause count of the coroutine at start
+    const void *callsite; // the user callsite of the operation
+};
+
+// ctstart starts a profiled operation. The callsite is the return address
+// of the public function that was called by the user.
+static inline struct ctop ctstart(const void *callsite) {
+    struct ctop op = { 0 };
+    if (rt && rt->ctenabled) {
+        struct coroutine *co = coself();
+        if (co) {
+            op.start = getnow();
+            op.npauses = co->npauses;
+            op.callsite = callsite;
+        }
+    }
+    return op;
+}
+
+static void ctrecord0(int kind, const void *object, struct ctop op) {
+    struct coroutine *co = coself();
+    if (!rt->ctenabled) {
+        return;
+    }
+    struct ctentry key = { 
+        .ct = { .kind = kind, .object = object, .callsite = op.callsite }
+    };
+    struct ctentry *entry = ctentries_search(&rt->ctentries, &key);
+    if (!entry) {
+        entry = malloc0(sizeof(struct ctentry));
+        if (!entry) {
+            // Profiling is best effort.
+            return;
+        }
+        *entry = key;
+        ctentries_insert(&rt->ctentries, entry);
+    }
+    entry->ct.acquisitions++;
+    if (co->npauses == op.npauses) {
+        // Did not wait.
+        return;
+    }
+    int64_t elapsed = getnow() - op.start;
+    entry->ct.contended++;
+    entry->ct.waittime += elapsed;
+    if (elapsed > entry->ct.maxwait) {
+        entry->ct.maxwait = elapsed;
+    }
+    int i = 0;
+    uint64_t n = (uint64_t)elapsed >> 10;
+    while (n && i < NECO_CONTENTION_NBUCKETS-1) {
+        n >>= 1;
+        i++;
+    }
+    entry->ct.histogram[i]++;
+}
+
+// ctrecord finishes a profiled operation that was started with ctstart().
+static inline void ctrecord(int kind, const void *object, struct ctop op) {
+    if (op.start) {
+        ctrecord0(kind, object, op);
+    }
+}
+
+static int contention_enable(bool enable) {
+    if (!rt) {
+        return NECO_PERM;
+    }
+    rt->ctenabled = enable;
+    return NECO_OK;
+}
+
+/// Enable or disable contention profiling for the current runtime.
+///
+/// While enabled, every blocking mutex lock, condition variable wait,
+/// waitgroup wait, semaphore acquire, and channel send or receive records
+/// the number of times it was called and, when it had to wait, how long it
+/// waited. The profile is kept per object and per callsite.
+/// @param enable Enable profiling
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see neco_contention_foreach()
+/// @see neco_contention_dump()
+int neco_contention_enable(bool enable) {
+    int ret = contention_enable(enable);
+    error_guard(ret);
+    return ret;
+}
+
+static int contention_foreach(bool(*iter)(const neco_contention *ct, 
+    void *udata), void *udata)
+{
+    if (!iter) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    struct ctentry *entry = ctentries_first(&rt->ctentries);
+    while (entry) {
+        if (!iter(&entry->ct, udata)) {
+            break;
+        }
+        entry = ctentries_next(&rt->ctentries, entry);
+    }
+    return NECO_OK;
+}
+
+/// Iterate over the contention profile of the current runtime.
+///
+/// The iterator is called once for every object and callsite pair. Return
+/// false from the iterator to stop. The iterator must not perform any
+/// blocking operations.
+/// @param iter The iterator
+/// @param udata User data
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_contention_foreach(bool(*iter)(const neco_contention *ct, 
+    void *udata), void *udata)
+{
+    int ret = contention_foreach(iter, udata);
+    error_guard(ret);
+    return ret;
+}
+
+static int contention_reset(void) {
+    if (!rt) {
+        return NECO_PERM;
+    }
+    rt_freecontention();
+    return NECO_OK;
+}
+
+/// Clear the contention profile of the current runtime.
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_contention_reset(void) {
+    int ret = contention_reset();
+    error_guard(ret);
+    return ret;
+}
+
+static const char *contention_kind_name(int kind) {
+    switch (kind) {
+    case NECO_CONTENTION_MUTEX:     return "mutex";
+    case NECO_CONTENTION_COND:      return "cond";
+    case NECO_CONTENTION_WAITGROUP: return "waitgroup";
+    case NECO_CONTENTION_SEMA:      return "sema";
+    case NECO_CONTENTION_SEND:      return "send";
+    case NECO_CONTENTION_RECV:      return "recv";
+    default:                        return "unknown";
+    }
+}
+
+static ssize_t write_dl(int fd, const void *data, size_t nbytes,
+    int64_t deadline);
+
+static int contention_dump(int fd) {
+    if (!rt) {
+        return NECO_PERM;
+    } else if (!coself()) {
+        return NECO_PERM;
+    }
+    // Copy the entries first. Writing to the file may yield, which allows
+    // other coroutines to change the profile.
+    size_t count = 0;
+    struct ctentry *entry = ctentries_first(&rt->ctentries);
+    while (entry) {
+        count++;
+        entry = ctentries_next(&rt->ctentries, entry);
+    }
+    neco_contention *cts = malloc0(sizeof(neco_contention)*(count+1));
+    if (!cts) {
+        return NECO_NOMEM;
+    }
+    count = 0;
+    entry = ctentries_first(&rt->ctentries);
+    while (entry) {
+        cts[count++] = entry->ct;
+        entry = ctentries_next(&rt->ctentries, entry);
+    }
+    int ret = NECO_OK;
+    char line[512];
+    for (size_t i = 0; i < count && ret == NECO_OK; i++) {
+        neco_contention *ct = &cts[i];
+        int n = snprintf(line, sizeof(line), "%-9s object=%p callsite=%p "
+            "acquisitions=%" PRIi64 " contended=%" PRIi64 " waittime=%" PRIi64 
+            " maxwait=%" PRIi64 " histogram=",
+            contention_kind_name(ct->kind), ct->object, ct->callsite,
+            ct->acquisitions, ct->contended, ct->waittime, ct->maxwait);
+        int last = NECO_CONTENTION_NBUCKETS-1;
+        while (last > 0 && ct->histogram[last] == 0) {
+            last--;
+        }
+        for (int j = 0; j <= last && n < (int)sizeof(line)-32; j++) {
+            n += snprintf(line+n, sizeof(line)-(size_t)n, "%s%" PRIi64, 
+                j ? "," : "", ct->histogram[j]);
+        }
+        n += snprintf(line+n, sizeof(line)-(size_t)n, "\n");
+        if (write_dl(fd, line, (size_t)n, INT64_MAX) != n) {
+            ret = NECO_ERROR;
+        }
+    }
+    free0(cts);
+    return ret;
+}
+
+/// Write the contention profile of the current runtime to a file 
+/// descriptor, as text, with one line per object and callsite pair.
+///
+/// Times are in nanoseconds. Histogram bucket N counts the waits that were
+/// shorter than 2^(N+10) nanoseconds, and longer than the previous bucket.
+/// @param fd The file descriptor
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_ERROR Check errno for more info
+int neco_contention_dump(int fd) {
+    int ret = contention_dump(fd);
+    async_error_guard(ret);
+    return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // channels
 ////////////////////////////////////////////////////////////////////////////////
@@ -5723,13 +8322,47 @@ struct neco_chan {
     bool qrecv;           // queue has all receivers, otherwise all senders
     bool lok;             // used for the select-case 'closed' result
     struct colist queue;  // waiting coroutines. Either senders or receivers
+    bool segmented;       // buffer uses segments instead of the ring
+    bool wmabove;         // buffer is above the high watermark
     int msgsize;          // size of each message
-    int bufcap;           // max number of messages in ring buffer
-    int buflen;           // number of messages in ring buffer
+    int bufcap;           // max number of messages in buffer
+    int buflen;           // number of messages in buffer
     int bufpos;           // position of first message in ring buffer
+    int ringcap;          // number of message slots in ring buffer
+    struct chanseg *shead;   // first segment, messages are popped here
+    struct chanseg *stail;   // last segment, messages are pushed here
+    int wmlow;               // low watermark
+    int wmhigh;              // high watermark
+    void (*wmfunc)(struct neco_chan *chan, bool high, void *udata);
+    void *wmudata;
+    int (*prfunc)(const void *a, const void *b, void *udata); // priority 
+    void *prudata;
+    struct chantimer *timer; // timer feeding this channel, if any
+    size_t memsize;       // allocated size, including the ring buffer
     char data[];          // message ring buffer + one extra entry for 'lmsg'
 };
 
+// chanseg is a chunk of messages for the segmented buffer of an unbounded or 
+// resized channel. Segments that are NECO_CHANSEGSIZE in size are reused
+// through the runtime segment pool.
+struct chanseg {
+    struct chanseg *next;
+    int head;             // position of first message
+    int tail;             // position of next free message slot
+    char data[];
+};
+
+static void rt_freesegpool(void) {
+    while (rt->segpool) {
+        struct chanseg *seg = rt->segpool;
+        rt->segpool = seg->next;
+        free0(seg);
+    }
+}
+
+#define CHANSEG_DATASIZE ((int)(NECO_CHANSEGSIZE - sizeof(struct chanseg)))
+#define CHANSEG_POOLMAX  64
+
 // coselectcase pretends to be a coroutine for the purpose of multiplexing
 // select-case channels into a single coroutine. 
 // It's required that this structure is 16-byte aligned.
@@ -5751,28 +8384,219 @@ static char *cbufslot(struct neco_chan *chan, int index) {
     return chan->data + (chan->msgsize * index);
 }
 
-// push a message to the back by copying from data
-static void cbuf_push(struct neco_chan *chan, void *data) {
-    int pos = chan->bufpos + chan->buflen;
-    if (pos >= chan->bufcap) {
-        pos -= chan->bufcap;
+// returns the extra message slot used for select-case results
+static char *cbuflslot(struct neco_chan *chan) {
+    return cbufslot(chan, chan->ringcap);
+}
+
+// returns the number of messages that fit in one segment
+static int chanseg_cap(struct neco_chan *chan) {
+    if (chan->msgsize > CHANSEG_DATASIZE) {
+        return 1;
     }
-    if (chan->msgsize > 0) {
-        memcpy(cbufslot(chan, pos), data, (size_t)chan->msgsize);
+    return CHANSEG_DATASIZE / chan->msgsize;
+}
+
+static struct chanseg *chanseg_new(struct neco_chan *chan) {
+    struct chanseg *seg;
+    if (chan->msgsize > CHANSEG_DATASIZE) {
+        seg = malloc0(sizeof(struct chanseg) + (size_t)chan->msgsize);
+    } else if (rt->segpool) {
+        seg = rt->segpool;
+        rt->segpool = seg->next;
+        rt->nsegpool--;
+    } else {
+        seg = malloc0(NECO_CHANSEGSIZE);
+    }
+    if (!seg) {
+        return NULL;
+    }
+    seg->next = NULL;
+    seg->head = 0;
+    seg->tail = 0;
+    return seg;
+}
+
+static void chanseg_free(struct neco_chan *chan, struct chanseg *seg) {
+    if (POOL_ENABLED && chan->msgsize <= CHANSEG_DATASIZE && 
+        rt->nsegpool < CHANSEG_POOLMAX)
+    {
+        seg->next = rt->segpool;
+        rt->segpool = seg;
+        rt->nsegpool++;
+    } else {
+        free0(seg);
+    }
+}
+
+// push a message to the tail segment, adding a new segment when full.
+static bool cseg_push(struct neco_chan *chan, void *data) {
+    struct chanseg *seg = chan->stail;
+    if (!seg || seg->tail == chanseg_cap(chan)) {
+        struct chanseg *seg2 = chanseg_new(chan);
+        if (!seg2) {
+            return false;
+        }
+        if (seg) {
+            seg->next = seg2;
+        } else {
+            chan->shead = seg2;
+        }
+        chan->stail = seg2;
+        seg = seg2;
+    }
+    memcpy(seg->data + (size_t)chan->msgsize * (size_t)seg->tail, data, 
+        (size_t)chan->msgsize);
+    seg->tail++;
+    return true;
+}
+
+// pop a message from the head segment, releasing the segment when empty.
+static void cseg_pop(struct neco_chan *chan, void *data) {
+    struct chanseg *seg = chan->shead;
+    memcpy(data, seg->data + (size_t)chan->msgsize * (size_t)seg->head, 
+        (size_t)chan->msgsize);
+    seg->head++;
+    if (seg->head == seg->tail) {
+        chan->shead = seg->next;
+        if (!chan->shead) {
+            chan->stail = NULL;
+        }
+        chanseg_free(chan, seg);
+    }
+}
+
+static void cseg_clear(struct neco_chan *chan) {
+    while (chan->shead) {
+        struct chanseg *seg = chan->shead;
+        chan->shead = seg->next;
+        chanseg_free(chan, seg);
+    }
+    chan->stail = NULL;
+}
+
+// The buffer of a priority channel is a binary heap in the ring slots, 
+// ordered by the user compare function. The slot after the 'lmsg' slot is 
+// used as scratch space for swapping.
+static bool cheap_less(struct neco_chan *chan, int i, int j) {
+    return chan->prfunc(cbufslot(chan, i), cbufslot(chan, j), 
+        chan->prudata) < 0;
+}
+
+static void cheap_swap(struct neco_chan *chan, int i, int j) {
+    char *tmp = cbufslot(chan, chan->ringcap+1);
+    memcpy(tmp, cbufslot(chan, i), (size_t)chan->msgsize);
+    memcpy(cbufslot(chan, i), cbufslot(chan, j), (size_t)chan->msgsize);
+    memcpy(cbufslot(chan, j), tmp, (size_t)chan->msgsize);
+}
+
+static void cheap_push(struct neco_chan *chan, void *data) {
+    int i = chan->buflen;
+    memcpy(cbufslot(chan, i), data, (size_t)chan->msgsize);
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!cheap_less(chan, i, parent)) {
+            break;
+        }
+        cheap_swap(chan, i, parent);
+        i = parent;
+    }
+}
+
+static void cheap_pop(struct neco_chan *chan, void *data) {
+    memcpy(data, cbufslot(chan, 0), (size_t)chan->msgsize);
+    int n = chan->buflen - 1;
+    if (n == 0) {
+        return;
+    }
+    memcpy(cbufslot(chan, 0), cbufslot(chan, n), (size_t)chan->msgsize);
+    int i = 0;
+    while (1) {
+        int min = i;
+        int left = i * 2 + 1;
+        int right = left + 1;
+        if (left < n && cheap_less(chan, left, min)) {
+            min = left;
+        }
+        if (right < n && cheap_less(chan, right, min)) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        cheap_swap(chan, i, min);
+        i = min;
+    }
+}
+
+// Notify the watermark callback when the buffer length crosses the high 
+// watermark going up, or the low watermark going down.
+static void cbuf_watermark(struct neco_chan *chan) {
+    if (!chan->wmabove && chan->buflen >= chan->wmhigh) {
+        chan->wmabove = true;
+        chan->wmfunc(chan, true, chan->wmudata);
+    } else if (chan->wmabove && chan->buflen <= chan->wmlow) {
+        chan->wmabove = false;
+        chan->wmfunc(chan, false, chan->wmudata);
+    }
+}
+
+// push a message to the back by copying from data.
+// Returns false if a segmented buffer could not allocate a new segment.
+static bool cbuf_push(struct neco_chan *chan, void *data) {
+    if (chan->prfunc) {
+        cheap_push(chan, data);
+    } else if (chan->segmented) {
+        if (chan->msgsize > 0 && !cseg_push(chan, data)) {
+            return false;
+        }
+    } else {
+        int pos = chan->bufpos + chan->buflen;
+        if (pos >= chan->ringcap) {
+            pos -= chan->ringcap;
+        }
+        if (chan->msgsize > 0) {
+            memcpy(cbufslot(chan, pos), data, (size_t)chan->msgsize);
+        }
     }
     chan->buflen++;
+    if (chan->wmfunc) {
+        cbuf_watermark(chan);
+    }
+    return true;
 }
 
 // pop a message from the front and copy to data
 static void cbuf_pop(struct neco_chan *chan, void *data) {
-    if (chan->msgsize) {
-        memcpy(data, cbufslot(chan, chan->bufpos), (size_t)chan->msgsize);
-    }
-    chan->bufpos++;
-    if (chan->bufpos == chan->bufcap) {
-        chan->bufpos = 0;
+    if (chan->prfunc) {
+        cheap_pop(chan, data);
+    } else if (chan->segmented) {
+        if (chan->msgsize > 0) {
+            cseg_pop(chan, data);
+        }
+    } else {
+        if (chan->msgsize) {
+            memcpy(data, cbufslot(chan, chan->bufpos), (size_t)chan->msgsize);
+        }
+        chan->bufpos++;
+        if (chan->bufpos == chan->ringcap) {
+            chan->bufpos = 0;
+        }
     }
     chan->buflen--;
+    if (chan->wmfunc) {
+        cbuf_watermark(chan);
+    }
+}
+
+// remove all messages from the buffer
+static void cbuf_clear(struct neco_chan *chan) {
+    cseg_clear(chan);
+    chan->buflen = 0;
+    chan->bufpos = 0;
+    if (chan->wmfunc) {
+        cbuf_watermark(chan);
+    }
 }
 
 static struct neco_chan *chan_fastmake(size_t data_size, size_t capacity,
@@ -5782,21 +8606,19 @@ static struct neco_chan *chan_fastmake(size_t data_size, size_t capacity,
     // Generators do not need buffered capacity of any size because they can't
     // use the neco_select, which requires at least one buffered slot for the 
     // neco_case operation to store the pending data.
-    size_t ring_size = as_generator ? 0 : data_size * (capacity+1);
-    if (POOL_ENABLED && ring_size == 0 && rt->zchanpoollen > 0) {
-        chan = rt->zchanpool[--rt->zchanpoollen];
-    } else {
-        size_t memsize = sizeof(struct neco_chan) + ring_size;
-        chan = malloc0(memsize);
-        if (!chan) {
-            return NULL;
-        }
+    size_t ring_size = as_generator ? 0 : data_size * (capacity+1);
+    size_t memsize = sizeof(struct neco_chan) + ring_size;
+    chan = slab_alloc(memsize);
+    if (!chan) {
+        return NULL;
     }
     // Zero the struct memory space, not the data space.
     memset(chan, 0, sizeof(struct neco_chan));
+    chan->memsize = memsize;
     chan->rtid = rt->id;
     chan->msgsize = (int)data_size;
     chan->bufcap = (int)capacity;
+    chan->ringcap = (int)capacity;
     colist_init(&chan->queue);
     return chan;
 }
@@ -5898,30 +8720,15 @@ int neco_chan_retain(struct neco_chan *chan) {
     return ret;
 }
 
-static bool zchanpush(struct neco_chan *chan) {
-    if (rt->zchanpoollen == rt->zchanpoolcap) {
-        if (rt->zchanpoolcap == 256) {
-            return false;
-        }
-        int cap = rt->zchanpoolcap == 0 ? 16 : rt->zchanpoolcap * 2;
-        void *zchanpool2 = realloc0(rt->zchanpool, 
-            sizeof(struct neco_chan) * (size_t)cap);
-        if (!zchanpool2) {
-            return false;
-        }
-        rt->zchanpoolcap = cap;
-        rt->zchanpool = zchanpool2;
-    }
-    rt->zchanpool[rt->zchanpoollen++] = chan;
-    return true;
-}
-
 static void chan_fastrelease(struct neco_chan *chan) {
     chan->rc--;
     if (chan->rc < 0) {
-        if (!POOL_ENABLED || chan->msgsize > 0 || !zchanpush(chan)) {
-            free0(chan);
+        if (chan->timer) {
+            chantimer_disarm(chan->timer);
+            free0(chan->timer);
         }
+        cseg_clear(chan);
+        slab_free(chan, chan->memsize);
     }
 }
 
@@ -5951,6 +8758,35 @@ int neco_chan_release(struct neco_chan *chan) {
     return ret;
 }
 
+// Pops the next coroutine that is waiting to receive a message from the
+// channel queue, or NULL if there are none. Select-cases are exchanged with
+// their real coroutine, whose 'cmsg' is pointed at the case data slot.
+// Receivers that were already woken by their deadline are skipped, otherwise
+// the message would be lost when they return NECO_TIMEDOUT.
+static struct coroutine *chan_pop_receiver(struct neco_chan *chan) {
+    while (!colist_is_empty(&chan->queue) && chan->qrecv) {
+        struct coroutine *recv = colist_pop_front(&chan->queue);
+        if (recv->kind == SELECTCASE) {
+            // The receiver is a select-case. 
+            struct coselectcase *cocase = (struct coselectcase *)recv;
+            if (*cocase->ret_idx != -1 || cocase->co->deadlined) {
+                // This select-case has already been handled
+                continue;
+            }
+            // Set the far stack index pointer and exchange the select-case
+            // with the real coroutine.
+            *cocase->ret_idx = cocase->idx;
+            recv = cocase->co;
+            recv->cmsg = cocase->data;
+            *cocase->ok = true;
+        } else if (recv->deadlined) {
+            continue;
+        }
+        return recv;
+    }
+    return NULL;
+}
+
 static int chan_send0(struct neco_chan *chan, void *data, bool broadcast, 
     int64_t deadline)
 {
@@ -5967,9 +8803,256 @@ static int chan_send0(struct neco_chan *chan, void *data, bool broadcast,
         return NECO_CANCELED;
     }
     int sent = 0;
-    while (!colist_is_empty(&chan->queue) && chan->qrecv) {
+    struct coroutine *recv;
+    while ((recv = chan_pop_receiver(chan))) {
         // A receiver is currently waiting for a message.
-        // Pop it from the queue.
+        // Directly copy the message to the receiver's 'data' argument.
+        if (chan->msgsize > 0) {
+            memcpy(recv->cmsg, data, (size_t)chan->msgsize);
+        }
+        if (!broadcast) {
+            // Resume receiver immediately.
+            sco_resume(recv->id);
+            return NECO_OK;
+        } else {
+            // Schedule the reciever.
+            sched_resume(recv);
+            sent++;
+        }
+    }
+    if (broadcast) {
+        yield_for_sched_resume();
+        return sent;
+    }
+
+    if (chan->buflen < chan->bufcap) {
+        // There room to write to the ring buffer. 
+        // Add this message and return immediately.
+        if (!cbuf_push(chan, data)) {
+            return NECO_NOMEM;
+        }
+        return NECO_OK;
+    }
+
+    // Push this sender to queue
+    colist_push_back(&chan->queue, co);
+    chan->qrecv = false;
+    co->cmsg = data;
+
+    // Wait for a receiver to consume this message.
+    rt->nsenders++;
+    copause(deadline);
+    rt->nsenders--;
+    remove_from_list(co);
+
+    co->cmsg = NULL;
+    return checkdl(co, INT64_MAX);
+}
+
+static int chan_send_at(neco_chan *chan, void *data, int64_t deadline,
+    const void *callsite)
+{
+    struct ctop op = ctstart(callsite);
+    int ret = chan_send0(chan, data, false, deadline);
+    ctrecord(NECO_CONTENTION_SEND, chan, op);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Same as neco_chan_send() but with a deadline parameter.
+int neco_chan_send_dl(neco_chan *chan, void *data, int64_t deadline) {
+    return chan_send_at(chan, data, deadline, CALLSITE);
+}
+
+/// Send a message
+///
+/// See neco_chan_make() for an example.
+///
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_CANCELED Operation canceled
+/// @return NECO_CLOSED Channel closed
+/// @see Channels
+/// @see neco_chan_recv()
+int neco_chan_send(struct neco_chan *chan, void *data) {
+    return chan_send_at(chan, data, INT64_MAX, CALLSITE);
+}
+
+/// Sends message to all receiving channels.
+/// @return The number of channels that received the message
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_CLOSED Channel closed
+/// @note This operation cannot be canceled and does not timeout
+/// @see Channels
+/// @see neco_chan_recv()
+int neco_chan_broadcast(struct neco_chan *chan, void *data) {
+    int ret = chan_send0(chan, data, true, INT64_MAX);
+    error_guard(ret);
+    return ret;
+}
+
+static int chan_tryrecv0(struct neco_chan *chan, void *data, bool try,
+    int64_t deadline)
+{
+    if (!chan) {
+        return NECO_INVAL;
+    } else if (!rt || chan->rtid != rt->id) {
+        return NECO_PERM;
+    } else if (chan->rclosed) {
+        return NECO_CLOSED;
+    }
+    struct coroutine *co = coself();
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
+    }
+    if (chan->buflen > 0) {
+        // Take from the buffer
+        cbuf_pop(chan, data);
+        struct coroutine *send = NULL;
+        if (!colist_is_empty(&chan->queue) && chan->buflen < chan->bufcap) {
+            // There's a sender waiting to send a message.
+            // Put the sender's message in the buffer and wake it up.
+            // The sender stays in the queue if the buffer cannot grow.
+            send = chan->queue.head.next;
+            if (cbuf_push(chan, send->cmsg)) {
+                remove_from_list(send);
+            } else {
+                send = NULL;
+            }
+        }
+        if (chan->sclosed && colist_is_empty(&chan->queue) && 
+            chan->buflen == 0)
+        {
+            // The channel was closed and there are no more messages.
+            // Close the receiving side too
+            chan->rclosed = true;
+        }
+        if (send) {
+            sco_resume(send->id);
+        }
+        return NECO_OK;
+    }
+
+    if (!colist_is_empty(&chan->queue) && !chan->qrecv) {
+        // A sender is currently waiting to send a message.
+        // This message must be consumed immediately.
+        struct coroutine *send = colist_pop_front(&chan->queue);
+        if (chan->msgsize) {
+            memcpy(data, send->cmsg, (size_t)chan->msgsize);
+        }
+        if (chan->sclosed && colist_is_empty(&chan->queue) && 
+            chan->buflen == 0)
+        {
+            // The channel was closed and there are no more messages.
+            // Now close the receiving side too.
+            chan->rclosed = true;
+        }
+        sco_resume(send->id);
+        return NECO_OK;
+    }
+    if (try) {
+        return NECO_EMPTY;
+    }
+    // Push the receiver to the queue. 
+    colist_push_back(&chan->queue, co);
+    chan->qrecv = true;
+    // Assign the 'cmsg' message slot so that the sender knows where to copy
+    // the message.
+    co->cmsg = data;
+    // Set the channel closed flag that *may* be changed by the sender.
+    co->cclosed = false;
+    // Wait for a sender.
+    rt->nreceivers++;
+    copause(deadline);
+    rt->nreceivers--;
+    remove_from_list(co);
+    // The sender has already copied its message to 'data'.
+    co->cmsg = NULL;
+    int ret = checkdl(co, INT64_MAX);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    if (co->cclosed) {
+        // The channel was closed for receiving while this coroutine was
+        // waiting on a new message.
+        if (chan->msgsize) {
+            memset(data, 0, (size_t)chan->msgsize);
+        }
+        co->cclosed = false;
+        return NECO_CLOSED;
+    } else {
+        return NECO_OK;
+    }
+}
+
+static int chan_recv_at(struct neco_chan *chan, void *data, int64_t deadline,
+    const void *callsite)
+{
+    struct ctop op = ctstart(callsite);
+    int ret = chan_tryrecv0(chan, data, false, deadline);
+    ctrecord(NECO_CONTENTION_RECV, chan, op);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Same as neco_chan_recv() but with a deadline parameter.
+int neco_chan_recv_dl(struct neco_chan *chan, void *data, int64_t deadline) {
+    return chan_recv_at(chan, data, deadline, CALLSITE);
+}
+
+/// Receive a message
+///
+/// See neco_chan_make() for an example.
+///
+/// @param chan channel
+/// @param data data pointer
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_CANCELED Operation canceled
+/// @return NECO_CLOSED Channel closed
+/// @see Channels
+/// @see neco_chan_send()
+int neco_chan_recv(struct neco_chan *chan, void *data) {
+    return chan_recv_at(chan, data, INT64_MAX, CALLSITE);
+}
+
+/// Receive a message, but do not wait if the message is not available.
+/// @param chan channel
+/// @param data data pointer
+/// @return NECO_OK Success
+/// @return NECO_EMPTY No message available
+/// @return NECO_CLOSED Channel closed
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @see Channels
+/// @see neco_chan_recv()
+int neco_chan_tryrecv(struct neco_chan *chan, void *data) {
+    int ret = chan_tryrecv0(chan, data, true, INT64_MAX);
+    async_error_guard(ret);
+    return ret;
+}
+
+static int chan_close(struct neco_chan *chan) {
+    if (!chan) {
+        return NECO_INVAL;
+    } else if (!rt || chan->rtid != rt->id) {
+        return NECO_PERM;
+    } else if (chan->sclosed) {
+        return NECO_CLOSED;
+    }
+    chan->sclosed = true;
+    if (chan->buflen > 0 || (!colist_is_empty(&chan->queue) && !chan->qrecv)) {
+        // There are currently messages in the buffer or senders still waiting
+        // to send messages. Do not close the receiver side yet.
+        return NECO_OK;
+    }
+    // No buffered messages or senders waiting. 
+    // Close the receiver side and wake up all receivers.
+    while (!colist_is_empty(&chan->queue)) {
         struct coroutine *recv = colist_pop_front(&chan->queue);
         if (recv->kind == SELECTCASE) {
             // The receiver is a select-case. 
@@ -5982,489 +9065,889 @@ static int chan_send0(struct neco_chan *chan, void *data, bool broadcast,
             // with the real coroutine.
             *cocase->ret_idx = cocase->idx;
             recv = cocase->co;
-            recv->cmsg = cocase->data;
-            *cocase->ok = true;
-        }
-        // Directly copy the message to the receiver's 'data' argument.
-        if (chan->msgsize > 0) {
-            memcpy(recv->cmsg, data, (size_t)chan->msgsize);
+            *cocase->ok = false;
         }
-        if (!broadcast) {
-            // Resume receiver immediately.
-            sco_resume(recv->id);
-            return NECO_OK;
-        } else {
-            // Schedule the reciever.
-            sched_resume(recv);
-            sent++;
+        recv->cclosed = true;
+        sched_resume(recv);
+    }
+    chan->rclosed = true;
+    chan->qrecv = false;
+    yield_for_sched_resume();
+    return NECO_OK;
+}
+
+/// Close a channel for sending.
+/// @param chan channel
+/// @return NECO_OK Success
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_CLOSED Channel already closed
+int neco_chan_close(struct neco_chan *chan) {
+    int ret = chan_close(chan);
+    error_guard(ret);
+    return ret;
+}
+
+static int chan_select(int ncases, struct coselectcase *cases, int *ret_idx,
+    int64_t deadline, bool try)
+{
+    // Check that the channels are valid before continuing.
+    for (int i = 0; i < ncases; i++) {
+        struct neco_chan *chan = cases[i].chan;
+        if (!chan) {
+            return NECO_INVAL;
+        } else if (chan->rtid != rt->id) {
+            return NECO_PERM;
         }
     }
-    if (broadcast) {
-        yield_for_sched_resume();
-        return sent;
+
+    struct coroutine *co = coself();
+
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
     }
 
-    if (chan->buflen < chan->bufcap) {
-        // There room to write to the ring buffer. 
-        // Add this message and return immediately.
-        cbuf_push(chan, data);
-        return NECO_OK;
+    // Scan each channel and see if there are any messages waiting in their
+    // queue or if any are closed. 
+    // If so then receive that channel immediately.
+    for (int i = 0; i < ncases; i++) {
+        struct neco_chan *chan = cases[i].chan;
+        if ((!colist_is_empty(&chan->queue) && !chan->qrecv) || 
+            chan->buflen > 0 || chan->rclosed)
+        {
+            int ret = neco_chan_recv(cases[i].chan, cases[i].data);
+            *cases[i].ok = ret == NECO_OK;
+            return i;
+        }
     }
 
-    // Push this sender to queue
-    colist_push_back(&chan->queue, co);
-    chan->qrecv = false;
-    co->cmsg = data;
+    if (try) {
+        return NECO_EMPTY;
+    }
 
-    // Wait for a receiver to consume this message.
-    rt->nsenders++;
+    // Push all cases into their repsective channel queue.
+    for (int i = 0; i < ncases; i++) {
+        colist_push_back(&cases[i].chan->queue, (struct coroutine*)&cases[i]);
+        cases[i].chan->qrecv = true;
+    }
+
+    // Wait for a sender to wake us up
+    rt->nreceivers++;
     copause(deadline);
-    rt->nsenders--;
-    remove_from_list(co);
+    rt->nreceivers--;
 
-    co->cmsg = NULL;
-    return checkdl(co, INT64_MAX);
+    // Remove all cases
+    for (int i = 0; i < ncases; i++) {
+        remove_from_list((struct coroutine*)&cases[i]);
+    }
+    int ret = checkdl(co, INT64_MAX);
+    return ret == NECO_OK ? *ret_idx : ret;
 }
 
-/// Same as neco_chan_send() but with a deadline parameter.
-int neco_chan_send_dl(neco_chan *chan, void *data, int64_t deadline) {
-    int ret = chan_send0(chan, data, false, deadline);
+static int chan_selectv_dl(int ncases, va_list *args, struct neco_chan **chans, 
+    int64_t deadline, bool try)
+{
+    if (ncases < 0) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+
+    // Allocate space for storing each select-case struct. 
+    // These are used in place of a coroutine for the channel receiver queues.
+    bool must_free;
+    struct coselectcase stack_cases[8];
+    struct coselectcase *cases;
+    if (ncases > 8) {
+        cases = malloc0((size_t)ncases * sizeof(struct coselectcase));
+        if (!cases) {
+            return NECO_NOMEM;
+        }
+        must_free = true;
+    } else {
+        cases = stack_cases;
+        must_free = false;
+    }
+    struct coroutine *co = coself();
+    int ret_idx = -1;
+
+    // Copy the select-case arguments into the array.
+    for (int i = 0; i < ncases; i++) {
+        struct neco_chan *chan;
+        chan = args ? va_arg(*args, struct neco_chan*) : chans[i];
+        cases[i] = (struct coselectcase){
+            .chan = chan,
+            .kind = SELECTCASE,
+            .idx = i,
+            .ret_idx = &ret_idx,
+            .co = co,
+            .data = chan ? cbuflslot(chan) : 0,
+            .ok = chan ? &chan->lok : 0,
+        };
+        cases[i].next = (struct coroutine*)&cases[i];
+        cases[i].prev = (struct coroutine*)&cases[i];
+    }
+    int ret = chan_select(ncases, cases, &ret_idx, deadline, try);
+    if (must_free) {
+        free0(cases);
+    }
+    return ret;
+}
+
+/// Same as neco_chan_selectv() but with a deadline parameter.
+int neco_chan_selectv_dl(int nchans, struct neco_chan *chans[],
+    int64_t deadline)
+{
+    int ret = chan_selectv_dl(nchans, 0, chans, deadline, false);
     async_error_guard(ret);
     return ret;
 }
 
-/// Send a message
+/// Same as neco_chan_select() but using an array for arguments.
+int neco_chan_selectv(int nchans, struct neco_chan *chans[]) {
+    return neco_chan_selectv_dl(nchans, chans, INT64_MAX);
+}
+
+/// Same as neco_chan_select() but with a deadline parameter.
+int neco_chan_select_dl(int64_t deadline, int nchans, ...) {
+    va_list args;
+    va_start(args, nchans);
+    int ret = chan_selectv_dl(nchans, &args, 0, deadline, false);
+    va_end(args);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait on multiple channel operations at the same time. 
 ///
-/// See neco_chan_make() for an example.
+/// **Example**
 ///
-/// @return NECO_OK Success
+/// ```
+/// 
+/// // Let's say we have two channels 'c1' and 'c2' that both transmit 'char *'
+/// // messages.
+///
+/// // Use neco_chan_select() to wait on both channels.
+///
+/// char *msg;
+/// int idx = neco_chan_select(2, c1, c2);
+/// switch (idx) {
+/// case 0:
+///     neco_chan_case(c1, &msg);
+///     break;
+/// case 1:
+///     neco_chan_case(c2, &msg);
+///     break;
+/// default:
+///     // Error occured. The return value 'idx' is the error
+/// }
+///
+/// printf("%s\n", msg);
+/// ```
+///
+/// @param nchans Number of channels 
+/// @param ... The channels 
+/// @return The index of channel with an available message
 /// @return NECO_PERM Operation called outside of a coroutine
 /// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_NOMEM The system lacked the necessary resources
 /// @return NECO_CANCELED Operation canceled
-/// @return NECO_CLOSED Channel closed
 /// @see Channels
-/// @see neco_chan_recv()
-int neco_chan_send(struct neco_chan *chan, void *data) {
-    return neco_chan_send_dl(chan, data, INT64_MAX);
+int neco_chan_select(int nchans, ...) {
+    va_list args;
+    va_start(args, nchans);
+    int ret = chan_selectv_dl(nchans, &args, 0, INT64_MAX, false);
+    va_end(args);
+    async_error_guard(ret);
+    return ret;
 }
 
-/// Sends message to all receiving channels.
-/// @return The number of channels that received the message
+/// Same as neco_chan_select() but does not wait if a message is not available
+/// @return NECO_EMPTY No message available
+/// @see Channels
+/// @see neco_chan_select()
+int neco_chan_tryselect(int nchans, ...) {
+    va_list args;
+    va_start(args, nchans);
+    int ret = chan_selectv_dl(nchans, &args, 0, INT64_MAX, true);
+    va_end(args);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Same as neco_chan_tryselect() but uses an array for arguments.
+int neco_chan_tryselectv(int nchans, struct neco_chan *chans[]) {
+    int ret = chan_selectv_dl(nchans, 0, chans, 0, true);
+    async_error_guard(ret);
+    return ret;
+}
+
+static int chan_case(struct neco_chan *chan, void *data) {
+    if (!chan) {
+        return NECO_INVAL;
+    } else if (!rt || chan->rtid != rt->id) {
+        return NECO_PERM;
+    } else if (!chan->lok) {
+        return NECO_CLOSED;
+    }
+    if (chan->msgsize) {
+        memcpy(data, cbuflslot(chan), (size_t)chan->msgsize);
+    }
+    return NECO_OK;
+}
+
+/// Receive the message after a successful neco_chan_select().
+/// See neco_chan_select() for an example.
+/// @param chan The channel
+/// @param data The data
+/// @return NECO_OK Success
 /// @return NECO_PERM Operation called outside of a coroutine
 /// @return NECO_INVAL An invalid parameter was provided
 /// @return NECO_CLOSED Channel closed
-/// @note This operation cannot be canceled and does not timeout
-/// @see Channels
-/// @see neco_chan_recv()
-int neco_chan_broadcast(struct neco_chan *chan, void *data) {
-    int ret = chan_send0(chan, data, true, INT64_MAX);
+int neco_chan_case(struct neco_chan *chan, void *data) {
+    int ret = chan_case(chan, data);
     error_guard(ret);
     return ret;
 }
 
-static int chan_tryrecv0(struct neco_chan *chan, void *data, bool try,
-    int64_t deadline)
-{
+// Convert the channel from using the fixed inline ring buffer to using
+// a segmented buffer, copying over the buffered messages.
+static bool chan_tosegments(struct neco_chan *chan) {
+    if (chan->msgsize > 0) {
+        for (int i = 0; i < chan->buflen; i++) {
+            int pos = chan->bufpos + i;
+            if (pos >= chan->ringcap) {
+                pos -= chan->ringcap;
+            }
+            if (!cseg_push(chan, cbufslot(chan, pos))) {
+                cseg_clear(chan);
+                return false;
+            }
+        }
+    }
+    chan->bufpos = 0;
+    chan->segmented = true;
+    return true;
+}
+
+static int chan_setcap(struct neco_chan *chan, size_t capacity) {
     if (!chan) {
         return NECO_INVAL;
     } else if (!rt || chan->rtid != rt->id) {
         return NECO_PERM;
-    } else if (chan->rclosed) {
-        return NECO_CLOSED;
+    } else if (capacity > INT_MAX && capacity != NECO_CHAN_UNBOUNDED) {
+        return NECO_INVAL;
     }
-    struct coroutine *co = coself();
-    if (co->canceled) {
-        co->canceled = false;
-        return NECO_CANCELED;
+    int cap = capacity == NECO_CHAN_UNBOUNDED ? INT_MAX : (int)capacity;
+    if (chan->prfunc && cap > chan->ringcap) {
+        // The priority heap cannot grow past its initial capacity.
+        return NECO_PERM;
     }
-    if (chan->buflen > 0) {
-        // Take from the buffer
-        cbuf_pop(chan, data);
-        struct coroutine *send = NULL;
-        if (!colist_is_empty(&chan->queue)) {
-            // There's a sender waiting to send a message.
-            // Put the sender's message in the buffer and wake it up.
-            send = colist_pop_front(&chan->queue);
-            cbuf_push(chan, send->cmsg);
-        }
-        if (chan->sclosed && colist_is_empty(&chan->queue) && 
-            chan->buflen == 0)
-        {
-            // The channel was closed and there are no more messages.
-            // Close the receiving side too
-            chan->rclosed = true;
-        }
-        if (send) {
-            sco_resume(send->id);
+    if (!chan->segmented && cap > chan->ringcap) {
+        if (!chan_tosegments(chan)) {
+            return NECO_NOMEM;
         }
-        return NECO_OK;
     }
-
-    if (!colist_is_empty(&chan->queue) && !chan->qrecv) {
-        // A sender is currently waiting to send a message.
-        // This message must be consumed immediately.
-        struct coroutine *send = colist_pop_front(&chan->queue);
-        if (chan->msgsize) {
-            memcpy(data, send->cmsg, (size_t)chan->msgsize);
-        }
-        if (chan->sclosed && colist_is_empty(&chan->queue) && 
-            chan->buflen == 0)
-        {
-            // The channel was closed and there are no more messages.
-            // Now close the receiving side too.
-            chan->rclosed = true;
+    chan->bufcap = cap;
+    // The buffer may have grown, move the messages from waiting senders into
+    // the buffer and wake them up.
+    int woken = 0;
+    struct coroutine *send = chan->queue.head.next;
+    while (!chan->qrecv && chan->buflen < chan->bufcap &&
+        send != (struct coroutine*)&chan->queue.tail)
+    {
+        struct coroutine *next = send->next;
+        if (!send->deadlined) {
+            if (!cbuf_push(chan, send->cmsg)) {
+                break;
+            }
+            remove_from_list(send);
+            sched_resume(send);
+            woken++;
         }
-        sco_resume(send->id);
-        return NECO_OK;
+        send = next;
     }
-    if (try) {
-        return NECO_EMPTY;
+    if (woken > 0) {
+        yield_for_sched_resume();
     }
-    // Push the receiver to the queue. 
-    colist_push_back(&chan->queue, co);
-    chan->qrecv = true;
-    // Assign the 'cmsg' message slot so that the sender knows where to copy
-    // the message.
-    co->cmsg = data;
-    // Set the channel closed flag that *may* be changed by the sender.
-    co->cclosed = false;
-    // Wait for a sender.
-    rt->nreceivers++;
-    copause(deadline);
-    rt->nreceivers--;
-    remove_from_list(co);
-    // The sender has already copied its message to 'data'.
-    co->cmsg = NULL;
-    int ret = checkdl(co, INT64_MAX);
+    return NECO_OK;
+}
+
+/// Change the buffer capacity of a channel.
+///
+/// The capacity can grow or shrink at any time. Growing a channel beyond 
+/// the capacity that it was created with switches the channel over to a
+/// segmented buffer, which is allocated in NECO_CHANSEGSIZE chunks as
+/// needed. Coroutines that are waiting to send are woken up when there's
+/// new room in the buffer. When shrinking, the messages that are already
+/// buffered are kept, and sends will wait until the buffer has drained
+/// below the new capacity.
+///
+/// @param chan The channel
+/// @param capacity The new capacity, or NECO_CHAN_UNBOUNDED
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine, or attempting
+///         to grow a priority channel beyond its initial capacity
+/// @see Channels
+/// @see neco_chan_make_unbounded()
+int neco_chan_setcap(struct neco_chan *chan, size_t capacity) {
+    int ret = chan_setcap(chan, capacity);
+    error_guard(ret);
+    return ret;
+}
+
+static int chan_make_unbounded(struct neco_chan **chan, size_t data_size) {
+    int ret = chan_make(chan, data_size, 0);
     if (ret != NECO_OK) {
         return ret;
     }
-    if (co->cclosed) {
-        // The channel was closed for receiving while this coroutine was
-        // waiting on a new message.
-        if (chan->msgsize) {
-            memset(data, 0, (size_t)chan->msgsize);
-        }
-        co->cclosed = false;
-        return NECO_CLOSED;
-    } else {
-        return NECO_OK;
-    }
+    (*chan)->segmented = true;
+    (*chan)->bufcap = INT_MAX;
+    return NECO_OK;
 }
 
-/// Same as neco_chan_recv() but with a deadline parameter.
-int neco_chan_recv_dl(struct neco_chan *chan, void *data, int64_t deadline) {
-    int ret = chan_tryrecv0(chan, data, false, deadline);
-    async_error_guard(ret);
+/// Creates a new channel with an unbounded buffer.
+///
+/// Sending to an unbounded channel never waits for a receiver. The messages
+/// are stored in a segmented buffer that grows and shrinks as needed, using
+/// segments from a per-runtime pool.
+///
+/// @param chan Channel
+/// @param data_size Data size of messages
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @note The caller is responsible for freeing with neco_chan_release()
+/// @note A send on an unbounded channel may return NECO_NOMEM
+/// @see Channels
+/// @see neco_chan_setwatermarks()
+int neco_chan_make_unbounded(struct neco_chan **chan, size_t data_size) {
+    int ret = chan_make_unbounded(chan, data_size);
+    error_guard(ret);
     return ret;
 }
 
-/// Receive a message
+static int chan_make_priority(struct neco_chan **chan, size_t data_size, 
+    size_t capacity, int (*compare)(const void *a, const void *b, void *udata),
+    void *udata)
+{
+    if (!chan || !compare || data_size == 0 || data_size > INT_MAX || 
+        capacity == 0 || capacity > INT_MAX-1)
+    {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM; 
+    }
+    // Allocate one extra slot for swapping heap entries.
+    *chan = chan_fastmake(data_size, capacity+1, 0);
+    if (!*chan) {
+        return NECO_NOMEM;
+    }
+    (*chan)->bufcap = (int)capacity;
+    (*chan)->ringcap = (int)capacity;
+    (*chan)->prfunc = compare;
+    (*chan)->prudata = udata;
+    return NECO_OK;
+}
+
+/// Creates a new buffered channel that receives messages in priority order.
 ///
-/// See neco_chan_make() for an example.
+/// Buffered messages are received in the order defined by the compare 
+/// function, rather than in the order they were sent. The compare function
+/// returns a negative value when message `a` should be received before
+/// message `b`. The buffer is a binary heap, thus messages of equal priority
+/// are not guaranteed to be received in the order they were sent.
 ///
-/// @param chan channel
-/// @param data data pointer
+/// Only messages that are in the buffer are ordered. Senders waiting on a
+/// full buffer are queued in the order they arrived.
+///
+/// **Example**
+///
+/// ```
+/// int compare(const void *a, const void *b, void *udata) {
+///     const struct job *ja = a;
+///     const struct job *jb = b;
+///     return ja->urgency > jb->urgency ? -1 : ja->urgency < jb->urgency;
+/// }
+///
+/// neco_chan *jobs;
+/// neco_chan_make_priority(&jobs, sizeof(struct job), 256, compare, 0);
+/// ```
+///
+/// @param chan Channel
+/// @param data_size Data size of messages, must be greater than zero
+/// @param capacity Buffer capacity, must be greater than zero
+/// @param compare Function that compares two messages
+/// @param udata User data passed to the compare function
 /// @return NECO_OK Success
-/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_NOMEM The system lacked the necessary resources
 /// @return NECO_INVAL An invalid parameter was provided
-/// @return NECO_CANCELED Operation canceled
-/// @return NECO_CLOSED Channel closed
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @note The caller is responsible for freeing with neco_chan_release()
 /// @see Channels
-/// @see neco_chan_send()
-int neco_chan_recv(struct neco_chan *chan, void *data) {
-    return neco_chan_recv_dl(chan, data, INT64_MAX);
+int neco_chan_make_priority(struct neco_chan **chan, size_t data_size, 
+    size_t capacity, int (*compare)(const void *a, const void *b, void *udata),
+    void *udata)
+{
+    int ret = chan_make_priority(chan, data_size, capacity, compare, udata);
+    error_guard(ret);
+    return ret;
 }
 
-/// Receive a message, but do not wait if the message is not available.
-/// @param chan channel
-/// @param data data pointer
+static int chan_setwatermarks(struct neco_chan *chan, size_t low, size_t high,
+    void (*func)(struct neco_chan *chan, bool high, void *udata), void *udata)
+{
+    if (!chan || low > INT_MAX || high > INT_MAX || low >= high) {
+        return NECO_INVAL;
+    } else if (!rt || chan->rtid != rt->id) {
+        return NECO_PERM;
+    }
+    chan->wmlow = (int)low;
+    chan->wmhigh = (int)high;
+    chan->wmfunc = func;
+    chan->wmudata = udata;
+    chan->wmabove = false;
+    if (chan->wmfunc) {
+        cbuf_watermark(chan);
+    }
+    return NECO_OK;
+}
+
+/// Set the buffer watermarks for a channel, for backpressure.
+///
+/// The callback is called with `high` set to true when the number of 
+/// buffered messages rises to the high watermark, and then called with
+/// `high` set to false once it drops back down to the low watermark.
+///
+/// The callback runs inline from the coroutine that is sending or receiving 
+/// and must not block.
+///
+/// @param chan The channel
+/// @param low The low watermark
+/// @param high The high watermark, must be greater than low
+/// @param func The callback, or NULL to remove the watermarks
+/// @param udata User data passed to the callback
 /// @return NECO_OK Success
-/// @return NECO_EMPTY No message available
-/// @return NECO_CLOSED Channel closed
-/// @return NECO_PERM Operation called outside of a coroutine
 /// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
 /// @see Channels
-/// @see neco_chan_recv()
-int neco_chan_tryrecv(struct neco_chan *chan, void *data) {
-    int ret = chan_tryrecv0(chan, data, true, INT64_MAX);
-    async_error_guard(ret);
+int neco_chan_setwatermarks(struct neco_chan *chan, size_t low, size_t high,
+    void (*func)(struct neco_chan *chan, bool high, void *udata), void *udata)
+{
+    int ret = chan_setwatermarks(chan, low, high, func, udata);
+    error_guard(ret);
     return ret;
 }
 
-static int chan_close(struct neco_chan *chan) {
+// Deliver the current time to the timer's channel without blocking. The
+// message goes directly to a waiting receiver, or into the channel buffer.
+// If the buffer is full then the tick is dropped, same as a Go ticker.
+static void chantimer_fire(struct chantimer *timer, int64_t now) {
+    struct neco_chan *chan = timer->chan;
+    chantimer_disarm(timer);
+    if (timer->func) {
+        timer->func(timer, now);
+        return;
+    }
+    if (chan->sclosed) {
+        return;
+    }
+    struct coroutine *recv = chan_pop_receiver(chan);
+    if (recv) {
+        memcpy(recv->cmsg, &now, sizeof(int64_t));
+        sco_resume(recv->id);
+    } else if (chan->buflen < chan->bufcap) {
+        (void)cbuf_push(chan, &now);
+    }
+    if (timer->interval > 0) {
+        // Rearm the ticker, skipping any ticks that were missed.
+        int64_t deadline = i64_add_clamp(timer->deadline, timer->interval);
+        if (deadline <= now) {
+            int64_t missed = (now - timer->deadline) / timer->interval;
+            deadline = i64_add_clamp(timer->deadline, 
+                (missed + 1) * timer->interval);
+        }
+        chantimer_arm(timer, deadline);
+    }
+}
+
+static int timer_make(struct neco_chan **chan, int64_t duration, 
+    int64_t interval)
+{
     if (!chan) {
         return NECO_INVAL;
-    } else if (!rt || chan->rtid != rt->id) {
+    } else if (!rt) {
         return NECO_PERM;
-    } else if (chan->sclosed) {
-        return NECO_CLOSED;
     }
-    chan->sclosed = true;
-    if (chan->buflen > 0 || (!colist_is_empty(&chan->queue) && !chan->qrecv)) {
-        // There are currently messages in the buffer or senders still waiting
-        // to send messages. Do not close the receiver side yet.
-        return NECO_OK;
+    struct chantimer *timer = malloc0(sizeof(struct chantimer));
+    if (!timer) {
+        return NECO_NOMEM;
     }
-    // No buffered messages or senders waiting. 
-    // Close the receiver side and wake up all receivers.
-    while (!colist_is_empty(&chan->queue)) {
-        struct coroutine *recv = colist_pop_front(&chan->queue);
-        if (recv->kind == SELECTCASE) {
-            // The receiver is a select-case. 
-            struct coselectcase *cocase = (struct coselectcase *)recv;
-            if (*cocase->ret_idx != -1) {
-                // This select-case has already been handled
-                continue;
-            }
-            // Set the far stack index pointer and exchange the select-case
-            // with the real coroutine.
-            *cocase->ret_idx = cocase->idx;
-            recv = cocase->co;
-            *cocase->ok = false;
-        }
-        recv->cclosed = true;
-        sched_resume(recv);
+    *chan = chan_fastmake(sizeof(int64_t), 1, 0);
+    if (!*chan) {
+        free0(timer);
+        return NECO_NOMEM;
+    }
+    memset(timer, 0, sizeof(struct chantimer));
+    timer->chan = *chan;
+    timer->id = rt->timerid++;
+    timer->interval = interval;
+    (*chan)->timer = timer;
+    chantimer_arm(timer, i64_add_clamp(getnow(), duration));
+    return NECO_OK;
+}
+
+/// Creates a channel that receives the current time after a duration.
+///
+/// The channel has a capacity of one and messages are `int64_t` timestamps,
+/// as returned by neco_now(), of when the timer fired.
+/// The timer is managed by the runtime scheduler and does not require a
+/// coroutine of its own, so it can be used with neco_chan_select() for
+/// combining timeouts with other channel operations.
+///
+/// **Example**
+///
+/// ```
+/// neco_chan *tm;
+/// neco_timer_make(&tm, NECO_SECOND);
+/// int idx = neco_chan_select(2, ch, tm);
+/// if (idx == 1) {
+///     // timed out after one second
+/// }
+/// neco_chan_release(tm);
+/// ```
+///
+/// @param chan The timer channel
+/// @param duration Duration before the timer fires
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @note The caller is responsible for freeing with neco_chan_release(), 
+///       which also stops the timer.
+/// @see Channels
+/// @see neco_ticker_make()
+int neco_timer_make(struct neco_chan **chan, int64_t duration) {
+    int ret = timer_make(chan, duration, 0);
+    error_guard(ret);
+    return ret;
+}
+
+static int ticker_make(struct neco_chan **chan, int64_t interval) {
+    if (interval <= 0) {
+        return NECO_INVAL;
+    }
+    return timer_make(chan, interval, interval);
+}
+
+/// Creates a channel that receives the current time at every interval.
+///
+/// Same as neco_timer_make() but the timer repeats until the channel is
+/// released or neco_timer_stop() is called. Ticks are dropped when the
+/// receiver falls behind, rather than queued up.
+///
+/// @param chan The ticker channel
+/// @param interval Duration between ticks, must be greater than zero
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Channels
+/// @see neco_timer_make()
+int neco_ticker_make(struct neco_chan **chan, int64_t interval) {
+    int ret = ticker_make(chan, interval);
+    error_guard(ret);
+    return ret;
+}
+
+static int timer_stop(struct neco_chan *chan) {
+    if (!chan) {
+        return NECO_INVAL;
+    } else if (!rt || chan->rtid != rt->id) {
+        return NECO_PERM;
+    } else if (!chan->timer) {
+        return NECO_INVAL;
     }
-    chan->rclosed = true;
-    chan->qrecv = false;
-    yield_for_sched_resume();
+    chantimer_disarm(chan->timer);
     return NECO_OK;
 }
 
-/// Close a channel for sending.
-/// @param chan channel
+/// Stop a timer or ticker channel from firing.
+///
+/// A message that was already delivered to the channel buffer is not
+/// removed. Use neco_timer_reset() to restart the timer.
+///
+/// @param chan The timer channel
 /// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided, or the channel is
+///         not a timer
 /// @return NECO_PERM Operation called outside of a coroutine
-/// @return NECO_INVAL An invalid parameter was provided
-/// @return NECO_CLOSED Channel already closed
-int neco_chan_close(struct neco_chan *chan) {
-    int ret = chan_close(chan);
+/// @see Channels
+int neco_timer_stop(struct neco_chan *chan) {
+    int ret = timer_stop(chan);
     error_guard(ret);
     return ret;
 }
 
-static int chan_select(int ncases, struct coselectcase *cases, int *ret_idx,
-    int64_t deadline, bool try)
-{
-    // Check that the channels are valid before continuing.
-    for (int i = 0; i < ncases; i++) {
-        struct neco_chan *chan = cases[i].chan;
-        if (!chan) {
+static int timer_reset(struct neco_chan *chan, int64_t duration) {
+    int ret = timer_stop(chan);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct chantimer *timer = chan->timer;
+    if (timer->interval > 0) {
+        if (duration <= 0) {
             return NECO_INVAL;
-        } else if (chan->rtid != rt->id) {
-            return NECO_PERM;
         }
+        timer->interval = duration;
     }
+    // Drop any stale message so that the next receive is for the new
+    // deadline.
+    cbuf_clear(chan);
+    chantimer_arm(timer, i64_add_clamp(getnow(), duration));
+    return NECO_OK;
+}
 
-    struct coroutine *co = coself();
+/// Restart a timer or ticker channel with a new duration.
+///
+/// For tickers the duration becomes the new interval. Any pending message
+/// in the channel buffer is discarded.
+///
+/// @param chan The timer channel
+/// @param duration Duration before the timer fires
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided, or the channel is
+///         not a timer
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Channels
+int neco_timer_reset(struct neco_chan *chan, int64_t duration) {
+    int ret = timer_reset(chan, duration);
+    error_guard(ret);
+    return ret;
+}
 
-    if (co->canceled) {
-        co->canceled = false;
-        return NECO_CANCELED;
-    }
+static_assert(NECO_SELECT_READ == EVREAD, "");
+static_assert(NECO_SELECT_WRITE == EVWRITE, "");
+
+// selcase is used by neco_select() for each case. Channel cases use the
+// select-case that is queued on the channel, and file cases use the event
+// waiter that is registered with the scheduler.
+struct selcase {
+    struct coselectcase ccase;
+    struct evwaiter ev;
+} aligned16;
+
+static int select0(int ncases, struct neco_selectcase *cases, 
+    struct selcase *scases, int64_t deadline)
+{
+    struct coroutine *co = coself();
+    bool hasfds = false;
+    bool haschans = false;
 
     // Scan each channel and see if there are any messages waiting in their
-    // queue or if any are closed. 
-    // If so then receive that channel immediately.
+    // queue or if any are closed. If so then receive that channel now.
     for (int i = 0; i < ncases; i++) {
         struct neco_chan *chan = cases[i].chan;
+        if (cases[i].kind != NECO_SELECT_RECV) {
+            hasfds = true;
+            continue;
+        }
+        haschans = true;
         if ((!colist_is_empty(&chan->queue) && !chan->qrecv) || 
             chan->buflen > 0 || chan->rclosed)
         {
-            int ret = neco_chan_recv(cases[i].chan, cases[i].data);
-            *cases[i].ok = ret == NECO_OK;
+            int ret = chan_tryrecv0(chan, cbuflslot(chan), false, INT64_MAX);
+            chan->lok = ret == NECO_OK;
             return i;
         }
     }
-
-    if (try) {
-        return NECO_EMPTY;
+#if !defined(NECO_POLL_EPOLL) && !defined(NECO_POLL_KQUEUE)
+    // Windows and Emscripten only yield for file cases, until support for
+    // events queues are enabled. Channel only selects still wait below.
+    if (hasfds) {
+        sco_yield();
+        for (int i = 0; i < ncases; i++) {
+            if (cases[i].kind != NECO_SELECT_RECV) {
+                return i;
+            }
+        }
     }
+#else
+    if (hasfds && evqueue_ensure() == -1) {
+        return -1;
+    }
+#endif
 
-    // Push all cases into their repsective channel queue.
-    for (int i = 0; i < ncases; i++) {
-        colist_push_back(&cases[i].chan->queue, (struct coroutine*)&cases[i]);
-        cases[i].chan->qrecv = true;
+    // Register all cases with their respective channel queue or event.
+    int ret_idx = -1;
+    int ret = NECO_OK;
+    int nregs = 0;
+    for (; nregs < ncases; nregs++) {
+        struct neco_selectcase *c = &cases[nregs];
+        struct selcase *sc = &scases[nregs];
+        if (c->kind == NECO_SELECT_RECV) {
+            sc->ccase = (struct coselectcase){
+                .chan = c->chan,
+                .kind = SELECTCASE,
+                .idx = nregs,
+                .ret_idx = &ret_idx,
+                .co = co,
+                .data = cbuflslot(c->chan),
+                .ok = &c->chan->lok,
+            };
+            sc->ccase.next = (struct coroutine*)&sc->ccase;
+            sc->ccase.prev = (struct coroutine*)&sc->ccase;
+            colist_push_back(&c->chan->queue, (struct coroutine*)&sc->ccase);
+            c->chan->qrecv = true;
+        } else {
+#if defined(NECO_POLL_EPOLL) || defined(NECO_POLL_KQUEUE)
+            sc->ev = (struct evwaiter){
+                .fd = c->fd,
+                .kind = (enum evkind)c->kind,
+                .co = co,
+                .idx = nregs,
+                .ret_idx = &ret_idx,
+            };
+            if (evwaiter_add(&sc->ev) == -1) {
+                ret = -1;
+                break;
+            }
+#endif
+        }
     }
 
-    // Wait for a sender to wake us up
-    rt->nreceivers++;
-    copause(deadline);
-    rt->nreceivers--;
+    if (ret == NECO_OK) {
+        // Wait for a sender or file event to wake us up
+        rt->nreceivers += haschans;
+        rt->nevwaiters += hasfds;
+        copause(deadline);
+        rt->nreceivers -= haschans;
+        rt->nevwaiters -= hasfds;
+    }
 
     // Remove all cases
-    for (int i = 0; i < ncases; i++) {
-        remove_from_list((struct coroutine*)&cases[i]);
+    for (int i = 0; i < nregs; i++) {
+        if (cases[i].kind == NECO_SELECT_RECV) {
+            remove_from_list((struct coroutine*)&scases[i].ccase);
+        } else {
+#if defined(NECO_POLL_EPOLL) || defined(NECO_POLL_KQUEUE)
+            evwaiter_del(&scases[i].ev);
+#endif
+        }
     }
-    int ret = checkdl(co, INT64_MAX);
-    return ret == NECO_OK ? *ret_idx : ret;
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    ret = checkdl(co, INT64_MAX);
+    if (ret == NECO_TIMEDOUT && ret_idx != -1) {
+        // A case fired at the same time as the deadline.
+        ret = NECO_OK;
+    }
+    return ret == NECO_OK ? ret_idx : ret;
 }
 
-static int chan_selectv_dl(int ncases, va_list *args, struct neco_chan **chans, 
-    int64_t deadline, bool try)
+static int select_dl(int ncases, struct neco_selectcase *cases, 
+    int64_t deadline)
 {
-    if (ncases < 0) {
+    if (ncases < 0 || (ncases > 0 && !cases)) {
         return NECO_INVAL;
     } else if (!rt) {
         return NECO_PERM;
     }
-
-    // Allocate space for storing each select-case struct. 
-    // These are used in place of a coroutine for the channel receiver queues.
-    bool must_free;
-    struct coselectcase stack_cases[8];
-    struct coselectcase *cases;
-    if (ncases > 8) {
-        cases = malloc0((size_t)ncases * sizeof(struct coselectcase));
-        if (!cases) {
-            return NECO_NOMEM;
+    // Check that the cases are valid before continuing.
+    for (int i = 0; i < ncases; i++) {
+        switch (cases[i].kind) {
+        case NECO_SELECT_RECV:
+            if (!cases[i].chan) {
+                return NECO_INVAL;
+            } else if (cases[i].chan->rtid != rt->id) {
+                return NECO_PERM;
+            }
+            break;
+        case NECO_SELECT_READ:
+        case NECO_SELECT_WRITE:
+            if (cases[i].fd < 0) {
+                return NECO_INVAL;
+            }
+            break;
+        default:
+            return NECO_INVAL;
         }
-        must_free = true;
-    } else {
-        cases = stack_cases;
-        must_free = false;
     }
     struct coroutine *co = coself();
-    int ret_idx = -1;
-
-    // Copy the select-case arguments into the array.
-    for (int i = 0; i < ncases; i++) {
-        struct neco_chan *chan;
-        chan = args ? va_arg(*args, struct neco_chan*) : chans[i];
-        cases[i] = (struct coselectcase){
-            .chan = chan,
-            .kind = SELECTCASE,
-            .idx = i,
-            .ret_idx = &ret_idx,
-            .co = co,
-            .data = chan ? cbufslot(chan, chan->bufcap) : 0,
-            .ok = chan ? &chan->lok : 0,
-        };
-        cases[i].next = (struct coroutine*)&cases[i];
-        cases[i].prev = (struct coroutine*)&cases[i];
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
     }
-    int ret = chan_select(ncases, cases, &ret_idx, deadline, try);
-    if (must_free) {
-        free0(cases);
+    struct selcase stack_scases[8];
+    struct selcase *scases = stack_scases;
+    if (ncases > 8) {
+        scases = malloc0((size_t)ncases * sizeof(struct selcase));
+        if (!scases) {
+            return NECO_NOMEM;
+        }
+    }
+    int ret = select0(ncases, cases, scases, deadline);
+    if (scases != stack_scases) {
+        free0(scases);
     }
     return ret;
 }
 
-/// Same as neco_chan_selectv() but with a deadline parameter.
-int neco_chan_selectv_dl(int nchans, struct neco_chan *chans[],
-    int64_t deadline)
-{
-    int ret = chan_selectv_dl(nchans, 0, chans, deadline, false);
-    async_error_guard(ret);
-    return ret;
-}
-
-/// Same as neco_chan_select() but using an array for arguments.
-int neco_chan_selectv(int nchans, struct neco_chan *chans[]) {
-    return neco_chan_selectv_dl(nchans, chans, INT64_MAX);
-}
-
-/// Same as neco_chan_select() but with a deadline parameter.
-int neco_chan_select_dl(int64_t deadline, int nchans, ...) {
-    va_list args;
-    va_start(args, nchans);
-    int ret = chan_selectv_dl(nchans, &args, 0, deadline, false);
-    va_end(args);
+/// Same as neco_select() but with a deadline parameter.
+int neco_select_dl(int ncases, neco_selectcase cases[], int64_t deadline) {
+    int ret = select_dl(ncases, cases, deadline);
     async_error_guard(ret);
     return ret;
 }
 
-/// Wait on multiple channel operations at the same time. 
+/// Wait on multiple channels and file descriptors at the same time.
 ///
-/// **Example**
+/// Each case is either a channel receive (NECO_SELECT_RECV), or a file
+/// descriptor that is waiting to be readable (NECO_SELECT_READ) or writable
+/// (NECO_SELECT_WRITE). The first case that is ready wins. For channel
+/// cases, use neco_chan_case() to receive the message.
 ///
-/// ```
-/// 
-/// // Let's say we have two channels 'c1' and 'c2' that both transmit 'char *'
-/// // messages.
+/// Timers from neco_timer_make() and neco_ticker_make() are channels too,
+/// and may be used as cases.
 ///
-/// // Use neco_chan_select() to wait on both channels.
+/// **Example**
 ///
-/// char *msg;
-/// int idx = neco_chan_select(2, c1, c2);
+/// ```
+/// neco_selectcase cases[] = {
+///     { .kind = NECO_SELECT_READ, .fd = sockfd },
+///     { .kind = NECO_SELECT_RECV, .chan = ctrl },
+/// };
+/// int idx = neco_select(2, cases);
 /// switch (idx) {
 /// case 0:
-///     neco_chan_case(c1, &msg);
+///     // sockfd is readable
 ///     break;
 /// case 1:
-///     neco_chan_case(c2, &msg);
+///     neco_chan_case(ctrl, &msg);
 ///     break;
 /// default:
 ///     // Error occured. The return value 'idx' is the error
 /// }
-///
-/// printf("%s\n", msg);
 /// ```
 ///
-/// @param nchans Number of channels 
-/// @param ... The channels 
-/// @return The index of channel with an available message
-/// @return NECO_PERM Operation called outside of a coroutine
-/// @return NECO_INVAL An invalid parameter was provided
-/// @return NECO_NOMEM The system lacked the necessary resources
-/// @return NECO_CANCELED Operation canceled
-/// @see Channels
-int neco_chan_select(int nchans, ...) {
-    va_list args;
-    va_start(args, nchans);
-    int ret = chan_selectv_dl(nchans, &args, 0, INT64_MAX, false);
-    va_end(args);
-    async_error_guard(ret);
-    return ret;
-}
-
-/// Same as neco_chan_select() but does not wait if a message is not available
-/// @return NECO_EMPTY No message available
-/// @see Channels
-/// @see neco_chan_select()
-int neco_chan_tryselect(int nchans, ...) {
-    va_list args;
-    va_start(args, nchans);
-    int ret = chan_selectv_dl(nchans, &args, 0, INT64_MAX, true);
-    va_end(args);
-    async_error_guard(ret);
-    return ret;
-}
-
-/// Same as neco_chan_tryselect() but uses an array for arguments.
-int neco_chan_tryselectv(int nchans, struct neco_chan *chans[]) {
-    int ret = chan_selectv_dl(nchans, 0, chans, 0, true);
-    async_error_guard(ret);
-    return ret;
-}
-
-static int chan_case(struct neco_chan *chan, void *data) {
-    if (!chan) {
-        return NECO_INVAL;
-    } else if (!rt || chan->rtid != rt->id) {
-        return NECO_PERM;
-    } else if (!chan->lok) {
-        return NECO_CLOSED;
-    }
-    if (chan->msgsize) {
-        memcpy(data, cbufslot(chan, chan->bufcap), (size_t)chan->msgsize);
-    }
-    return NECO_OK;
-}
-
-/// Receive the message after a successful neco_chan_select().
-/// See neco_chan_select() for an example.
-/// @param chan The channel
-/// @param data The data
-/// @return NECO_OK Success
-/// @return NECO_PERM Operation called outside of a coroutine
-/// @return NECO_INVAL An invalid parameter was provided
-/// @return NECO_CLOSED Channel closed
-int neco_chan_case(struct neco_chan *chan, void *data) {
-    int ret = chan_case(chan, data);
-    error_guard(ret);
-    return ret;
+/// @param ncases Number of cases
+/// @param cases The cases
+/// @return The index of the case that is ready
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_CANCELED Operation canceled
+/// @return NECO_ERROR Check errno for more info
+/// @see Channels
+/// @see neco_chan_select()
+/// @see neco_wait()
+int neco_select(int ncases, neco_selectcase cases[]) {
+    return neco_select_dl(ncases, cases, INT64_MAX);
 }
 
 struct getaddrinfo_args {
@@ -6544,44 +10027,82 @@ static struct getaddrinfo_args *gai_args_new(const char *node,
     return args;
 }
 
+// The number of lookups that are still held by a background thread.
 static atomic_int getaddrinfo_th_counter = 0;
+static atomic_int getaddrinfo_lookups = 0;
 
 #ifdef NECO_TESTING
 int neco_getaddrinfo_nthreads(void) {
     return atomic_load(&getaddrinfo_th_counter);
 }
+
+// Returns the number of lookups that were handed to the system resolver.
+int neco_getaddrinfo_nlookups(void) {
+    return atomic_load(&getaddrinfo_lookups);
+}
+
+// Slows down each lookup, in nanoseconds.
+_Atomic(int64_t) neco_gai_delay = 0;
 #endif
 
-static void *getaddrinfo_th(void *v) {
-    struct getaddrinfo_args *a = v;
+// Performs the lookup on a background thread and notifies the leader through
+// the pipe. The leader may have already abandoned the lookup, so the args are
+// freed by whichever side lets go of them last, and the runtime is never
+// touched from here.
+static void gai_work(void *udata) {
+    struct getaddrinfo_args *a = udata;
+#ifdef NECO_TESTING
+    int64_t delay = atomic_load(&neco_gai_delay);
+    if (delay > 0) {
+        nanosleep(&(struct timespec){
+            .tv_sec = delay/NECO_SECOND,
+            .tv_nsec = delay%NECO_SECOND,
+        }, 0);
+    }
+#endif
     a->ret = getaddrinfo(a->node, a->service, a->hints, &a->res);
     a->errnum = errno;
     must(write(a->fds[1], &(int){1}, sizeof(int)) == sizeof(int));
-    while (!atomic_load(&a->returned)) {
-        sched_yield();
+    if (atomic_exchange(&a->returned, 1)) {
+        gai_args_free(a);
     }
-    gai_args_free(a);
     atomic_fetch_sub(&getaddrinfo_th_counter, 1);
+}
+
+#ifdef NECO_NOWORKERS
+static void *getaddrinfo_th(void *v) {
+    gai_work(v);
     return NULL;
 }
+#else
+// Lookups have their own worker pool, which is shared by all runtimes and is
+// never freed. A lookup may block its thread for a long time, so it must not
+// hold the workers that neco_read() and neco_write() use. Also the runtime
+// joins its own workers when it returns, but not these, which allows for a
+// lookup to outlive the runtime that started it. Idle threads stop on their
+// own.
+static struct worker *gai_worker = NULL;
+static pthread_once_t gai_worker_once = PTHREAD_ONCE_INIT;
+
+static void gai_worker_init(void) {
+    struct worker_opts wopts = {
+        .max_threads = NECO_MAXGAIWORKERS,
+        .max_thread_entries = NECO_MAXRINGSIZE,
+    };
+    gai_worker = worker_new(&wopts);
+}
+#endif
 
 static bool is_ip_address(const char *addr) {
     bool ok = false;
     if (addr) {
         struct in6_addr result;
-        ok = inet_pton(AF_INET, addr, &result) == 1 || 
+        ok = inet_pton(AF_INET, addr, &result) == 1 ||
              inet_pton(AF_INET6, addr, &result) == 1;
     }
     return ok;
 }
 
-static void cleanup_gai(void *ptr) {
-    // This notifies the gai thread that it should return. The thread itself
-    // will do the actual cleanup of resources.
-    struct getaddrinfo_args *args = ptr;
-    atomic_store(&args->returned, 1);
-}
-
 #ifdef _WIN32
 int pipe1(int fds[2]) {
     return _pipe(fds, 64, _O_BINARY);
@@ -6590,49 +10111,234 @@ int pipe1(int fds[2]) {
 #define pipe1 pipe0
 #endif
 
-static int getaddrinfo_dl(const char *node, const char *service,
-    const struct addrinfo *hints, struct addrinfo **res, int64_t deadline)
+////////////////////////////////////////////////////////////////////////////////
+// gai - Name resolution for neco_getaddrinfo.
+// Each lookup is run by a leader coroutine on the worker pool. Concurrent
+// lookups for the same query join the leader's flight and share its result,
+// and successful results are kept in a small per-runtime cache.
+// The system getaddrinfo does not report the TTLs of the DNS records, so
+// cached results live for a fixed NECO_GAICACHETTL.
+// Sharing requires handing out copies that the caller can release with the
+// system freeaddrinfo, which is only possible when the layout of its results
+// is known. Elsewhere each lookup gets its own flight and no cache is used.
+////////////////////////////////////////////////////////////////////////////////
+
+#if !defined(NECO_NOGAICACHE) && (defined(__GLIBC__) || \
+    defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || \
+    defined(__DragonFly__))
+#define GAI_SHARED
+#endif
+
+#ifndef NECO_GAICACHETTL
+#define NECO_GAICACHETTL (NECO_SECOND*10)
+#endif
+
+#ifndef NECO_GAICACHESIZE
+#define NECO_GAICACHESIZE 64
+#endif
+
+struct gaiflight {
+    struct gaiflight *next;        // next in-flight lookup for the runtime
+    struct getaddrinfo_args *args; // the query, owned by the leader
+    struct coroutine *leader;      // the coroutine performing the lookup
+    struct colist waiters;         // coroutines waiting on the result
+    int rc;                        // the leader and each joined caller
+    bool done;                     // the result is ready
+    int ret;                       // getaddrinfo return value
+    int errnum;                    // errno from the lookup
+    struct addrinfo *res;          // the result, freed with the flight
+};
+
+struct gaientry {
+    struct gaientry *next;         // next (older) entry
+    int64_t expires;               // when the entry is no longer used
+    struct getaddrinfo_args *args; // the query and a private copy of result
+};
+
+#ifdef GAI_SHARED
+#ifndef NECO_TESTING
+static
+#endif
+__thread int64_t neco_gai_cachettl = NECO_GAICACHETTL;
+
+static bool gai_streq(const char *a, const char *b) {
+    return (!a || !b) ? a == b : strcmp(a, b) == 0;
+}
+
+static bool gai_match(struct getaddrinfo_args *args, const char *node,
+    const char *service, const struct addrinfo *hints)
 {
-    struct coroutine *co = coself();
-    if (!co) {
-        errno = EPERM;
-        return EAI_SYSTEM;
+    if (!gai_streq(args->node, node) || !gai_streq(args->service, service)) {
+        return false;
     }
-    int ret = checkdl(co, deadline);
-    if (ret != NECO_OK) {
-        errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
-        return EAI_SYSTEM;
+    if (!args->hints || !hints) {
+        return args->hints == hints;
+    }
+    return args->hints->ai_flags == hints->ai_flags &&
+           args->hints->ai_family == hints->ai_family &&
+           args->hints->ai_socktype == hints->ai_socktype &&
+           args->hints->ai_protocol == hints->ai_protocol;
+}
+
+// Copy an addrinfo list using the same layout as the system getaddrinfo,
+// one allocation per entry which includes its address, so that the copy can
+// be released with freeaddrinfo. The system allocator is used for the same
+// reason.
+static struct addrinfo *gai_copy(const struct addrinfo *ai) {
+    struct addrinfo *head = NULL;
+    struct addrinfo **tail = &head;
+    for (; ai; ai = ai->ai_next) {
+        struct addrinfo *cp = malloc(sizeof(struct addrinfo)+ai->ai_addrlen);
+        if (!cp) {
+            goto fail;
+        }
+        *cp = *ai;
+        cp->ai_next = NULL;
+        cp->ai_canonname = NULL;
+        cp->ai_addr = (struct sockaddr*)(cp+1);
+        memcpy(cp->ai_addr, ai->ai_addr, ai->ai_addrlen);
+        *tail = cp;
+        tail = &cp->ai_next;
+        if (ai->ai_canonname) {
+            size_t n = strlen(ai->ai_canonname);
+            cp->ai_canonname = malloc(n+1);
+            if (!cp->ai_canonname) {
+                goto fail;
+            }
+            memcpy(cp->ai_canonname, ai->ai_canonname, n+1);
+        }
     }
-    if (is_ip_address(node)) {
-        // This is a simple address. Since there's no DNS lookup involved we
-        // can use the standard getaddrinfo function without worrying about
-        // much delay.
-        return getaddrinfo(node, service, hints, res);
+    return head;
+fail:
+    freeaddrinfo(head);
+    return NULL;
+}
+
+static void gai_entry_free(struct gaientry *entry) {
+    gai_args_free(entry->args);
+    free0(entry);
+}
+
+// Returns the cached entry for the query, or NULL if there is none.
+// Expired entries are removed along the way.
+static struct gaientry *gai_cache_find(const char *node, const char *service,
+    const struct addrinfo *hints)
+{
+    int64_t now = getnow();
+    struct gaientry **pentry = &rt->gaicache;
+    while (*pentry) {
+        struct gaientry *entry = *pentry;
+        if (entry->expires <= now) {
+            *pentry = entry->next;
+            gai_entry_free(entry);
+            rt->ngaicache--;
+            continue;
+        }
+        if (gai_match(entry->args, node, service, hints)) {
+            return entry;
+        }
+        pentry = &entry->next;
+    }
+    return NULL;
+}
+
+// Add a successful result to the cache, evicting the oldest entry when full.
+// Failing to allocate just leaves the result uncached.
+static void gai_cache_add(struct getaddrinfo_args *query, struct addrinfo *res)
+{
+    if (neco_gai_cachettl <= 0 || NECO_GAICACHESIZE <= 0) {
+        return;
+    }
+    struct gaientry *entry = malloc0(sizeof(struct gaientry));
+    if (!entry) {
+        return;
+    }
+    entry->args = gai_args_new(query->node, query->service, query->hints);
+    if (!entry->args) {
+        free0(entry);
+        return;
+    }
+    entry->args->res = gai_copy(res);
+    if (!entry->args->res) {
+        gai_entry_free(entry);
+        return;
+    }
+    entry->expires = i64_add_clamp(getnow(), neco_gai_cachettl);
+    if (rt->ngaicache >= NECO_GAICACHESIZE) {
+        struct gaientry **pentry = &rt->gaicache;
+        while ((*pentry)->next) {
+            pentry = &(*pentry)->next;
+        }
+        gai_entry_free(*pentry);
+        *pentry = NULL;
+        rt->ngaicache--;
     }
+    entry->next = rt->gaicache;
+    rt->gaicache = entry;
+    rt->ngaicache++;
+}
 
-    // DNS lookup is probably needed. This may cause network usage and who
-    // knows how long it will take to return. Here we'll use a background
-    // thread to do the work and we'll wait by using a local pipe.
-    struct getaddrinfo_args *args = gai_args_new(node, service, hints);
-    if (!args) {
-        return EAI_MEMORY;
+static struct gaiflight *gai_flight_find(const char *node,
+    const char *service, const struct addrinfo *hints)
+{
+    struct gaiflight *flight = rt->gaiflights;
+    while (flight && !gai_match(flight->args, node, service, hints)) {
+        flight = flight->next;
+    }
+    return flight;
+}
+
+static void gai_flight_unlink(struct gaiflight *flight) {
+    struct gaiflight **pflight = &rt->gaiflights;
+    while (*pflight != flight) {
+        pflight = &(*pflight)->next;
+    }
+    *pflight = flight->next;
+}
+#endif
+
+static void rt_freegaicache(void) {
+#ifdef GAI_SHARED
+    while (rt->gaicache) {
+        struct gaientry *entry = rt->gaicache;
+        rt->gaicache = entry->next;
+        gai_entry_free(entry);
+    }
+    rt->ngaicache = 0;
+#endif
+}
+
+static void gai_flight_release(struct gaiflight *flight) {
+    flight->rc--;
+    if (flight->rc == 0) {
+        freeaddrinfo(flight->res);
+        free0(flight);
     }
+}
 
-    // Create a pipe to communicate with the thread. This allows us to use the
-    // async neco_read() operation, which includes builtin deadline and cancel
-    // support. Using a traditional pthread mutexes or cond variables are not
-    // an option.
+// Run the lookup in the background and wait for it using a local pipe, which
+// allows for using the async neco_read() operation. Using a traditional
+// pthread mutexes or cond variables are not an option.
+// When every caller has left, the leader is canceled and stops waiting. The
+// lookup is then abandoned to the background, which frees the args when the
+// resolver returns.
+// Returns true if the background took its share of the args, which are then
+// freed by whichever side lets go of them last.
+static bool gai_lookup(struct gaiflight *flight) {
+    struct getaddrinfo_args *args = flight->args;
+    flight->ret = EAI_SYSTEM;
     if (pipe1(args->fds) == -1) {
-        gai_args_free(args);
-        return EAI_SYSTEM;
+        flight->errnum = errno;
+        return false;
     }
 #ifndef _WIN32
     if (neco_setnonblock(args->fds[0], true, 0) == -1) {
-        gai_args_free(args);
-        return EAI_SYSTEM;
+        flight->errnum = errno;
+        return false;
     }
 #endif
 
+#ifdef NECO_NOWORKERS
     pthread_t th;
 #ifdef __FreeBSD__
     // The pthread functions are not included in libc for FreeBSD, dynamically
@@ -6642,44 +10348,197 @@ static int getaddrinfo_dl(const char *node, const char *service,
     int (*pthread_detach)(pthread_t);
     args->dlhandle = dlopen("/usr/lib/libpthread.so", RTLD_LAZY);
     if (!args->dlhandle) {
-        gai_args_free(args);
-        return EAI_SYSTEM;
+        flight->errnum = errno;
+        return false;
     }
     pthread_create = (int(*)(pthread_t*,const pthread_attr_t*,void*(*)(void*),
         void*))dlsym(args->dlhandle, "pthread_create");
     pthread_detach = (int(*)(pthread_t))
         dlsym(args->dlhandle, "pthread_detach");
     if (!pthread_create || !pthread_detach) {
-        gai_args_free(args);
-        return EAI_SYSTEM;
+        flight->errnum = errno;
+        return false;
     }
 #endif
     atomic_fetch_add(&getaddrinfo_th_counter, 1);
-    ret = pthread_create0(&th, 0, getaddrinfo_th, args);
+    int ret = pthread_create0(&th, 0, getaddrinfo_th, args);
     if (ret != 0) {
-        errno = ret;
-        gai_args_free(args);
+        flight->errnum = ret;
         atomic_fetch_sub(&getaddrinfo_th_counter, 1);
-        return EAI_SYSTEM;
+        return false;
     }
     must(pthread_detach0(th) == 0);
-
-    // At this point the args are owned by the thread and all cleanup will
-    // happen there. The thread will complete the getaddrinfo operation.
-    // Then we'll steal the result and return it to the caller.
-    neco_cleanup_push(cleanup_gai, args);
+#else
+    pthread_once(&gai_worker_once, gai_worker_init);
+    if (!gai_worker) {
+        flight->errnum = ENOMEM;
+        return false;
+    }
+    atomic_fetch_add(&getaddrinfo_th_counter, 1);
+    while (!worker_submit(gai_worker, -1, gai_work, args)) {
+        sco_yield();
+    }
+#endif
     int ready = 0;
-    ssize_t n = neco_read_dl(args->fds[0], &ready, sizeof(int), deadline);
-    ret = EAI_SYSTEM;
-    if (n != -1) {
+    ssize_t n;
+    do {
+        n = neco_read_dl(args->fds[0], &ready, sizeof(int), INT64_MAX);
+        // Keep waiting for as long as there are callers.
+    } while (n == -1 && errno == ECANCELED && flight->rc > 1);
+    if (n == -1) {
+        flight->errnum = errno;
+    } else {
         must(ready == 1 && n == sizeof(int));
-        *res = args->res;
+        flight->res = args->res;
         args->res = NULL;
-        ret = args->ret;
-        errno = args->errnum;
-        coyield();
+        flight->ret = args->ret;
+        flight->errnum = args->errnum;
     }
-    neco_cleanup_pop(1);
+    return true;
+}
+
+// The leader performs the lookup for its flight, then wakes the callers that
+// joined it. Callers that timed out or were canceled have already left.
+static void gai_leader(int argc, void *argv[]) {
+    (void)argc;
+    struct gaiflight *flight = argv[0];
+    struct getaddrinfo_args *args = flight->args;
+    // The leader must clean up after a cancel, so never exit on one.
+    flight->leader = coself();
+    flight->leader->canceltype = NECO_CANCEL_INLINE;
+    atomic_fetch_add(&getaddrinfo_lookups, 1);
+    bool background = gai_lookup(flight);
+    flight->done = true;
+    flight->leader = NULL;
+#ifdef GAI_SHARED
+    gai_flight_unlink(flight);
+    if (flight->ret == 0) {
+        gai_cache_add(args, flight->res);
+    }
+#endif
+    struct coroutine *co = colist_pop_front(&flight->waiters);
+    while (co) {
+        sched_resume(co);
+        co = colist_pop_front(&flight->waiters);
+    }
+    if (!background || atomic_exchange(&args->returned, 1)) {
+        gai_args_free(args);
+    }
+    flight->args = NULL;
+    gai_flight_release(flight);
+}
+
+// Start a new flight for the query. The returned flight is held by the
+// caller, which must release it.
+static struct gaiflight *gai_flight_start(const char *node,
+    const char *service, const struct addrinfo *hints)
+{
+    struct gaiflight *flight = malloc0(sizeof(struct gaiflight));
+    if (!flight) {
+        return NULL;
+    }
+    memset(flight, 0, sizeof(struct gaiflight));
+    colist_init(&flight->waiters);
+    flight->args = gai_args_new(node, service, hints);
+    if (!flight->args) {
+        free0(flight);
+        return NULL;
+    }
+    flight->rc = 2;
+#ifdef GAI_SHARED
+    flight->next = rt->gaiflights;
+    rt->gaiflights = flight;
+#endif
+    void *argv[] = { flight };
+    if (start(gai_leader, 1, 0, argv, 0, 0, 0, 0, 0) != NECO_OK) {
+#ifdef GAI_SHARED
+        gai_flight_unlink(flight);
+#endif
+        gai_args_free(flight->args);
+        free0(flight);
+        return NULL;
+    }
+    return flight;
+}
+
+static int getaddrinfo_dl(const char *node, const char *service,
+    const struct addrinfo *hints, struct addrinfo **res, int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        errno = EPERM;
+        return EAI_SYSTEM;
+    }
+    int ret = checkdl(co, deadline);
+    if (ret != NECO_OK) {
+        errno = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+        return EAI_SYSTEM;
+    }
+    if (is_ip_address(node)) {
+        // This is a simple address. Since there's no DNS lookup involved we
+        // can use the standard getaddrinfo function without worrying about
+        // much delay.
+        return getaddrinfo(node, service, hints, res);
+    }
+
+    // DNS lookup is probably needed. This may cause network usage and who
+    // knows how long it will take to return. The lookup is performed in the
+    // background by a flight, which is shared with any other coroutine that
+    // asks for the same query in the meantime.
+    struct gaiflight *flight = NULL;
+#ifdef GAI_SHARED
+    struct gaientry *entry = gai_cache_find(node, service, hints);
+    if (entry) {
+        *res = gai_copy(entry->args->res);
+        return *res ? 0 : EAI_MEMORY;
+    }
+    flight = gai_flight_find(node, service, hints);
+    if (flight) {
+        flight->rc++;
+    }
+#endif
+    if (!flight) {
+        flight = gai_flight_start(node, service, hints);
+        if (!flight) {
+            return EAI_MEMORY;
+        }
+    }
+    while (!flight->done) {
+        ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            break;
+        }
+        colist_push_back(&flight->waiters, co);
+        copause(deadline);
+        remove_from_list(co);
+    }
+    int errnum;
+    if (flight->done) {
+        ret = flight->ret;
+        errnum = flight->errnum;
+        if (ret == 0) {
+#ifdef GAI_SHARED
+            *res = gai_copy(flight->res);
+            if (!*res) {
+                ret = EAI_MEMORY;
+            }
+#else
+            *res = flight->res;
+            flight->res = NULL;
+#endif
+        }
+    } else {
+        errnum = ret == NECO_CANCELED ? ECANCELED : ETIMEDOUT;
+        ret = EAI_SYSTEM;
+        if (flight->rc == 2 && flight->leader) {
+            // This is the last caller, no need for the leader to keep
+            // waiting on the lookup.
+            flight->leader->canceled = true;
+            sco_resume(flight->leader->id);
+        }
+    }
+    gai_flight_release(flight);
+    errno = errnum;
     return ret;
 }
 
@@ -6706,6 +10565,15 @@ int neco_getaddrinfo_dl(const char *node, const char *service,
 /// This is functionally identical to the Posix getaddrinfo function with the
 /// exception that it does not block, allowing for usage in a Neco coroutine.
 ///
+/// Lookups run on a pool of background threads. Concurrent lookups for the
+/// same query share a single lookup, and successful results are briefly 
+/// cached by the runtime. The result must still be freed with freeaddrinfo().
+///
+/// A lookup cannot be stopped once it is handed to the system resolver.
+/// When every caller has timed out or was canceled, the lookup is abandoned
+/// and its result is discarded when the resolver returns. An abandoned lookup
+/// does not keep the runtime from returning.
+///
 /// @return On success, 0 is returned
 /// @return On error, a nonzero error code defined by the system. See the link
 ///         below for a list.
@@ -6770,7 +10638,7 @@ static void cleanup_free_host(void *host) {
 
 // Returns NECO errors
 static int getaddrinfo_from_tcp_addr_dl(const char *addr, int tcp_vers, 
-    struct addrinfo **res, int64_t deadline)
+    int socktype, struct addrinfo **res, int64_t deadline)
 {
     char *host = NULL;
     const char *port = 0;
@@ -6780,8 +10648,8 @@ static int getaddrinfo_from_tcp_addr_dl(const char *addr, int tcp_vers,
     }
     struct addrinfo hints = { 0 };
     hints.ai_family = AF_UNSPEC; 
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = socktype == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP;
     hints.ai_family = tcp_vers;
     struct addrinfo *ainfo = NULL;
     const char *vhost = host;
@@ -6815,7 +10683,7 @@ static int getaddrinfo_from_tcp_addr_dl(const char *addr, int tcp_vers,
 
 
 static int getaddrinfo_from_tcp_addr_dl(const char *addr, int tcp_vers, 
-    struct addrinfo **res, int64_t deadline);
+    int socktype, struct addrinfo **res, int64_t deadline);
 
 int neco_errconv_from_sys(void);
 
@@ -6859,43 +10727,204 @@ static int dial_connect_dl(int domain, int type, int protocol,
     if (fd == -1) {
         return -1;
     }
-    if (neco_setnonblock(fd, true, 0) == -1) {
-        close(fd);
-        return -1;
+    if (neco_setnonblock(fd, true, 0) == -1) {
+        close(fd);
+        return -1;
+    }
+    int ret;
+    neco_cleanup_push(cleanup_close_socket, &fd);
+    ret = neco_connect_dl(fd, addr, addrlen, deadline);
+    if (ret == 0) {
+        ret = fd;
+        fd = -1;
+    }
+    neco_cleanup_pop(1);
+    return ret;
+}
+
+static void cleanup_addrinfo(void *arg) {
+    struct addrinfo *ainfo = arg;
+    freeaddrinfo(ainfo);
+}
+
+// Happy Eyeballs (RFC 8305). When a host resolves to more than one address
+// the connection attempts are raced, each in its own coroutine. A new attempt
+// starts every NECO_DIALDELAY, or as soon as the previous attempt fails, and
+// the first attempt to connect wins. The others are canceled.
+#ifndef NECO_DIALDELAY
+#define NECO_DIALDELAY (NECO_MILLISECOND*250)
+#endif
+
+struct dialrace {
+    struct coroutine *co;          // the dialing coroutine
+    int64_t deadline;              // deadline for all attempts
+    bool waiting;                  // dialer is paused, waiting on attempts
+    int nrunning;                  // number of running attempts
+    int fd;                        // the winning socket, or -1
+    int err;                       // errno of the first failed attempt
+};
+
+struct dialattempt {
+    struct dialrace *race;
+    struct addrinfo *ai;
+    int64_t id;                    // attempt coroutine id
+    bool done;
+};
+
+static void dial_attempt(int argc, void *argv[]) {
+    (void)argc;
+    struct dialattempt *att = argv[0];
+    struct dialrace *race = att->race;
+    // The dialer must always hear back, so never exit on a cancel.
+    coself()->canceltype = NECO_CANCEL_INLINE;
+    struct addrinfo *ai = att->ai;
+    int fd = dial_connect_dl(ai->ai_family, ai->ai_socktype, ai->ai_protocol, 
+        ai->ai_addr, ai->ai_addrlen, race->deadline);
+    if (fd == -1) {
+        if (race->err == 0 && errno != ECANCELED) {
+            race->err = errno;
+        }
+    } else if (race->fd == -1) {
+        race->fd = fd;
+    } else {
+        close(fd);
+    }
+    att->done = true;
+    race->nrunning--;
+    if (race->waiting) {
+        race->waiting = false;
+        sco_resume(race->co->id);
+    }
+}
+
+// Returns a connected socket or -1 with errno set.
+static int dial_race_dl(struct addrinfo *ainfo, int64_t deadline) {
+    int n = 0;
+    for (struct addrinfo *ai = ainfo; ai; ai = ai->ai_next) {
+        n++;
+    }
+    struct dialattempt *atts = malloc0(sizeof(struct dialattempt)*(size_t)n);
+    if (!atts) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(atts, 0, sizeof(struct dialattempt)*(size_t)n);
+    // Interleave the address families, starting with the family of the 
+    // first, and most preferred, address.
+    int i = 0;
+    int family = ainfo->ai_family;
+    struct addrinfo *same = ainfo;
+    struct addrinfo *other = ainfo;
+    while (i < n) {
+        while (same && same->ai_family != family) {
+            same = same->ai_next;
+        }
+        while (other && other->ai_family == family) {
+            other = other->ai_next;
+        }
+        if (same) {
+            atts[i++].ai = same;
+            same = same->ai_next;
+        }
+        if (other) {
+            atts[i++].ai = other;
+            other = other->ai_next;
+        }
+    }
+    struct coroutine *co = coself();
+    struct dialrace race = { .co = co, .deadline = deadline, .fd = -1 };
+    int ret = NECO_OK;
+    i = 0;
+    while (1) {
+        if (i < n) {
+            atts[i].race = &race;
+            void *argv[] = { &atts[i] };
+            if (start(dial_attempt, 1, 0, argv, 0, 0, 0, 0, 0) != NECO_OK) {
+                ret = NECO_NOMEM;
+                break;
+            }
+            atts[i].id = co->lastid;
+            race.nrunning++;
+            i++;
+        }
+        if (race.fd != -1 || (i == n && race.nrunning == 0)) {
+            break;
+        }
+        // Wait for an attempt to finish, or for the next attempt delay.
+        int64_t wait = deadline;
+        if (i < n) {
+            wait = i64_add_clamp(getnow(), NECO_DIALDELAY);
+            wait = wait < deadline ? wait : deadline;
+        }
+        race.waiting = true;
+        copause(wait);
+        race.waiting = false;
+        if (co->deadlined && wait < deadline) {
+            // Only the attempt delay was reached.
+            co->deadlined = false;
+        }
+        ret = checkdl(co, deadline);
+        if (ret != NECO_OK || race.fd != -1) {
+            break;
+        }
+    }
+    // Cancel the attempts that are still running and wait for them to exit,
+    // as they share the race state.
+    for (int j = 0; j < i; j++) {
+        struct coroutine *attco = atts[j].done ? NULL : cofind(atts[j].id);
+        if (attco) {
+            attco->canceled = true;
+            sco_resume(attco->id);
+        }
     }
-    int ret;
-    neco_cleanup_push(cleanup_close_socket, &fd);
-    ret = neco_connect_dl(fd, addr, addrlen, deadline);
-    if (ret == 0) {
-        ret = fd;
-        fd = -1;
+    while (race.nrunning > 0) {
+        coyield();
     }
-    neco_cleanup_pop(1);
-    return ret;
+    free0(atts);
+    if (race.fd != -1) {
+        return race.fd;
+    }
+    errno = ret == NECO_CANCELED ? ECANCELED :
+            ret == NECO_TIMEDOUT ? ETIMEDOUT : 
+            ret == NECO_NOMEM ? ENOMEM : 
+            race.err ? race.err : ECONNREFUSED;
+    return -1;
 }
 
-static void cleanup_addrinfo(void *arg) {
-    struct addrinfo *ainfo = arg;
-    freeaddrinfo(ainfo);
-}
+#ifdef NECO_TESTING
+// Addresses that are dialed in place of the resolved addresses.
+__thread struct addrinfo *neco_dial_addrinfo = NULL;
+#endif
 
-static int dial_tcp_dl(const char *addr, int tcp_vers, int64_t deadline) {
+static int dial_tcp_dl(const char *addr, int tcp_vers, int socktype,
+    int64_t deadline)
+{
     struct addrinfo *ainfo;
-    int ret = getaddrinfo_from_tcp_addr_dl(addr, tcp_vers, &ainfo, deadline);
+    int ret = getaddrinfo_from_tcp_addr_dl(addr, tcp_vers, socktype, &ainfo, 
+        deadline);
     if (ret != NECO_OK) {
         return ret;
     }
     int fd;
     neco_cleanup_push(cleanup_addrinfo, ainfo);
     struct addrinfo *ai = ainfo;
-    do {
-        fd = dial_connect_dl(ai->ai_family, ai->ai_socktype, ai->ai_protocol, 
-            ai->ai_addr, ai->ai_addrlen, deadline);
-        if (fd != -1) {
-            break;
-        }
-        ai = ai->ai_next;
-    } while (ai);
+#ifdef NECO_TESTING
+    if (neco_dial_addrinfo) {
+        ai = neco_dial_addrinfo;
+    }
+#endif
+    if (socktype == SOCK_STREAM && ai->ai_next) {
+        fd = dial_race_dl(ai, deadline);
+    } else {
+        do {
+            fd = dial_connect_dl(ai->ai_family, ai->ai_socktype, 
+                ai->ai_protocol, ai->ai_addr, ai->ai_addrlen, deadline);
+            if (fd != -1) {
+                break;
+            }
+            ai = ai->ai_next;
+        } while (ai);
+    }
     if (fd == -1) {
         fd = neco_errconv_from_sys();
     }
@@ -6903,7 +10932,7 @@ static int dial_tcp_dl(const char *addr, int tcp_vers, int64_t deadline) {
     return fd;
 }
 
-static int dial_unix_dl(const char *addr, int64_t deadline) {
+static int dial_unix_dl(const char *addr, int socktype, int64_t deadline) {
     (void)addr; (void)deadline;
 #ifdef _WIN32
     return NECO_PERM;
@@ -6914,7 +10943,7 @@ static int dial_unix_dl(const char *addr, int64_t deadline) {
         return NECO_INVAL;
     }
     strncpy(unaddr.sun_path, addr, sizeof(unaddr.sun_path) - 1);
-    int fd = dial_connect_dl(AF_UNIX, SOCK_STREAM, 0, (void*)&unaddr,
+    int fd = dial_connect_dl(AF_UNIX, socktype, 0, (void*)&unaddr,
         sizeof(struct sockaddr_un), deadline);
     if (fd == -1) {
         fd = neco_errconv_from_sys();
@@ -6929,13 +10958,21 @@ static int dial_dl(const char *network, const char *address, int64_t deadline) {
     } else if (!network || !address) {
         return NECO_INVAL;
     } else if (strcmp(network, "tcp") == 0) {
-        return dial_tcp_dl(address, 0, deadline);
+        return dial_tcp_dl(address, 0, SOCK_STREAM, deadline);
     } else if (strcmp(network, "tcp4") == 0) {
-        return dial_tcp_dl(address, AF_INET, deadline);
+        return dial_tcp_dl(address, AF_INET, SOCK_STREAM, deadline);
     } else if (strcmp(network, "tcp6") == 0) {
-        return dial_tcp_dl(address, AF_INET6, deadline);
+        return dial_tcp_dl(address, AF_INET6, SOCK_STREAM, deadline);
+    } else if (strcmp(network, "udp") == 0) {
+        return dial_tcp_dl(address, 0, SOCK_DGRAM, deadline);
+    } else if (strcmp(network, "udp4") == 0) {
+        return dial_tcp_dl(address, AF_INET, SOCK_DGRAM, deadline);
+    } else if (strcmp(network, "udp6") == 0) {
+        return dial_tcp_dl(address, AF_INET6, SOCK_DGRAM, deadline);
     } else if (strcmp(network, "unix") == 0) {
-        return dial_unix_dl(address, deadline);
+        return dial_unix_dl(address, SOCK_STREAM, deadline);
+    } else if (strcmp(network, "unixgram") == 0) {
+        return dial_unix_dl(address, SOCK_DGRAM, deadline);
     } else {
         return NECO_INVAL;
     }
@@ -6961,7 +10998,12 @@ int neco_dial_dl(const char *network, const char *address, int64_t deadline) {
 /// // stream using neco_stream_make(fd).
 /// close(fd);
 /// ```
-/// @param network must be "tcp", "tcp4", "tcp6", or "unix".
+/// For the "udp", "udp4", "udp6", and "unixgram" networks the returned socket
+/// is a connected datagram socket, so neco_read() and neco_write() exchange
+/// whole datagrams with the remote address.
+///
+/// @param network must be "tcp", "tcp4", "tcp6", "udp", "udp4", "udp6",
+/// "unix", or "unixgram".
 /// @param address the address to dial
 /// @return On success, file descriptor (non-blocking)
 /// @return On error, Neco error
@@ -6971,18 +11013,72 @@ int neco_dial(const char *network, const char *address) {
     return neco_dial_dl(network, address, INT64_MAX);
 }
 
-static int listen_tcp_dl(const char *addr, int tcp_vers, int64_t deadline) {
+static int serve_backlog(const struct neco_serve_opts *opts) {
+    return opts && opts->backlog > 0 ? opts->backlog : SOMAXCONN;
+}
+
+// Apply the socket options that must be set before bind.
+static bool serve_prebind(int fd, const struct neco_serve_opts *opts) {
+    if (!opts || !opts->reuseport) {
+        return true;
+    }
+#ifdef SO_REUSEPORT
+    return setsockopt0(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, 
+        sizeof(int)) != -1;
+#else
+    errno = ENOPROTOOPT;
+    return false;
+#endif
+}
+
+// Apply the TCP options for a listening socket. These are set before listen
+// so that no connection is queued without them. Accepted sockets inherit
+// TCP_NODELAY from the listener.
+static bool serve_prelisten(int fd, const struct neco_serve_opts *opts) {
+    (void)fd;
+    if (!opts) {
+        return true;
+    }
+    bool ok = true;
+#ifndef _WIN32
+    if (opts->nodelay) {
+        ok = ok && setsockopt0(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, 
+            sizeof(int)) != -1;
+    }
+#endif
+#ifdef TCP_FASTOPEN
+    if (opts->fastopen > 0) {
+        ok = ok && setsockopt0(fd, IPPROTO_TCP, TCP_FASTOPEN, &opts->fastopen,
+            sizeof(int)) != -1;
+    }
+#endif
+#ifdef TCP_DEFER_ACCEPT
+    if (opts->defer_accept > 0) {
+        ok = ok && setsockopt0(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, 
+            &opts->defer_accept, sizeof(int)) != -1;
+    }
+#endif
+    return ok;
+}
+
+static int listen_tcp_dl(const char *addr, int tcp_vers, int socktype,
+    const struct neco_serve_opts *opts, int64_t deadline)
+{
     struct addrinfo *ainfo;
-    int ret = getaddrinfo_from_tcp_addr_dl(addr, tcp_vers, &ainfo, deadline);
+    int ret = getaddrinfo_from_tcp_addr_dl(addr, tcp_vers, socktype, &ainfo, 
+        deadline);
     if (ret != NECO_OK) {
         return ret;
     }
     int fd = socket0(ainfo->ai_family, ainfo->ai_socktype, ainfo->ai_protocol);
     bool ok = fd != -1 && setsockopt0(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, 
         sizeof(int)) != -1;
+    ok = ok && serve_prebind(fd, opts);
     ok = ok && bind0(fd, ainfo->ai_addr, ainfo->ai_addrlen) != -1;
     freeaddrinfo(ainfo);
-    ok = ok && listen0(fd, SOMAXCONN) != -1;
+    // Datagram sockets are ready for neco_read() once bound.
+    ok = ok && (socktype == SOCK_DGRAM || (serve_prelisten(fd, opts) &&
+        listen0(fd, serve_backlog(opts)) != -1));
     ok = ok && neco_setnonblock(fd, true, 0) != -1;
     if (!ok) {
         if (fd != -1) {
@@ -6993,12 +11089,14 @@ static int listen_tcp_dl(const char *addr, int tcp_vers, int64_t deadline) {
     return fd;
 }
 
-static int listen_unix_dl(const char *addr, int64_t deadline) {
-    (void)addr; (void)deadline;
+static int listen_unix_dl(const char *addr, int socktype,
+    const struct neco_serve_opts *opts, int64_t deadline)
+{
+    (void)addr; (void)socktype; (void)opts; (void)deadline;
 #ifdef _WIN32
     return NECO_PERM;
 #else
-    int fd = socket0(AF_UNIX, SOCK_STREAM, 0);
+    int fd = socket0(AF_UNIX, socktype, 0);
     if (fd == -1) {
         return NECO_ERROR;
     }
@@ -7010,7 +11108,7 @@ static int listen_unix_dl(const char *addr, int64_t deadline) {
         close(fd);
         return NECO_ERROR;
     }
-    if (listen0(fd, SOMAXCONN) == -1) {
+    if (socktype != SOCK_DGRAM && listen0(fd, serve_backlog(opts)) == -1) {
         close(fd);
         return NECO_ERROR;
     }
@@ -7022,20 +11120,29 @@ static int listen_unix_dl(const char *addr, int64_t deadline) {
 #endif
 }
 
-static int serve_dl(const char *network, const char *address, int64_t deadline)
+static int serve_dl(const char *network, const char *address, 
+    const struct neco_serve_opts *opts, int64_t deadline)
 {
     if (!network || !address) {
         return NECO_INVAL;
     } else if (neco_getid() <= 0) {
         return NECO_PERM; 
     } else if (strcmp(network, "tcp") == 0) {
-        return listen_tcp_dl(address, 0, deadline);
+        return listen_tcp_dl(address, 0, SOCK_STREAM, opts, deadline);
     } else if (strcmp(network, "tcp4") == 0) {
-        return listen_tcp_dl(address, AF_INET, deadline);
+        return listen_tcp_dl(address, AF_INET, SOCK_STREAM, opts, deadline);
     } else if (strcmp(network, "tcp6") == 0) {
-        return listen_tcp_dl(address, AF_INET6, deadline);
+        return listen_tcp_dl(address, AF_INET6, SOCK_STREAM, opts, deadline);
+    } else if (strcmp(network, "udp") == 0) {
+        return listen_tcp_dl(address, 0, SOCK_DGRAM, opts, deadline);
+    } else if (strcmp(network, "udp4") == 0) {
+        return listen_tcp_dl(address, AF_INET, SOCK_DGRAM, opts, deadline);
+    } else if (strcmp(network, "udp6") == 0) {
+        return listen_tcp_dl(address, AF_INET6, SOCK_DGRAM, opts, deadline);
     } else if (strcmp(network, "unix") == 0) {
-        return listen_unix_dl(address, deadline);
+        return listen_unix_dl(address, SOCK_STREAM, opts, deadline);
+    } else if (strcmp(network, "unixgram") == 0) {
+        return listen_unix_dl(address, SOCK_DGRAM, opts, deadline);
     } else {
         return NECO_INVAL;
     }
@@ -7043,7 +11150,7 @@ static int serve_dl(const char *network, const char *address, int64_t deadline)
 
 /// Same as neco_serve() but with a deadline parameter. 
 int neco_serve_dl(const char *network, const char *address, int64_t deadline) {
-    int ret = serve_dl(network, address, deadline);
+    int ret = serve_dl(network, address, 0, deadline);
     async_error_guard(ret);
     return ret;
 }
@@ -7065,7 +11172,13 @@ int neco_serve_dl(const char *network, const char *address, int64_t deadline) {
 ///
 /// close(servefd);
 /// ```
-/// @param network must be "tcp", "tcp4", "tcp6", or "unix".
+/// For the "udp", "udp4", "udp6", and "unixgram" networks the returned socket
+/// is a bound datagram socket that is not listening. Use neco_recvmsg() and
+/// neco_sendmsg(), or recvfrom() and sendto() after neco_wait(), instead of
+/// neco_accept().
+///
+/// @param network must be "tcp", "tcp4", "tcp6", "udp", "udp4", "udp6",
+/// "unix", or "unixgram".
 /// @param address the address to serve on
 /// @return On success, file descriptor (non-blocking)
 /// @return On error, Neco error
@@ -7075,6 +11188,457 @@ int neco_serve(const char *network, const char *address) {
     return neco_serve_dl(network, address, INT64_MAX);
 }
 
+/// Same as neco_serve_with() but with a deadline parameter. 
+int neco_serve_with_dl(const char *network, const char *address, 
+    const neco_serve_opts *opts, int64_t deadline)
+{
+    int ret = serve_dl(network, address, opts, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Listen on a local network address using the provided options.
+///
+/// **Example**
+///
+/// ```c 
+/// neco_serve_opts opts = { .reuseport = true, .nodelay = true };
+/// int servefd = neco_serve_with("tcp", "0.0.0.0:8080", &opts);
+/// ```
+///
+/// A zero value for any option keeps the default of neco_serve(). The
+/// fastopen and defer_accept options are silently ignored on platforms that
+/// do not support them, while reuseport fails with ENOPROTOOPT. Only the
+/// backlog option applies to the "unix" network.
+///
+/// @param network must be "tcp", "tcp4", "tcp6", "udp", "udp4", "udp6",
+/// "unix", or "unixgram".
+/// @param address the address to serve on
+/// @param opts the listener options, or NULL for the defaults
+/// @return On success, file descriptor (non-blocking)
+/// @return On error, Neco error
+/// @see Networking
+/// @see neco_serve()
+int neco_serve_with(const char *network, const char *address, 
+    const neco_serve_opts *opts)
+{
+    return neco_serve_with_dl(network, address, opts, INT64_MAX);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// connpool - Per-runtime pool of outbound connections, keyed by the network
+// and address given to neco_pool_dial(). Connections that are put back are
+// kept idle, most recent first, and handed out again after a liveness check.
+// A single runtime timer closes connections that stay idle for too long.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NECO_POOLMAXIDLE
+#define NECO_POOLMAXIDLE 8
+#endif
+
+#ifndef NECO_POOLIDLETIMEOUT
+#define NECO_POOLIDLETIMEOUT (NECO_SECOND*90)
+#endif
+
+struct poolconn {
+    struct poolconn *prev;
+    struct poolconn *next;
+    int fd;
+    int64_t since;                 // when the connection became idle
+};
+
+struct poolhost {
+    struct poolhost *next;         // next host in the pool
+    struct poolconn *idle;         // idle connections, most recent first
+    struct poolconn *oldest;       // least recent idle connection
+    int nidle;                     // number of idle connections
+    int nactive;                   // number of checked out connections
+    struct colist waiters;         // coroutines waiting on max_active
+    const char *address;           // points into key
+    char key[];                    // network and address, nul separated
+};
+
+struct connpool {
+    struct poolhost *hosts;        // all dial targets
+    struct poolhost **fds;         // checked out connections, by fd
+    int nfds;                      // capacity of fds
+    int max_idle;
+    int max_active;
+    int64_t idle_timeout;
+    struct chantimer timer;        // closes expired idle connections
+};
+
+static void connpool_reap(struct chantimer *timer, int64_t now);
+
+static struct connpool *connpool_get(void) {
+    if (!rt->connpool) {
+        struct connpool *pool = malloc0(sizeof(struct connpool));
+        if (!pool) {
+            return NULL;
+        }
+        memset(pool, 0, sizeof(struct connpool));
+        pool->max_idle = NECO_POOLMAXIDLE;
+        pool->idle_timeout = NECO_POOLIDLETIMEOUT;
+        pool->timer.func = connpool_reap;
+        pool->timer.id = rt->timerid++;
+        rt->connpool = pool;
+    }
+    return rt->connpool;
+}
+
+static struct poolhost *poolhost_get(struct connpool *pool, 
+    const char *network, const char *address)
+{
+    struct poolhost *host = pool->hosts;
+    while (host) {
+        if (strcmp(host->key, network) == 0 && 
+            strcmp(host->address, address) == 0)
+        {
+            return host;
+        }
+        host = host->next;
+    }
+    size_t nnetwork = strlen(network);
+    size_t naddress = strlen(address);
+    host = malloc0(sizeof(struct poolhost)+nnetwork+naddress+2);
+    if (!host) {
+        return NULL;
+    }
+    memset(host, 0, sizeof(struct poolhost));
+    memcpy(host->key, network, nnetwork+1);
+    memcpy(host->key+nnetwork+1, address, naddress+1);
+    host->address = host->key+nnetwork+1;
+    colist_init(&host->waiters);
+    host->next = pool->hosts;
+    pool->hosts = host;
+    return host;
+}
+
+static void poolhost_remove(struct poolhost *host, struct poolconn *conn) {
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        host->idle = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    } else {
+        host->oldest = conn->prev;
+    }
+    host->nidle--;
+}
+
+// Wake the next coroutine waiting for a connection slot.
+static void poolhost_notify(struct poolhost *host) {
+    struct coroutine *co = colist_pop_front(&host->waiters);
+    if (co) {
+        sco_resume(co->id);
+    }
+}
+
+// Returns true if an idle connection is still usable. A connection that was
+// closed by the peer reads as EOF, and one with unexpected data pending is
+// out of sync with its protocol, so both are discarded.
+static bool poolconn_alive(int fd) {
+#ifdef _WIN32
+    (void)fd;
+    return true;
+#else
+    char ch;
+    ssize_t n = recv0(fd, &ch, 1, MSG_PEEK|MSG_DONTWAIT);
+    return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
+static void connpool_reap(struct chantimer *timer, int64_t now) {
+    (void)timer;
+    struct connpool *pool = rt->connpool;
+    int64_t next = INT64_MAX;
+    struct poolhost *host = pool->hosts;
+    while (host) {
+        struct poolconn *conn = host->oldest;
+        while (conn && i64_add_clamp(conn->since, pool->idle_timeout) <= now) {
+            struct poolconn *prev = conn->prev;
+            poolhost_remove(host, conn);
+            close(conn->fd);
+            free0(conn);
+            conn = prev;
+        }
+        if (conn) {
+            int64_t expires = i64_add_clamp(conn->since, pool->idle_timeout);
+            if (expires < next) {
+                next = expires;
+            }
+        }
+        host = host->next;
+    }
+    if (next < INT64_MAX) {
+        chantimer_arm(&pool->timer, next);
+    }
+}
+
+static void rt_freeconnpool(void) {
+    struct connpool *pool = rt->connpool;
+    if (!pool) {
+        return;
+    }
+    struct poolhost *host = pool->hosts;
+    while (host) {
+        struct poolhost *next = host->next;
+        while (host->idle) {
+            struct poolconn *conn = host->idle;
+            poolhost_remove(host, conn);
+            close(conn->fd);
+            free0(conn);
+        }
+        free0(host);
+        host = next;
+    }
+    free0(pool->fds);
+    free0(pool);
+    rt->connpool = NULL;
+}
+
+static bool connpool_track(struct connpool *pool, int fd, 
+    struct poolhost *host)
+{
+    if (fd >= pool->nfds) {
+        int nfds = pool->nfds == 0 ? 64 : pool->nfds;
+        while (nfds <= fd) {
+            nfds *= 2;
+        }
+        struct poolhost **fds = realloc0(pool->fds, 
+            sizeof(struct poolhost*)*(size_t)nfds);
+        if (!fds) {
+            return false;
+        }
+        memset(fds+pool->nfds, 0, 
+            sizeof(struct poolhost*)*(size_t)(nfds-pool->nfds));
+        pool->fds = fds;
+        pool->nfds = nfds;
+    }
+    pool->fds[fd] = host;
+    return true;
+}
+
+static int pool_setopts(const neco_pool_opts *opts) {
+    if (!rt) {
+        return NECO_PERM;
+    } else if (opts && (opts->max_idle < 0 || opts->max_active < 0 || 
+        opts->idle_timeout < 0))
+    {
+        return NECO_INVAL;
+    }
+    struct connpool *pool = connpool_get();
+    if (!pool) {
+        return NECO_NOMEM;
+    }
+    neco_pool_opts defopts = { 0 };
+    opts = opts ? opts : &defopts;
+    pool->max_idle = opts->max_idle > 0 ? opts->max_idle : NECO_POOLMAXIDLE;
+    pool->max_active = opts->max_active;
+    pool->idle_timeout = opts->idle_timeout > 0 ? opts->idle_timeout : 
+        NECO_POOLIDLETIMEOUT;
+    return NECO_OK;
+}
+
+/// Set the options for the runtime's connection pool.
+///
+/// A zero value for any option keeps its default. The pool belongs to the
+/// current runtime, so each thread running neco has its own pool.
+///
+/// @param opts the pool options, or NULL to restore the defaults
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @see Networking
+/// @see neco_pool_dial()
+int neco_pool_setopts(const neco_pool_opts *opts) {
+    int ret = pool_setopts(opts);
+    error_guard(ret);
+    return ret;
+}
+
+static int pool_dial_dl(const char *network, const char *address, 
+    int64_t deadline)
+{
+    struct coroutine *co = coself();
+    if (!co) {
+        return NECO_PERM;
+    } else if (!network || !address) {
+        return NECO_INVAL;
+    }
+    struct connpool *pool = connpool_get();
+    if (!pool) {
+        return NECO_NOMEM;
+    }
+    struct poolhost *host = poolhost_get(pool, network, address);
+    if (!host) {
+        return NECO_NOMEM;
+    }
+    while (1) {
+        int ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            if (pool->max_active == 0 || host->nactive < pool->max_active) {
+                // This coroutine may have been the one notified about the
+                // free slot. Pass it on to the next waiter.
+                poolhost_notify(host);
+            }
+            return ret;
+        }
+        if (pool->max_active == 0 || host->nactive < pool->max_active) {
+            break;
+        }
+        colist_push_back(&host->waiters, co);
+        copause(deadline);
+        remove_from_list(co);
+    }
+    // Reserve the slot, which may be held while dialing.
+    host->nactive++;
+    while (host->idle) {
+        struct poolconn *conn = host->idle;
+        int fd = conn->fd;
+        poolhost_remove(host, conn);
+        free0(conn);
+        if (poolconn_alive(fd)) {
+            // The fd was tracked when first dialed, so there's room.
+            pool->fds[fd] = host;
+            return fd;
+        }
+        close(fd);
+    }
+    int fd = dial_dl(network, address, deadline);
+    if (fd >= 0 && !connpool_track(pool, fd, host)) {
+        close(fd);
+        fd = NECO_NOMEM;
+    }
+    if (fd < 0) {
+        host->nactive--;
+        poolhost_notify(host);
+    }
+    return fd;
+}
+
+/// Same as neco_pool_dial() but with a deadline parameter. 
+int neco_pool_dial_dl(const char *network, const char *address, 
+    int64_t deadline)
+{
+    int ret = pool_dial_dl(network, address, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Connect to a remote server, reusing a pooled connection when possible.
+///
+/// Returns the most recently used idle connection for the network and 
+/// address, after checking that the peer has not closed it, or dials a new
+/// one using neco_dial(). When the max_active option is set, this waits for
+/// a connection to be put back or closed once that many connections to the
+/// address are checked out.
+///
+/// The connection must be returned with neco_pool_put() when the caller is
+/// done with it and the protocol is in a state that allows for reuse, or
+/// with neco_pool_close() otherwise. It must not be closed with close().
+///
+/// **Example**
+///
+/// ```c 
+/// int fd = neco_pool_dial("tcp", "10.0.0.2:6379");
+/// if (fd < 0) {
+///    // .. error, do something with it.
+/// }
+/// if (neco_write(fd, "PING\r\n", 6) != 6 || neco_read(fd, buf, 7) != 7) {
+///     neco_pool_close(fd);
+/// } else {
+///     neco_pool_put(fd);
+/// }
+/// ```
+/// @param network must be "tcp", "tcp4", "tcp6", "udp", "udp4", "udp6",
+/// "unix", or "unixgram".
+/// @param address the address to dial
+/// @return On success, file descriptor (non-blocking)
+/// @return On error, Neco error
+/// @see Networking
+/// @see neco_pool_setopts()
+int neco_pool_dial(const char *network, const char *address) {
+    return neco_pool_dial_dl(network, address, INT64_MAX);
+}
+
+static int pool_release(int fd, bool reuse) {
+    if (!rt) {
+        return NECO_PERM;
+    }
+    struct connpool *pool = rt->connpool;
+    if (!pool || fd < 0 || fd >= pool->nfds || !pool->fds[fd]) {
+        return NECO_INVAL;
+    }
+    struct poolhost *host = pool->fds[fd];
+    pool->fds[fd] = NULL;
+    host->nactive--;
+    struct poolconn *conn = NULL;
+    if (reuse && host->nidle < pool->max_idle) {
+        // When out of memory the connection is closed instead.
+        conn = malloc0(sizeof(struct poolconn));
+    }
+    if (conn) {
+        conn->fd = fd;
+        conn->since = getnow();
+        conn->prev = NULL;
+        conn->next = host->idle;
+        if (host->idle) {
+            host->idle->prev = conn;
+        } else {
+            host->oldest = conn;
+        }
+        host->idle = conn;
+        host->nidle++;
+        if (!pool->timer.armed) {
+            chantimer_arm(&pool->timer, 
+                i64_add_clamp(conn->since, pool->idle_timeout));
+        }
+    } else {
+        close(fd);
+    }
+    poolhost_notify(host);
+    return NECO_OK;
+}
+
+/// Return a connection from neco_pool_dial() to the pool for reuse.
+///
+/// The connection is kept idle until it's handed out again, or until it has
+/// been idle longer than the idle_timeout option. It's closed right away if
+/// the address already has max_idle idle connections.
+///
+/// @param fd a connection returned by neco_pool_dial()
+/// @return NECO_OK Success
+/// @return NECO_INVAL The fd is not a checked out pool connection
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Networking
+/// @see neco_pool_dial()
+int neco_pool_put(int fd) {
+    int ret = pool_release(fd, true);
+    error_guard(ret);
+    return ret;
+}
+
+/// Close a connection from neco_pool_dial() without returning it to the pool.
+///
+/// Use this when the connection had an error or its protocol state does not
+/// allow for reuse.
+///
+/// @param fd a connection returned by neco_pool_dial()
+/// @return NECO_OK Success
+/// @return NECO_INVAL The fd is not a checked out pool connection
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Networking
+/// @see neco_pool_dial()
+int neco_pool_close(int fd) {
+    int ret = pool_release(fd, false);
+    error_guard(ret);
+    return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // sync 
 ////////////////////////////////////////////////////////////////////////////////
@@ -7084,6 +11648,7 @@ struct neco_mutex {
     struct colist queue; // coroutine doubly linked list
     int  rlocked;        // read lock counter
     bool locked;         // mutex is locked (read or write)
+    uint8_t mode;        // NECO_MUTEX_NOYIELD and NECO_MUTEX_BARGING flags
 };
 
 static_assert(sizeof(neco_mutex) >= sizeof(struct neco_mutex), "");
@@ -7098,6 +11663,7 @@ static int mutex_init(neco_mutex *mutex) {
     }
     memset(mu, 0, sizeof(struct neco_mutex));
     mu->rtid = rt->id;
+    mu->mode = env_mutexmode;
     colist_init(&mu->queue);
     return NECO_OK;
 }
@@ -7181,18 +11747,49 @@ int neco_mutex_tryrdlock(neco_mutex *mutex) {
     return ret;
 }
 
+static void mutex_wake(struct neco_mutex *mu);
+
 noinline
 static int finish_lock(struct coroutine *co, struct neco_mutex *mu, 
     bool rlocked, int64_t deadline)
 {
-    co->rlocked = rlocked;
-    colist_push_back(&mu->queue, co);
-    rt->nlocked++;
-    copause(deadline);
-    rt->nlocked--;
-    remove_from_list(co);
-    co->rlocked = false;
-    return checkdl(co, INT64_MAX);
+    bool front = false;
+    while (1) {
+        co->rlocked = rlocked;
+        co->granted = false;
+        if (front) {
+            // Woken but beaten to the lock. Keep our place in line.
+            colist_push_front(&mu->queue, co);
+        } else {
+            colist_push_back(&mu->queue, co);
+        }
+        rt->nlocked++;
+        copause(deadline);
+        rt->nlocked--;
+        remove_from_list(co);
+        co->rlocked = false;
+        int ret = checkdl(co, INT64_MAX);
+        if (!co->granted) {
+            // Handoff mode. The lock is already ours.
+            return ret;
+        }
+        // Barging mode. The unlocker only woke us up, so we must contend for
+        // the lock with any other coroutine.
+        co->granted = false;
+        if (ret != NECO_OK) {
+            // Pass the wake up on to the next in line.
+            mutex_wake(mu);
+            return ret;
+        }
+        if (!mu->locked || (rlocked && mu->rlocked > 0)) {
+            if (rlocked) {
+                mu->rlocked++;
+            }
+            mu->locked = true;
+            return NECO_OK;
+        }
+        front = true;
+    }
 }
 
 static int mutex_lock_dl(struct coroutine *co, struct neco_mutex *mu,
@@ -7206,40 +11803,76 @@ static int mutex_lock_dl(struct coroutine *co, struct neco_mutex *mu,
     return ret;
 }
 
-int neco_mutex_lock_dl(neco_mutex *mutex, int64_t deadline) {
+static int mutex_lock_at(neco_mutex *mutex, int64_t deadline,
+    const void *callsite)
+{
     struct coroutine *co = coself();
     struct neco_mutex *mu = (void*)mutex;
     int ret = check_mutex(co, mu);
     if (ret != NECO_OK) {
         return ret;
     }
+    struct ctop op = ctstart(callsite);
     ret = mutex_lock_dl(co, mu, deadline);
+    ctrecord(NECO_CONTENTION_MUTEX, mutex, op);
     async_error_guard(ret);
     return ret;
 }
 
+int neco_mutex_lock_dl(neco_mutex *mutex, int64_t deadline) {
+    return mutex_lock_at(mutex, deadline, CALLSITE);
+}
+
 int neco_mutex_lock(neco_mutex *mutex) {
-    return neco_mutex_lock_dl(mutex, INT64_MAX);
+    return mutex_lock_at(mutex, INT64_MAX, CALLSITE);
 }
 
-int neco_mutex_rdlock_dl(neco_mutex *mutex, int64_t deadline) {
+static int mutex_rdlock_at(neco_mutex *mutex, int64_t deadline,
+    const void *callsite)
+{
     struct coroutine *co = coself();
     struct neco_mutex *mu = (void*)mutex;
     int ret = check_mutex(co, mu);
     if (ret != NECO_OK) {
         return ret;
     }
+    struct ctop op = ctstart(callsite);
     ret = mutex_tryrdlock(co, mu, false, deadline);
     if (ret == NECO_BUSY) {
         // Another coroutine is holding this lock.
         ret = finish_lock(co, mu, true, deadline);
     }
+    ctrecord(NECO_CONTENTION_MUTEX, mutex, op);
     async_error_guard(ret);
     return ret;
 }
 
+int neco_mutex_rdlock_dl(neco_mutex *mutex, int64_t deadline) {
+    return mutex_rdlock_at(mutex, deadline, CALLSITE);
+}
+
 int neco_mutex_rdlock(neco_mutex *mutex) {
-    return neco_mutex_rdlock_dl(mutex, INT64_MAX);
+    return mutex_rdlock_at(mutex, INT64_MAX, CALLSITE);
+}
+
+// Wake the next waiter in the queue, plus any readers that directly follow,
+// without handing off the lock. Used in barging mode.
+static void mutex_wake(struct neco_mutex *mu) {
+    if (mu->locked && mu->rlocked == 0) {
+        // A writer already holds the lock. It will wake the next waiter.
+        return;
+    }
+    struct coroutine *co = colist_pop_front(&mu->queue);
+    while (co) {
+        co->granted = true;
+        sched_resume(co);
+        if (!co->rlocked || colist_is_empty(&mu->queue) || 
+            !mu->queue.head.next->rlocked)
+        {
+            break;
+        }
+        co = colist_pop_front(&mu->queue);
+    }
 }
 
 static void mutex_fastunlock(struct neco_mutex *mu) {
@@ -7259,6 +11892,13 @@ static void mutex_fastunlock(struct neco_mutex *mu) {
         mu->locked = false;
         return;
     }
+    if (mu->mode & NECO_MUTEX_BARGING) {
+        // Release the lock and let the next in line contend for it.
+        mu->locked = false;
+        mutex_wake(mu);
+        yield_for_sched_resume();
+        return;
+    }
     // Choose next coroutine to take the lock.
     while (1) {
         struct coroutine *co = colist_pop_front(&mu->queue);
@@ -7286,7 +11926,9 @@ static int mutex_unlock(neco_mutex *mutex) {
         return ret;
     }
     mutex_fastunlock(mu);
-    coyield();
+    if (!(mu->mode & NECO_MUTEX_NOYIELD)) {
+        coyield();
+    }
     return NECO_OK;
 }
 
@@ -7317,6 +11959,46 @@ int neco_mutex_fastlock(neco_mutex *mutex, int64_t deadline) {
 }
 #endif
 
+static int mutex_setmode(neco_mutex *mutex, int mode) {
+    struct coroutine *co = coself();
+    struct neco_mutex *mu = (void*)mutex;
+    int ret = check_mutex(co, mu);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (mode & ~(NECO_MUTEX_NOYIELD|NECO_MUTEX_BARGING)) {
+        return NECO_INVAL;
+    }
+    mu->mode = mode;
+    return NECO_OK;
+}
+
+/// Set the mode of a mutex.
+///
+/// The mode is zero or more of the following flags:
+///
+/// - NECO_MUTEX_NOYIELD: Unlocking does not yield to other coroutines when
+///   there are no waiters. This avoids a context switch on every unlock when
+///   guarding small critical sections. With waiters, the unlock still yields
+///   so that they get to run.
+/// - NECO_MUTEX_BARGING: Unlocking releases the lock and wakes the next
+///   waiter, rather than handing the lock directly to it. A running coroutine
+///   may take the lock before the woken waiter gets a chance to. This
+///   improves throughput at the cost of fairness.
+///
+/// The default, NECO_MUTEX_DEFAULT, yields on unlock and directly hands the
+/// lock off to the next waiter.
+/// @param mutex The mutex
+/// @param mode The mutex mode
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see neco_env_setmutexmode()
+int neco_mutex_setmode(neco_mutex *mutex, int mode) {
+    int ret = mutex_setmode(mutex, mode);
+    error_guard(ret);
+    return ret;
+}
+
 static int mutex_destroy(neco_mutex *mutex) {
     struct coroutine *co = coself();
     struct neco_mutex *mu = (void*)mutex;
@@ -7460,14 +12142,22 @@ static int waitgroup_wait_dl(neco_waitgroup *waitgroup, int64_t deadline) {
     return checkdl(co, INT64_MAX);
 }
 
-int neco_waitgroup_wait_dl(neco_waitgroup *waitgroup, int64_t deadline) {
+static int waitgroup_wait_at(neco_waitgroup *waitgroup, int64_t deadline,
+    const void *callsite)
+{
+    struct ctop op = ctstart(callsite);
     int ret = waitgroup_wait_dl(waitgroup, deadline);
+    ctrecord(NECO_CONTENTION_WAITGROUP, waitgroup, op);
     async_error_guard(ret);
     return ret;
 }
 
+int neco_waitgroup_wait_dl(neco_waitgroup *waitgroup, int64_t deadline) {
+    return waitgroup_wait_at(waitgroup, deadline, CALLSITE);
+}
+
 int neco_waitgroup_wait(neco_waitgroup *waitgroup) {
-    return neco_waitgroup_wait_dl(waitgroup, INT64_MAX);
+    return waitgroup_wait_at(waitgroup, INT64_MAX, CALLSITE);
 }
 
 static int waitgroup_destroy(neco_waitgroup *waitgroup) {
@@ -7587,6 +12277,22 @@ int neco_cond_broadcast(neco_cond *cond) {
     return ret;
 }
 
+// Relock the mutex at the end of a condition wait. The mutex must be held on
+// return, so the coroutine's context is ignored and cancelers are held back,
+// the same as with a disabled cancel state, until the lock is taken.
+static void cond_relock(struct coroutine *co, struct neco_mutex *mu) {
+    struct neco_context *ctx = co->ctx;
+    int state = co->cancelstate;
+    co->ctx = NULL;
+    co->cancelstate = NECO_CANCEL_DISABLE;
+    while (mutex_lock_dl(co, mu, INT64_MAX) != NECO_OK) { }
+    co->ctx = ctx;
+    co->cancelstate = state;
+    if (state == NECO_CANCEL_ENABLE) {
+        cancel_enabled(co);
+    }
+}
+
 static int cond_wait_dl(neco_cond *cond, neco_mutex *mutex, int64_t deadline) {
     struct neco_cond *cvar = (struct neco_cond*)cond;
     int ret = check_cond(cvar);
@@ -7599,32 +12305,381 @@ static int cond_wait_dl(neco_cond *cond, neco_mutex *mutex, int64_t deadline) {
     if (ret != NECO_OK) {
         return ret;
     }
-    if (co->canceled) {
+    if (co->canceled) {
+        co->canceled = false;
+        return NECO_CANCELED;
+    }
+    mutex_fastunlock(mu);
+    // The coroutine was added to the deadliner queue. We can safely
+    // yield and wait to be woken at some point in the future.
+    colist_push_back(&cvar->queue, co);
+    rt->ncondwaiters++;
+    copause(deadline);
+    rt->ncondwaiters--;
+    remove_from_list(co);
+    ret = checkdl(co, INT64_MAX);
+    // Must relock.
+    cond_relock(co, mu);
+    return ret;
+}
+
+static int cond_wait_at(neco_cond *cond, neco_mutex *mutex, int64_t deadline,
+    const void *callsite)
+{
+    struct ctop op = ctstart(callsite);
+    int ret = cond_wait_dl(cond, mutex, deadline);
+    ctrecord(NECO_CONTENTION_COND, cond, op);
+    async_error_guard(ret);
+    return ret;
+}
+
+int neco_cond_wait_dl(neco_cond *cond, neco_mutex *mutex, int64_t deadline) {
+    return cond_wait_at(cond, mutex, deadline, CALLSITE);
+}
+
+int neco_cond_wait(neco_cond *cond, neco_mutex *mutex) {
+    return cond_wait_at(cond, mutex, INT64_MAX, CALLSITE);
+}
+
+struct neco_sema {
+    int64_t rtid;        // runtime id
+    struct colist queue; // coroutine doubly linked list
+    int64_t size;        // maximum combined weight
+    int64_t cur;         // current acquired weight
+};
+
+static_assert(sizeof(neco_sema) >= sizeof(struct neco_sema), "");
+static_assert(_Alignof(neco_sema) == _Alignof(struct neco_sema), "");
+
+static int sema_init(neco_sema *sema, int64_t size) {
+    struct neco_sema *sm = (void*)sema;
+    if (!sm || size <= 0) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    memset(sm, 0, sizeof(struct neco_sema));
+    sm->rtid = rt->id;
+    sm->size = size;
+    colist_init(&sm->queue);
+    return NECO_OK;
+}
+
+/// Initialize a weighted semaphore.
+/// @param sema The semaphore
+/// @param size The maximum combined weight that can be held at once
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_sema_init(neco_sema *sema, int64_t size) {
+    int ret = sema_init(sema, size);
+    error_guard(ret);
+    return ret;
+}
+
+inline
+static int check_sema(struct neco_sema *sm, int64_t weight) {
+    if (!sm) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    } else if (sm->rtid == 0) {
+        // Semaphores must be initialized with a size.
+        return NECO_INVAL;
+    } else if (rt->id != sm->rtid) {
+        return NECO_PERM;
+    } else if (weight <= 0 || weight > sm->size) {
+        return NECO_INVAL;
+    }
+    return NECO_OK;
+}
+
+// Hand off the available weight to the waiters at the front of the queue.
+// Waiters are strictly served in order, so a large waiter at the front will
+// block smaller ones behind it. This avoids starving large acquires.
+static void sema_notify(struct neco_sema *sm) {
+    bool resumed = false;
+    while (!colist_is_empty(&sm->queue)) {
+        struct coroutine *co = sm->queue.head.next;
+        if (co->sweight > sm->size - sm->cur) {
+            break;
+        }
+        colist_pop_front(&sm->queue);
+        sm->cur += co->sweight;
+        co->granted = true;
+        sched_resume(co);
+        resumed = true;
+    }
+    if (resumed) {
+        yield_for_sched_resume();
+    }
+}
+
+static int sema_acquire_dl(neco_sema *sema, int64_t weight, bool tryonly,
+    int64_t deadline)
+{
+    struct neco_sema *sm = (void*)sema;
+    int ret = check_sema(sm, weight);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct coroutine *co = coself();
+    if (!co) {
+        return NECO_PERM;
+    }
+    if (!tryonly) {
+        ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            return ret;
+        }
+    }
+    if (colist_is_empty(&sm->queue) && weight <= sm->size - sm->cur) {
+        sm->cur += weight;
+        return NECO_OK;
+    }
+    if (tryonly) {
+        return NECO_BUSY;
+    }
+    co->sweight = weight;
+    co->granted = false;
+    colist_push_back(&sm->queue, co);
+    rt->nlocked++;
+    copause(deadline);
+    rt->nlocked--;
+    remove_from_list(co);
+    if (co->granted) {
+        // The weight was handed off by a releaser. Any deadline that fired
+        // afterwards is ignored.
+        co->granted = false;
+        co->deadlined = false;
+        return NECO_OK;
+    }
+    // Leaving the queue may allow for the waiters behind to proceed.
+    sema_notify(sm);
+    return checkdl(co, INT64_MAX);
+}
+
+static int sema_acquire_at(neco_sema *sema, int64_t weight, int64_t deadline,
+    const void *callsite)
+{
+    struct ctop op = ctstart(callsite);
+    int ret = sema_acquire_dl(sema, weight, false, deadline);
+    ctrecord(NECO_CONTENTION_SEMA, sema, op);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Same as neco_sema_acquire() but with a deadline parameter.
+int neco_sema_acquire_dl(neco_sema *sema, int64_t weight, int64_t deadline) {
+    return sema_acquire_at(sema, weight, deadline, CALLSITE);
+}
+
+/// Acquire the semaphore with a weight, blocking until the weight is
+/// available. Waiters are served in first-in, first-out order.
+/// @param sema The semaphore
+/// @param weight The weight to acquire, which must be in the range of 1 to
+/// the size of the semaphore.
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_CANCELED Operation canceled
+/// @see neco_sema_acquire_dl()
+int neco_sema_acquire(neco_sema *sema, int64_t weight) {
+    return sema_acquire_at(sema, weight, INT64_MAX, CALLSITE);
+}
+
+/// Same as neco_sema_acquire() but returns NECO_BUSY instead of blocking.
+int neco_sema_tryacquire(neco_sema *sema, int64_t weight) {
+    int ret = sema_acquire_dl(sema, weight, true, 0);
+    async_error_guard(ret);
+    return ret;
+}
+
+static int sema_release(neco_sema *sema, int64_t weight) {
+    struct neco_sema *sm = (void*)sema;
+    int ret = check_sema(sm, weight);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (weight > sm->cur) {
+        // Releasing more than what is held.
+        return NECO_INVAL;
+    }
+    sm->cur -= weight;
+    sema_notify(sm);
+    return NECO_OK;
+}
+
+/// Release a weight that was previously acquired.
+/// @param sema The semaphore
+/// @param weight The weight to release
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided or the weight is
+/// larger than what is currently held.
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_sema_release(neco_sema *sema, int64_t weight) {
+    int ret = sema_release(sema, weight);
+    error_guard(ret);
+    return ret;
+}
+
+static int sema_destroy(neco_sema *sema) {
+    struct neco_sema *sm = (void*)sema;
+    int ret = check_sema(sm, 1);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (sm->cur > 0 || !colist_is_empty(&sm->queue)) {
+        return NECO_BUSY;
+    }
+    memset(sm, 0, sizeof(struct neco_sema));
+    return NECO_OK;
+}
+
+int neco_sema_destroy(neco_sema *sema) {
+    int ret = sema_destroy(sema);
+    error_guard(ret);
+    return ret;
+}
+
+// A token-bucket rate limiter that uses the generic cell rate algorithm.
+// Rather than storing a token count, it stores the theoretical arrival time
+// of the next token. A waiting coroutine simply sleeps on the deadline queue
+// until its reserved token arrives.
+struct neco_ratelimiter {
+    int64_t rtid;        // runtime id
+    int64_t interval;    // nanoseconds between each token
+    int64_t burst;       // maximum number of tokens available at once
+    int64_t tat;         // theoretical arrival time of the next token
+};
+
+static_assert(sizeof(neco_ratelimiter) >= sizeof(struct neco_ratelimiter), 
+    "");
+static_assert(_Alignof(neco_ratelimiter) == 
+    _Alignof(struct neco_ratelimiter), "");
+
+static int ratelimiter_init(neco_ratelimiter *limiter, int64_t rate,
+    int64_t burst)
+{
+    struct neco_ratelimiter *rl = (void*)limiter;
+    if (!rl || rate <= 0 || rate > NECO_SECOND || burst <= 0 || 
+        burst > INT32_MAX)
+    {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    memset(rl, 0, sizeof(struct neco_ratelimiter));
+    rl->rtid = rt->id;
+    rl->interval = NECO_SECOND / rate;
+    rl->burst = burst;
+    return NECO_OK;
+}
+
+/// Initialize a rate limiter.
+/// @param limiter The rate limiter
+/// @param rate The number of tokens that are added per second
+/// @param burst The maximum number of tokens that can be taken at once
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_ratelimiter_init(neco_ratelimiter *limiter, int64_t rate,
+    int64_t burst)
+{
+    int ret = ratelimiter_init(limiter, rate, burst);
+    error_guard(ret);
+    return ret;
+}
+
+inline
+static int check_ratelimiter(struct neco_ratelimiter *rl) {
+    if (!rl) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    } else if (rl->rtid == 0) {
+        // Rate limiters must be initialized with a rate.
+        return NECO_INVAL;
+    } else if (rt->id != rl->rtid) {
+        return NECO_PERM;
+    }
+    return NECO_OK;
+}
+
+static int ratelimiter_acquire_dl(neco_ratelimiter *limiter, bool tryonly,
+    int64_t deadline)
+{
+    struct neco_ratelimiter *rl = (void*)limiter;
+    int ret = check_ratelimiter(rl);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct coroutine *co = coself();
+    if (!co) {
+        return NECO_PERM;
+    }
+    if (!tryonly) {
+        ret = checkdl(co, deadline);
+        if (ret != NECO_OK) {
+            return ret;
+        }
+    }
+    int64_t now = getnow();
+    int64_t tat = i64_add_clamp(rl->tat > now ? rl->tat : now, rl->interval);
+    int64_t when = tat - rl->interval * rl->burst;
+    if (when <= now) {
+        // Token is available now.
+        rl->tat = tat;
+        return NECO_OK;
+    }
+    if (tryonly) {
+        return NECO_BUSY;
+    } else if (when > codeadline(co, deadline)) {
+        // The token will not arrive in time. Do not bother waiting.
+        return NECO_TIMEDOUT;
+    }
+    // Reserve the token and sleep until it arrives.
+    rl->tat = tat;
+    rt->nsleepers++;
+    copause(when);
+    rt->nsleepers--;
+    co->deadlined = false;
+    if (co->canceled || ctxcanceled(co)) {
+        // Give back the reserved token, unless a later waiter has already
+        // reserved the one after it.
         co->canceled = false;
+        if (rl->tat == tat) {
+            rl->tat -= rl->interval;
+        }
         return NECO_CANCELED;
     }
-    mutex_fastunlock(mu);
-    // The coroutine was added to the deadliner queue. We can safely
-    // yield and wait to be woken at some point in the future.
-    colist_push_back(&cvar->queue, co);
-    rt->ncondwaiters++;
-    copause(deadline);
-    rt->ncondwaiters--;
-    remove_from_list(co);
-    ret = checkdl(co, INT64_MAX);
-    // Must relock.
-    while (mutex_fastlock(co, mu, INT64_MAX) != NECO_OK) { }
-    return ret;
+    return NECO_OK;
 }
 
-int neco_cond_wait_dl(neco_cond *cond, neco_mutex *mutex, int64_t deadline) {
-    int ret = cond_wait_dl(cond, mutex, deadline);
+/// Same as neco_ratelimiter_acquire() but with a deadline parameter.
+/// Returns NECO_TIMEDOUT right away, without waiting, when the next token
+/// will not be available before the deadline.
+int neco_ratelimiter_acquire_dl(neco_ratelimiter *limiter, int64_t deadline) {
+    int ret = ratelimiter_acquire_dl(limiter, false, deadline);
     async_error_guard(ret);
     return ret;
 }
 
-int neco_cond_wait(neco_cond *cond, neco_mutex *mutex) {
-    return neco_cond_wait_dl(cond, mutex, INT64_MAX);
+/// Take a token from the rate limiter, blocking until one is available.
+/// @param limiter The rate limiter
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_CANCELED Operation canceled
+/// @see neco_ratelimiter_acquire_dl()
+int neco_ratelimiter_acquire(neco_ratelimiter *limiter) {
+    return neco_ratelimiter_acquire_dl(limiter, INT64_MAX);
+}
+
+/// Same as neco_ratelimiter_acquire() but returns NECO_BUSY instead of
+/// blocking.
+int neco_ratelimiter_tryacquire(neco_ratelimiter *limiter) {
+    int ret = ratelimiter_acquire_dl(limiter, true, 0);
+    async_error_guard(ret);
+    return ret;
 }
 
 // Returns a string that indicates which coroutine method is being used by
@@ -7666,6 +12721,9 @@ static int setcancelstate(int state, int *oldstate) {
         *oldstate = co->cancelstate;
     }
     co->cancelstate = state;
+    if (state == NECO_CANCEL_ENABLE) {
+        cancel_enabled(co);
+    }
     return NECO_OK;
 }
 
@@ -7711,6 +12769,9 @@ void __neco_c1(int execute) {
 // The async flag indicates that the coroutine is being exited before the entry
 // function has been completed. In this case the cleanup push/pop stack stack
 // will immediately be unrolled and the coroutine will cease execution.
+static bool group_leave(struct coroutine *co);
+static void ctx_detach(struct coroutine *co);
+
 noinline
 static void coexit(bool async) {
     // The current coroutine _must_ exit.
@@ -7723,6 +12784,11 @@ static void coexit(bool async) {
         }
     }
 
+    // Run the coroutine-local storage destructors
+    if (co->nslots > 0) {
+        coslots_destroy(co);
+    }
+
     // Delete from map 
     comap_delete(&rt->all, co);
 
@@ -7743,6 +12809,16 @@ static void coexit(bool async) {
         cowaiter = colist_pop_front(&co->joinlist);
     }
 
+    // Detach from the context (if any)
+    if (co->ctx) {
+        ctx_detach(co);
+    }
+
+    // Notify the group (if any)
+    if (co->group && group_leave(co)) {
+        sched = true;
+    }
+
     // Close the generator
     if (co->gen) {
         chan_close((void*)co->gen);
@@ -7753,6 +12829,11 @@ static void coexit(bool async) {
     // Free the call arguments
     cofreeargs(co);
 
+    // Release the arena memory (if any)
+    if (co->arena) {
+        arena_free(co, false);
+    }
+
     if (sched) { 
         yield_for_sched_resume();
     }
@@ -7906,6 +12987,434 @@ int neco_join(int64_t id) {
     return neco_join_dl(id, INT64_MAX);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// groups
+////////////////////////////////////////////////////////////////////////////////
+
+struct neco_group {
+    int64_t rtid;             // runtime id
+    struct coroutine *head;   // member list (gprev, gnext)
+    struct coroutine *tail;
+    size_t nmembers;          // number of running members
+    int64_t *exited;          // ids of exited members, not yet joined
+    size_t nexited;
+    size_t exitedhead;        // position of first id in 'exited'
+    size_t exitedcap;
+    struct colist waiters;    // coroutines waiting for members to exit
+    int64_t cancelgen;        // cancel generation, see group_cancelall
+    int err;                  // first error from neco_group_seterr
+};
+
+static void group_join(struct neco_group *group, struct coroutine *co) {
+    co->group = group;
+    co->gnext = NULL;
+    co->gprev = group->tail;
+    if (group->tail) {
+        group->tail->gnext = co;
+    } else {
+        group->head = co;
+    }
+    group->tail = co;
+    group->nmembers++;
+}
+
+static void group_unlink(struct neco_group *group, struct coroutine *co) {
+    if (co->gprev) {
+        co->gprev->gnext = co->gnext;
+    } else {
+        group->head = co->gnext;
+    }
+    if (co->gnext) {
+        co->gnext->gprev = co->gprev;
+    } else {
+        group->tail = co->gprev;
+    }
+    co->gprev = NULL;
+    co->gnext = NULL;
+    co->group = NULL;
+    co->gcancelpending = false;
+    group->nmembers--;
+}
+
+// group_leave is called by coexit. There's always room in 'exited' because 
+// the space was reserved by group_start. Returns true if any waiters were
+// scheduled to resume.
+static bool group_leave(struct coroutine *co) {
+    struct neco_group *group = co->group;
+    group_unlink(group, co);
+    size_t pos = group->exitedhead + group->nexited;
+    group->exited[pos] = co->id;
+    group->nexited++;
+    bool sched = false;
+    struct coroutine *waiter = colist_pop_front(&group->waiters);
+    while (waiter) {
+        sched_resume(waiter);
+        sched = true;
+        waiter = colist_pop_front(&group->waiters);
+    }
+    return sched;
+}
+
+static int check_group(struct neco_group *group) {
+    if (!group) {
+        return NECO_INVAL;
+    } else if (!rt || group->rtid != rt->id) {
+        return NECO_PERM;
+    }
+    return NECO_OK;
+}
+
+static int group_make(neco_group **group) {
+    if (!group) {
+        return NECO_INVAL;
+    } else if (!rt) {
+        return NECO_PERM;
+    }
+    struct neco_group *g = malloc0(sizeof(struct neco_group));
+    if (!g) {
+        return NECO_NOMEM;
+    }
+    memset(g, 0, sizeof(struct neco_group));
+    g->rtid = rt->id;
+    colist_init(&g->waiters);
+    *group = g;
+    return NECO_OK;
+}
+
+/// Create a new coroutine group.
+///
+/// A group tracks the coroutines that are started into it using
+/// neco_group_start(), allowing for them to be joined or canceled together.
+///
+/// **Example**
+///
+/// ```
+/// neco_group *group;
+/// neco_group_make(&group);
+/// for (int i = 0; i < 50; i++) {
+///     neco_group_start(group, fetch_backend, 1, &backends[i]);
+/// }
+/// // Wait for enough answers, then cancel the stragglers.
+/// for (int i = 0; i < 3; i++) {
+///     neco_group_joinany(group, 0);
+/// }
+/// neco_group_cancel(group);
+/// neco_group_release(group);
+/// ```
+///
+/// @param group The new group
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see Groups
+int neco_group_make(neco_group **group) {
+    int ret = group_make(group);
+    error_guard(ret);
+    return ret;
+}
+
+static int group_release(neco_group *group) {
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (!colist_is_empty(&group->waiters)) {
+        return NECO_BUSY;
+    }
+    // Running members are detached and continue to run.
+    while (group->head) {
+        group_unlink(group, group->head);
+    }
+    free0(group->exited);
+    free0(group);
+    return NECO_OK;
+}
+
+/// Release a group.
+///
+/// Members that are still running are detached from the group and continue
+/// to run. Use neco_group_cancel() first to stop them.
+/// @param group The group
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_BUSY Another coroutine is waiting on the group
+int neco_group_release(neco_group *group) {
+    int ret = group_release(group);
+    error_guard(ret);
+    return ret;
+}
+
+// Make room in 'exited' for every running member plus one more.
+static bool group_reserve(struct neco_group *group) {
+    size_t need = group->nexited + group->nmembers + 1;
+    if (group->exitedhead > 0) {
+        memmove(group->exited, group->exited+group->exitedhead, 
+            group->nexited*sizeof(int64_t));
+        group->exitedhead = 0;
+    }
+    if (need <= group->exitedcap) {
+        return true;
+    }
+    size_t cap = group->exitedcap == 0 ? 8 : group->exitedcap * 2;
+    while (cap < need) {
+        cap *= 2;
+    }
+    int64_t *exited = realloc0(group->exited, cap*sizeof(int64_t));
+    if (!exited) {
+        return false;
+    }
+    group->exited = exited;
+    group->exitedcap = cap;
+    return true;
+}
+
+static int group_startv(neco_group *group, 
+    void(*coroutine)(int argc, void *argv[]), int argc, va_list *args, 
+    void *argv[])
+{
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (!coroutine || argc < 0) {
+        return NECO_INVAL;
+    } else if (!group_reserve(group)) {
+        return NECO_NOMEM;
+    }
+    return start(coroutine, argc, args, argv, 0, 0, group, 0, 0);
+}
+
+/// Starts a new coroutine as a member of a group.
+/// @param group The group
+/// @param coroutine The coroutine that will soon run
+/// @param argc Number of arguments
+/// @param ... Arguments passed to the coroutine
+/// @return NECO_OK Success
+/// @return NECO_NOMEM The system lacked the necessary resources
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @see neco_start()
+int neco_group_start(neco_group *group, 
+    void(*coroutine)(int argc, void *argv[]), int argc, ...)
+{
+    va_list args;
+    va_start(args, argc);
+    int ret = group_startv(group, coroutine, argc, &args, 0);
+    va_end(args);
+    error_guard(ret);
+    return ret;
+}
+
+/// Starts a new coroutine as a member of a group, using an array for
+/// arguments.
+/// @see neco_group_start()
+int neco_group_startv(neco_group *group, 
+    void(*coroutine)(int argc, void *argv[]), int argc, void *argv[])
+{
+    int ret = group_startv(group, coroutine, argc, 0, argv);
+    error_guard(ret);
+    return ret;
+}
+
+// Number of running members, not including the current coroutine.
+static size_t group_others(struct neco_group *group, struct coroutine *co) {
+    return group->nmembers - (co->group == group);
+}
+
+// Wait for any member to exit.
+static int group_wait(struct neco_group *group, struct coroutine *co,
+    int64_t deadline)
+{
+    colist_push_back(&group->waiters, co);
+    rt->nwaitgroupers++;
+    copause(deadline);
+    rt->nwaitgroupers--;
+    remove_from_list(co);
+    return checkdl(co, INT64_MAX);
+}
+
+static int group_join_dl(neco_group *group, int64_t deadline) {
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct coroutine *co = coself();
+    ret = checkdl(co, deadline);
+    while (ret == NECO_OK && group_others(group, co) > 0) {
+        ret = group_wait(group, co, deadline);
+    }
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    // All exited members are joined.
+    group->nexited = 0;
+    group->exitedhead = 0;
+    return group->err;
+}
+
+/// Same as neco_group_join() but with a deadline parameter.
+int neco_group_join_dl(neco_group *group, int64_t deadline) {
+    int ret = group_join_dl(group, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait for all members of a group to exit.
+///
+/// When called from a member of the group, that member is not waited on.
+/// @param group The group
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_CANCELED Operation canceled
+/// @return The first error provided to neco_group_seterr(), if any
+/// @see neco_group_join_dl()
+int neco_group_join(neco_group *group) {
+    return neco_group_join_dl(group, INT64_MAX);
+}
+
+static int group_joinany_dl(neco_group *group, int64_t *id, 
+    int64_t deadline)
+{
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct coroutine *co = coself();
+    ret = checkdl(co, deadline);
+    while (ret == NECO_OK && group->nexited == 0) {
+        if (group_others(group, co) == 0) {
+            return NECO_EMPTY;
+        }
+        ret = group_wait(group, co, deadline);
+    }
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    if (id) {
+        *id = group->exited[group->exitedhead];
+    }
+    group->exitedhead++;
+    group->nexited--;
+    if (group->nexited == 0) {
+        group->exitedhead = 0;
+    }
+    return NECO_OK;
+}
+
+/// Same as neco_group_joinany() but with a deadline parameter.
+int neco_group_joinany_dl(neco_group *group, int64_t *id, int64_t deadline) {
+    int ret = group_joinany_dl(group, id, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Wait for any member of a group to exit.
+///
+/// Each exited member is returned once, in the order that they exited.
+/// @param group The group
+/// @param[out] id The identifier of the exited member (optional)
+/// @return NECO_OK Success
+/// @return NECO_EMPTY The group has no members left to wait on
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_CANCELED Operation canceled
+/// @see neco_group_joinany_dl()
+int neco_group_joinany(neco_group *group, int64_t *id) {
+    return neco_group_joinany_dl(group, id, INT64_MAX);
+}
+
+// Cancel all members, except the current coroutine. Members are moved to 
+// the tail of the list as they are canceled, which allows for safely
+// resuming each one, even when they exit or start new members.
+// Members with their cancel state disabled are canceled once they enable it
+// again, see setcancelstate.
+static void group_cancelall(struct neco_group *group, struct coroutine *co) {
+    int64_t gen = ++group->cancelgen;
+    while (group->head && group->head->gcancelgen != gen) {
+        struct coroutine *member = group->head;
+        group_unlink(group, member);
+        group_join(group, member);
+        member->gcancelgen = gen;
+        if (member == co) {
+            continue;
+        } else if (member->cancelstate == NECO_CANCEL_ENABLE) {
+            member->canceled = true;
+            sco_resume(member->id);
+        } else {
+            member->gcancelpending = true;
+        }
+    }
+}
+
+static int group_cancel_dl(neco_group *group, int64_t deadline) {
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    struct coroutine *co = coself();
+    ret = checkdl(co, deadline);
+    if (ret != NECO_OK) {
+        return ret;
+    }
+    group_cancelall(group, co);
+    while (ret == NECO_OK && group_others(group, co) > 0) {
+        ret = group_wait(group, co, deadline);
+    }
+    return ret;
+}
+
+/// Same as neco_group_cancel() but with a deadline parameter.
+int neco_group_cancel_dl(neco_group *group, int64_t deadline) {
+    int ret = group_cancel_dl(group, deadline);
+    async_error_guard(ret);
+    return ret;
+}
+
+/// Cancel all members of a group and wait for them to exit.
+///
+/// When called from a member of the group, that member is not canceled.
+/// Members that have their cancel state disabled are canceled as soon as they
+/// enable it again.
+/// @param group The group
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+/// @return NECO_CANCELED Operation canceled
+/// @see neco_group_cancel_dl()
+int neco_group_cancel(neco_group *group) {
+    return neco_group_cancel_dl(group, INT64_MAX);
+}
+
+static int group_seterr(neco_group *group, int err) {
+    int ret = check_group(group);
+    if (ret != NECO_OK) {
+        return ret;
+    } else if (err == NECO_OK) {
+        return NECO_INVAL;
+    }
+    if (group->err == NECO_OK) {
+        group->err = err;
+        group_cancelall(group, coself());
+    }
+    return NECO_OK;
+}
+
+/// Report an error to a group.
+///
+/// The first error reported cancels all other members of the group and is
+/// returned by neco_group_join(). Any errors that follow are ignored.
+/// @param group The group
+/// @param err The error, which must not be NECO_OK
+/// @return NECO_OK Success
+/// @return NECO_INVAL An invalid parameter was provided
+/// @return NECO_PERM Operation called outside of a coroutine
+int neco_group_seterr(neco_group *group, int err) {
+    int ret = group_seterr(group, err);
+    error_guard(ret);
+    return ret;
+}
+
 #define DEFAULT_BUFFER_SIZE 4096
 
 struct bufrd {
@@ -7947,7 +13456,7 @@ static int stream_make_buffered_size(neco_stream **stream, int fd, bool buffered
     } else {
         memsize = offsetof(neco_stream, rd);
     }
-    *stream = malloc0(memsize);
+    *stream = slab_alloc(memsize);
     if (!*stream) {
         return NECO_NOMEM;
     }
@@ -7989,13 +13498,15 @@ static int stream_release(neco_stream *stream) {
     }
     if (stream->buffered) {
         if (stream->rd.data && stream->rd.data != stream->data) {
-            free0(stream->rd.data);
+            slab_free(stream->rd.data, stream->cap);
         }
         if (stream->wr.data && stream->wr.data != stream->data) {
-            free0(stream->wr.data);
+            slab_free(stream->wr.data, stream->cap);
         }
+        slab_free(stream, sizeof(neco_stream) + stream->cap);
+    } else {
+        slab_free(stream, offsetof(neco_stream, rd));
     }
-    free0(stream);
     return NECO_OK;
 }
 
@@ -8010,7 +13521,7 @@ static bool ensure_rd_data(neco_stream *stream) {
         if (!stream->wr.data) {
             stream->rd.data = stream->data;
         } else {
-            stream->rd.data = malloc0(stream->cap);
+            stream->rd.data = slab_alloc(stream->cap);
             if (!stream->rd.data) {
                 return false;
             }
@@ -8024,7 +13535,7 @@ static bool ensure_wr_data(neco_stream *stream) {
         if (!stream->rd.data) {
             stream->wr.data = stream->data;
         } else {
-            stream->wr.data = malloc0(stream->cap);
+            stream->wr.data = slab_alloc(stream->cap);
             if (!stream->wr.data) {
                 return false;
             }
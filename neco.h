@@ -17,6 +17,7 @@
 #else
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef __cplusplus
@@ -34,6 +35,8 @@ extern "C" {
 /// @{
 int neco_start(void(*coroutine)(int argc, void *argv[]), int argc, ...);
 int neco_startv(void(*coroutine)(int argc, void *argv[]), int argc, void *argv[]);
+int neco_start_many(void(*coroutine)(int argc, void *argv[]), int n, int argc, void(*argsfn)(int index, void *argv[], void *udata), void *udata);
+int neco_start_closure(void(*coroutine)(int argc, void *argv[]), const void *data, size_t size);
 int neco_yield(void);
 int neco_sleep(int64_t nanosecs);
 int neco_sleep_dl(int64_t deadline);
@@ -60,6 +63,8 @@ int64_t neco_starterid(void);
 /// @{
 typedef struct neco_chan neco_chan;
 
+#define NECO_CHAN_UNBOUNDED SIZE_MAX
+
 int neco_chan_make(neco_chan **chan, size_t data_size, size_t capacity);
 int neco_chan_retain(neco_chan *chan);
 int neco_chan_release(neco_chan *chan);
@@ -77,6 +82,29 @@ int neco_chan_selectv_dl(int nchans, neco_chan *chans[], int64_t deadline);
 int neco_chan_tryselect(int nchans, ...);
 int neco_chan_tryselectv(int nchans, neco_chan *chans[]);
 int neco_chan_case(neco_chan *chan, void *data);
+int neco_chan_make_unbounded(neco_chan **chan, size_t data_size);
+int neco_chan_setcap(neco_chan *chan, size_t capacity);
+int neco_chan_make_priority(neco_chan **chan, size_t data_size, size_t capacity, int (*compare)(const void *a, const void *b, void *udata), void *udata);
+int neco_chan_setwatermarks(neco_chan *chan, size_t low, size_t high, void (*func)(neco_chan *chan, bool high, void *udata), void *udata);
+
+int neco_timer_make(neco_chan **chan, int64_t duration);
+int neco_ticker_make(neco_chan **chan, int64_t interval);
+int neco_timer_stop(neco_chan *chan);
+int neco_timer_reset(neco_chan *chan, int64_t duration);
+
+// select on channels and file descriptors at the same time.
+#define NECO_SELECT_RECV  0
+#define NECO_SELECT_READ  1
+#define NECO_SELECT_WRITE 2
+
+typedef struct neco_selectcase {
+    int kind;        ///< NECO_SELECT_RECV, NECO_SELECT_READ, NECO_SELECT_WRITE
+    int fd;          ///< File descriptor for read and write cases
+    neco_chan *chan; ///< Channel for receive cases
+} neco_selectcase;
+
+int neco_select(int ncases, neco_selectcase cases[]);
+int neco_select_dl(int ncases, neco_selectcase cases[], int64_t deadline);
 /// @}
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -114,6 +142,10 @@ typedef struct { int64_t _0; intptr_t _1[5]; } neco_mutex;
 
 #define NECO_MUTEX_INITIALIZER { 0 }
 
+#define NECO_MUTEX_DEFAULT 0 ///< Yield on unlock and handoff to next waiter
+#define NECO_MUTEX_NOYIELD 1 ///< Do not yield on unlock without waiters
+#define NECO_MUTEX_BARGING 2 ///< Wake next waiter without handing off lock
+
 int neco_mutex_init(neco_mutex *mutex);
 int neco_mutex_lock(neco_mutex *mutex);
 int neco_mutex_lock_dl(neco_mutex *mutex, int64_t deadline);
@@ -122,6 +154,7 @@ int neco_mutex_unlock(neco_mutex *mutex);
 int neco_mutex_rdlock(neco_mutex *mutex);
 int neco_mutex_rdlock_dl(neco_mutex *mutex, int64_t deadline);
 int neco_mutex_tryrdlock(neco_mutex *mutex);
+int neco_mutex_setmode(neco_mutex *mutex, int mode);
 /// @}
 
 /// @defgroup WaitGroups WaitGroups
@@ -156,6 +189,32 @@ int neco_cond_wait(neco_cond *cond, neco_mutex *mutex);
 int neco_cond_wait_dl(neco_cond *cond, neco_mutex *mutex, int64_t deadline);
 /// @}
 
+/// @defgroup Semaphores Semaphores
+/// A weighted semaphore limits the combined weight of the coroutines that
+/// may hold it at once. It's typically used to bound concurrency.
+/// @{
+typedef struct { int64_t _0[3]; intptr_t _1[4]; } neco_sema;
+
+int neco_sema_init(neco_sema *sema, int64_t size);
+int neco_sema_acquire(neco_sema *sema, int64_t weight);
+int neco_sema_acquire_dl(neco_sema *sema, int64_t weight, int64_t deadline);
+int neco_sema_tryacquire(neco_sema *sema, int64_t weight);
+int neco_sema_release(neco_sema *sema, int64_t weight);
+/// @}
+
+/// @defgroup RateLimiters Rate limiters
+/// A token bucket rate limiter that allows for a number of operations per
+/// second, with bursts. 
+/// @{
+typedef struct { int64_t _0[4]; } neco_ratelimiter;
+
+int neco_ratelimiter_init(neco_ratelimiter *limiter, int64_t rate, 
+    int64_t burst);
+int neco_ratelimiter_acquire(neco_ratelimiter *limiter);
+int neco_ratelimiter_acquire_dl(neco_ratelimiter *limiter, int64_t deadline);
+int neco_ratelimiter_tryacquire(neco_ratelimiter *limiter);
+/// @}
+
 ////////////////////////////////////////////////////////////////////////////////
 // file descriptors
 ////////////////////////////////////////////////////////////////////////////////
@@ -170,8 +229,31 @@ ssize_t neco_read(int fd, void *data, size_t nbytes);
 ssize_t neco_read_dl(int fd, void *data, size_t nbytes, int64_t deadline);
 ssize_t neco_write(int fd, const void *data, size_t nbytes);
 ssize_t neco_write_dl(int fd, const void *data, size_t nbytes, int64_t deadline);
+#ifndef _WIN32
+ssize_t neco_readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t neco_readv_dl(int fd, const struct iovec *iov, int iovcnt, int64_t deadline);
+ssize_t neco_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t neco_writev_dl(int fd, const struct iovec *iov, int iovcnt, int64_t deadline);
+ssize_t neco_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+ssize_t neco_sendfile_dl(int out_fd, int in_fd, off_t *offset, size_t count, int64_t deadline);
+ssize_t neco_copy(int dst, int src, size_t max);
+ssize_t neco_copy_dl(int dst, int src, size_t max, int64_t deadline);
+ssize_t neco_recvmsg(int fd, struct msghdr *msg, int flags);
+ssize_t neco_recvmsg_dl(int fd, struct msghdr *msg, int flags, int64_t deadline);
+ssize_t neco_sendmsg(int fd, const struct msghdr *msg, int flags);
+ssize_t neco_sendmsg_dl(int fd, const struct msghdr *msg, int flags, int64_t deadline);
+#ifdef __linux__
+struct mmsghdr;
+int neco_recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+int neco_recvmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags, int64_t deadline);
+int neco_sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+int neco_sendmmsg_dl(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags, int64_t deadline);
+#endif
+#endif
 int neco_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 int neco_accept_dl(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int64_t deadline);
+int neco_accept_many(int sockfd, int *fds, int max);
+int neco_accept_many_dl(int sockfd, int *fds, int max, int64_t deadline);
 int neco_connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 int neco_connect_dl(int sockfd, const struct sockaddr *addr, socklen_t addrlen, int64_t deadline);
 int neco_getaddrinfo(const char *node, const char *service,
@@ -193,6 +275,8 @@ int neco_setnonblock(int fd, bool nonblock, bool *oldnonblock);
 
 int neco_wait(int fd, int mode);
 int neco_wait_dl(int fd, int mode, int64_t deadline);
+int neco_waitmany(const int fds[], const int modes[], int ready[], int nfds);
+int neco_waitmany_dl(const int fds[], const int modes[], int ready[], int nfds, int64_t deadline);
 
 /// @}
 
@@ -208,6 +292,29 @@ int neco_serve_dl(const char *network, const char *address, int64_t deadline);
 int neco_dial(const char *network, const char *address);
 int neco_dial_dl(const char *network, const char *address, int64_t deadline);
 
+typedef struct neco_serve_opts {
+    int backlog;      ///< Listen backlog. Default SOMAXCONN
+    bool reuseport;   ///< Set SO_REUSEPORT, allowing multiple listeners
+    bool nodelay;     ///< Set TCP_NODELAY, inherited by accepted sockets
+    int fastopen;     ///< TCP_FASTOPEN queue length. Default disabled
+    int defer_accept; ///< TCP_DEFER_ACCEPT timeout in seconds. Linux only
+} neco_serve_opts;
+
+int neco_serve_with(const char *network, const char *address, const neco_serve_opts *opts);
+int neco_serve_with_dl(const char *network, const char *address, const neco_serve_opts *opts, int64_t deadline);
+
+typedef struct neco_pool_opts {
+    int max_idle;         ///< Max idle connections per address. Default 8
+    int max_active;       ///< Max checked out connections per address
+    int64_t idle_timeout; ///< Close connections idle this long. Default 90s
+} neco_pool_opts;
+
+int neco_pool_setopts(const neco_pool_opts *opts);
+int neco_pool_dial(const char *network, const char *address);
+int neco_pool_dial_dl(const char *network, const char *address, int64_t deadline);
+int neco_pool_put(int fd);
+int neco_pool_close(int fd);
+
 /// @}
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -234,6 +341,55 @@ int neco_setcancelstate(int state, int *oldstate);
 
 /// @}
 
+/// @defgroup Contexts Contexts
+/// A context carries a deadline and a cancel signal that is inherited by
+/// started coroutines and honored by every blocking operation.
+/// @{
+typedef struct neco_context neco_context;
+
+int neco_context_make(neco_context **ctx, int64_t deadline);
+int neco_context_release(neco_context *ctx);
+int neco_context_cancel(neco_context *ctx);
+int neco_context_set(neco_context *ctx);
+int neco_context_get(neco_context **ctx);
+/// @}
+
+/// @defgroup Groups Coroutine groups
+/// A group tracks the coroutines that are started into it, allowing for them
+/// to be joined or canceled together. The first error reported to a group
+/// cancels all of its members.
+/// @{
+typedef struct neco_group neco_group;
+
+int neco_group_make(neco_group **group);
+int neco_group_release(neco_group *group);
+int neco_group_start(neco_group *group, void(*coroutine)(int argc, void *argv[]), int argc, ...);
+int neco_group_startv(neco_group *group, void(*coroutine)(int argc, void *argv[]), int argc, void *argv[]);
+int neco_group_join(neco_group *group);
+int neco_group_join_dl(neco_group *group, int64_t deadline);
+int neco_group_joinany(neco_group *group, int64_t *id);
+int neco_group_joinany_dl(neco_group *group, int64_t *id, int64_t deadline);
+int neco_group_cancel(neco_group *group);
+int neco_group_cancel_dl(neco_group *group, int64_t deadline);
+int neco_group_seterr(neco_group *group, int err);
+/// @}
+
+/// @defgroup Keys Coroutine-local storage
+/// Keys provide each coroutine with its own value, which is destroyed when
+/// the coroutine exits.
+/// @{
+int neco_key_create(int64_t *key, void(*destructor)(void *value));
+int neco_key_delete(int64_t key);
+void *neco_getspecific(int64_t key);
+int neco_setspecific(int64_t key, const void *value);
+/// @}
+
+/// @defgroup Arena Coroutine arena
+/// Memory that belongs to a coroutine and is released when it exits.
+/// @{
+void *neco_alloc(size_t size);
+/// @}
+
 ////////////////////////////////////////////////////////////////////////////////
 // random number generator
 ////////////////////////////////////////////////////////////////////////////////
@@ -304,6 +460,38 @@ const char *neco_switch_method(void);
 
 /// @}
 
+/// @defgroup Contention Contention profiling
+/// Optional profiling of how long coroutines wait on mutexes, condition
+/// variables, waitgroups, semaphores, and channels.
+/// @{
+
+#define NECO_CONTENTION_MUTEX     1 ///< Mutex lock and rdlock
+#define NECO_CONTENTION_COND      2 ///< Condition variable wait
+#define NECO_CONTENTION_WAITGROUP 3 ///< Waitgroup wait
+#define NECO_CONTENTION_SEMA      4 ///< Semaphore acquire
+#define NECO_CONTENTION_SEND      5 ///< Channel send
+#define NECO_CONTENTION_RECV      6 ///< Channel receive
+
+#define NECO_CONTENTION_NBUCKETS 32
+
+typedef struct neco_contention {
+    int kind;               ///< One of the NECO_CONTENTION_* kinds
+    const void *object;     ///< The mutex, channel, etc.
+    const void *callsite;   ///< Return address of the calling function
+    int64_t acquisitions;   ///< Number of operations
+    int64_t contended;      ///< Number of operations that had to wait
+    int64_t waittime;       ///< Total wait time, in nanoseconds
+    int64_t maxwait;        ///< Longest wait time, in nanoseconds
+    int64_t histogram[NECO_CONTENTION_NBUCKETS]; ///< Wait times, log2 buckets
+} neco_contention;
+
+int neco_contention_enable(bool enable);
+int neco_contention_foreach(bool(*iter)(const neco_contention *ct, void *udata), void *udata);
+int neco_contention_reset(void);
+int neco_contention_dump(int fd);
+
+/// @}
+
 ////////////////////////////////////////////////////////////////////////////////
 // global behaviors
 ////////////////////////////////////////////////////////////////////////////////
@@ -315,6 +503,7 @@ void neco_env_setallocator(void *(*malloc)(size_t), void *(*realloc)(void*, size
 void neco_env_setpaniconerror(bool paniconerror);
 void neco_env_setcanceltype(int type);
 void neco_env_setcancelstate(int state);
+void neco_env_setmutexmode(int mode);
 
 /// @}
 
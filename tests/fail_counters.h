@@ -10,6 +10,7 @@
 #undef write0
 #undef send0
 #undef accept0
+#undef sys_accept40
 #undef connect0
 #undef socket0
 #undef bind0
@@ -21,6 +22,14 @@
 #undef pthread_create0
 #undef pthread_detach0
 #undef pipe0
+#undef readv0
+#undef writev0
+#undef sendfile0
+#undef sys_splice0
+#undef recvmsg0
+#undef sendmsg0
+#undef sys_recvmmsg0
+#undef sys_sendmmsg0
 #undef malloc0
 #undef realloc0
 #undef stack_get0
@@ -103,6 +112,35 @@ FAIL_CALL(int, fcntl0, fcntl, -1, EBADF,
 FAIL_CALL(int, pipe0, pipe, -1, EMFILE,
     (int fds[2]), 
     (fds))
+FAIL_CALL(ssize_t, readv0, readv, -1, EIO,
+    (int fd, const struct iovec *iov, int iovcnt), 
+    (fd, iov, iovcnt))
+FAIL_CALL(ssize_t, writev0, writev, -1, EIO,
+    (int fd, const struct iovec *iov, int iovcnt), 
+    (fd, iov, iovcnt))
+FAIL_CALL(ssize_t, recvmsg0, recvmsg, -1, EIO,
+    (int fd, struct msghdr *msg, int flags), 
+    (fd, msg, flags))
+FAIL_CALL(ssize_t, sendmsg0, sendmsg, -1, EIO,
+    (int fd, const struct msghdr *msg, int flags), 
+    (fd, msg, flags))
+#ifdef __linux__
+FAIL_CALL(ssize_t, sendfile0, sendfile, -1, EIO,
+    (int out_fd, int in_fd, off_t *offset, size_t count), 
+    (out_fd, in_fd, offset, count))
+FAIL_CALL(int, sys_accept40, sys_accept4, -1, EMFILE,
+    (int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags), 
+    (sockfd, addr, addrlen, flags))
+FAIL_CALL(ssize_t, sys_splice0, sys_splice, -1, EIO,
+    (int fd_in, int fd_out, size_t len), 
+    (fd_in, fd_out, len))
+FAIL_CALL(int, sys_recvmmsg0, sys_recvmmsg, -1, EIO,
+    (int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags), 
+    (fd, msgvec, vlen, flags))
+FAIL_CALL(int, sys_sendmmsg0, sys_sendmmsg, -1, EIO,
+    (int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags), 
+    (fd, msgvec, vlen, flags))
+#endif
 #endif
 
 #if defined(__GNUC__)
@@ -75,6 +75,242 @@ void test_basic_start(void) {
 
 }
 
+void co_basic_many_child(int argc, void *argv[]) {
+    assert(argc == 5);
+    int *order = argv[0];
+    int index = (int)(intptr_t)argv[1];
+    assert(argv[4] == 0);
+    assert(*order == index);
+    (*order)++;
+}
+
+void co_basic_many_sleeper(int argc, void *argv[]) {
+    assert(argc == 2);
+    if (neco_sleep(NECO_SECOND) == NECO_OK) {
+        (*(int*)argv[0])++;
+    }
+}
+
+void basic_many_args(int index, void *argv[], void *udata) {
+    argv[0] = udata;
+    argv[1] = (void*)(intptr_t)index;
+}
+
+void co_basic_many(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int N = 1000;
+    int order = 0;
+    expect(neco_start_many(co_basic_many_child, N, 5, basic_many_args, &order),
+        NECO_OK);
+    // Children are queued and do not run until this coroutine yields.
+    assert(order == 0);
+    assert(neco_lastid() == neco_getid()+N);
+    expect(neco_yield(), NECO_OK);
+    assert(order == N);
+
+    // Queued children can be joined and canceled before they start.
+    order = 0;
+    expect(neco_start_many(co_basic_many_child, 1, 5, basic_many_args, &order),
+        NECO_OK);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(order == 1);
+    int slept = 0;
+    expect(neco_start_many(co_basic_many_sleeper, 1, 2, basic_many_args,
+        &slept), NECO_OK);
+    expect(neco_cancel(neco_lastid()), NECO_OK);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(slept == 0);
+
+    expect(neco_start_many(co_basic_many_child, 0, 0, 0, 0), NECO_OK);
+    expect(neco_start_many(co_basic_many_child, -1, 0, 0, 0), NECO_INVAL);
+    expect(neco_start_many(co_basic_many_child, 1, 1, 0, 0), NECO_INVAL);
+    expect(neco_start_many(0, 1, 0, 0, 0), NECO_INVAL);
+#ifdef IS_FAIL_TARGET
+    // Nothing is started when any of the reservations fail.
+    order = 0;
+    neco_fail_neco_malloc_counter = 5;
+    expect(neco_start_many(co_basic_many_child, 10, 5, basic_many_args, 
+        &order), NECO_NOMEM);
+    expect(neco_yield(), NECO_OK);
+    assert(order == 0);
+#endif
+}
+
+void test_basic_start_many(void) {
+    expect(neco_start_many(co_basic_many_child, 1, 0, 0, 0), NECO_PERM);
+    expect(neco_start(co_basic_many, 0), NECO_OK);
+}
+
+struct basic_closure {
+    int64_t id;
+    char msg[100];
+    int *done;
+};
+
+void co_basic_closure_child(int argc, void *argv[]) {
+    assert(argc == 1);
+    struct basic_closure *c = argv[0];
+    assert(((uintptr_t)c & 15) == 0);
+    assert(c->id == neco_starterid());
+    expect(neco_yield(), NECO_OK);
+    assert(strcmp(c->msg, "hello closure") == 0);
+    (*c->done)++;
+}
+
+void co_basic_closure_empty(int argc, void *argv[]) {
+    assert(argc == 1 && argv[0]);
+}
+
+void co_basic_closure(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int done = 0;
+    for (int i = 0; i < 10; i++) {
+        struct basic_closure c = { .id = neco_getid(), .done = &done };
+        strcpy(c.msg, "hello closure");
+        expect(neco_start_closure(co_basic_closure_child, &c, sizeof(c)), 
+            NECO_OK);
+        // The child has its own copy.
+        memset(&c, 0, sizeof(c));
+    }
+    expect(neco_start_closure(co_basic_closure_empty, 0, 0), NECO_OK);
+    expect(neco_start_closure(0, &done, sizeof(done)), NECO_INVAL);
+    expect(neco_start_closure(co_basic_closure_empty, 0, 1), NECO_INVAL);
+    expect(neco_start_closure(co_basic_closure_empty, &done, SIZE_MAX), 
+        NECO_INVAL);
+    while (done < 10) {
+        expect(neco_yield(), NECO_OK);
+    }
+}
+
+void test_basic_start_closure(void) {
+    int x = 0;
+    expect(neco_start_closure(co_basic_closure_empty, &x, sizeof(x)), 
+        NECO_PERM);
+    expect(neco_start(co_basic_closure, 0), NECO_OK);
+}
+
+static int64_t basic_key;
+static int basic_key_destroyed = 0;
+
+void basic_key_destructor(void *value) {
+    basic_key_destroyed += *(int*)value;
+    // Setting a value again from a destructor makes it run one more time.
+    if (*(int*)value == 1) {
+        static int two = 2;
+        expect(neco_setspecific(basic_key, &two), NECO_OK);
+    }
+}
+
+void co_basic_key_child(int argc, void *argv[]) {
+    assert(argc == 1);
+    assert(neco_getspecific(basic_key) == 0);
+    expect(neco_setspecific(basic_key, argv[0]), NECO_OK);
+    expect(neco_yield(), NECO_OK);
+    assert(neco_getspecific(basic_key) == argv[0]);
+}
+
+void co_basic_key(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    basic_key_destroyed = 0;
+    expect(neco_key_create(0, 0), NECO_INVAL);
+    expect(neco_key_create(&basic_key, basic_key_destructor), NECO_OK);
+    int one = 1;
+    int ten = 10;
+    expect(neco_setspecific(basic_key, &ten), NECO_OK);
+    expect(neco_start(co_basic_key_child, 1, &one), NECO_OK);
+    expect(neco_start(co_basic_key_child, 1, &ten), NECO_OK);
+    assert(neco_getspecific(basic_key) == &ten);
+    expect(neco_setspecific(basic_key, 0), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    assert(basic_key_destroyed == 13);
+
+    // Values from a deleted key are not visible through a reused slot.
+    expect(neco_setspecific(basic_key, &one), NECO_OK);
+    expect(neco_key_delete(basic_key), NECO_OK);
+    expect(neco_key_delete(basic_key), NECO_INVAL);
+    assert(neco_getspecific(basic_key) == 0);
+    expect(neco_setspecific(basic_key, &one), NECO_INVAL);
+    assert(neco_getspecific(-1) == 0);
+    int64_t key2;
+    expect(neco_key_create(&key2, 0), NECO_OK);
+    assert(neco_getspecific(key2) == 0);
+    expect(neco_setspecific(key2, &one), NECO_OK);
+    assert(neco_getspecific(key2) == &one);
+
+    // Many keys
+    int64_t keys[100];
+    for (int i = 0; i < 100; i++) {
+        expect(neco_key_create(&keys[i], 0), NECO_OK);
+        expect(neco_setspecific(keys[i], &keys[i]), NECO_OK);
+    }
+    for (int i = 0; i < 100; i++) {
+        assert(neco_getspecific(keys[i]) == &keys[i]);
+        expect(neco_key_delete(keys[i]), NECO_OK);
+    }
+#ifdef IS_FAIL_TARGET
+    int64_t keys2[200];
+    for (int i = 0; i < 200; i++) {
+        expect(neco_key_create(&keys2[i], 0), NECO_OK);
+    }
+    neco_fail_neco_realloc_counter = 1;
+    expect(neco_setspecific(keys2[199], &one), NECO_NOMEM);
+    assert(neco_getspecific(keys2[199]) == 0);
+    expect(neco_setspecific(keys2[199], &one), NECO_OK);
+    for (int i = 0; i < 200; i++) {
+        expect(neco_key_delete(keys2[i]), NECO_OK);
+    }
+    neco_fail_neco_realloc_counter = 1;
+    expect(neco_key_create(&keys2[0], 0), NECO_OK); // reuses a slot
+    neco_fail_neco_realloc_counter = 0;
+    expect(neco_key_delete(keys2[0]), NECO_OK);
+#endif
+    expect(neco_key_delete(key2), NECO_OK);
+}
+
+void test_basic_key(void) {
+    int64_t key;
+    expect(neco_key_create(&key, 0), NECO_PERM);
+    expect(neco_key_delete(0), NECO_PERM);
+    expect(neco_setspecific(0, 0), NECO_PERM);
+    assert(neco_getspecific(0) == 0);
+    expect(neco_start(co_basic_key, 0), NECO_OK);
+}
+
+void co_basic_alloc_child(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    char *ptrs[1000];
+    for (int i = 0; i < 1000; i++) {
+        size_t size = i % 100 == 0 ? 10000 : (size_t)(i % 37) + 1;
+        ptrs[i] = neco_alloc(size);
+        assert(ptrs[i]);
+        assert(((uintptr_t)ptrs[i] & 15) == 0);
+        memset(ptrs[i], i & 0xFF, size);
+    }
+    for (int i = 0; i < 1000; i++) {
+        assert((unsigned char)ptrs[i][0] == (i & 0xFF));
+    }
+    expect(neco_yield(), NECO_OK);
+}
+
+void co_basic_alloc(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    for (int i = 0; i < 10; i++) {
+        expect(neco_start(co_basic_alloc_child, 0), NECO_OK);
+    }
+    assert(neco_alloc(0));
+    assert(neco_alloc(SIZE_MAX) == 0);
+#ifdef IS_FAIL_TARGET
+    neco_fail_neco_malloc_counter = 1;
+    assert(neco_alloc(100000) == 0);
+    assert(neco_alloc(100000));
+#endif
+}
+
+void test_basic_alloc(void) {
+    assert(neco_alloc(10) == 0);
+    expect(neco_start(co_basic_alloc, 0), NECO_OK);
+}
+
 void co_basic_stats(int argc, void *argv[]) {
     assert(argc == 0);
     (void)argv;
@@ -206,6 +442,10 @@ void test_basic_malloc(void) {
 
 int main(int argc, char **argv) {
     do_test(test_basic_start);
+    do_test(test_basic_start_many);
+    do_test(test_basic_start_closure);
+    do_test(test_basic_key);
+    do_test(test_basic_alloc);
     do_test(test_basic_stats);
     do_test(test_basic_sched);
     do_test(test_basic_sleep);
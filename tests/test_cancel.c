@@ -101,9 +101,101 @@ void test_cancel_block(void) {
     expect(neco_start(co_cancel_block, 0), NECO_OK);
 }
 
+void co_cancel_context_child(int argc, void *argv[]) {
+    assert(argc == 1);
+    int *canceled = argv[0];
+    expect(neco_setcanceltype(NECO_CANCEL_INLINE, 0), NECO_OK);
+    expect(neco_sleep(NECO_HOUR), NECO_CANCELED);
+    expect(neco_yield(), NECO_OK);
+    expect(neco_sleep(NECO_HOUR), NECO_CANCELED);
+    (*canceled)++;
+}
+
+void co_cancel_context_budget(int argc, void *argv[]) {
+    assert(argc == 1);
+    int *timedout = argv[0];
+    neco_chan *chan;
+    expect(neco_chan_make(&chan, sizeof(int), 0), NECO_OK);
+    int x;
+    expect(neco_chan_recv(chan, &x), NECO_TIMEDOUT);
+    expect(neco_sleep(NECO_HOUR), NECO_TIMEDOUT);
+    expect(neco_chan_release(chan), NECO_OK);
+    (*timedout)++;
+}
+
+void co_cancel_context(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    neco_context *ctx;
+    expect(neco_context_make(0, 0), NECO_INVAL);
+    expect(neco_context_get(&ctx), NECO_OK);
+    assert(ctx == NULL);
+
+    // The deadline is inherited by started coroutines.
+    int64_t start = neco_now();
+    expect(neco_context_make(&ctx, neco_now()+NECO_MILLISECOND*5), NECO_OK);
+    expect(neco_context_set(ctx), NECO_OK);
+    int timedout = 0;
+    expect(neco_start(co_cancel_context_budget, 1, &timedout), NECO_OK);
+    expect(neco_sleep(NECO_HOUR), NECO_TIMEDOUT);
+    assert(neco_now()-start < NECO_SECOND);
+    expect(neco_join(neco_lastid()), NECO_TIMEDOUT);
+    expect(neco_context_set(0), NECO_OK);
+    expect(neco_context_release(ctx), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    assert(timedout == 1);
+
+    // Cancel wakes all coroutines, including those in child contexts.
+    int canceled = 0;
+    neco_context *root, *child;
+    expect(neco_context_make(&root, INT64_MAX), NECO_OK);
+    expect(neco_context_set(root), NECO_OK);
+    for (int i = 0; i < 3; i++) {
+        expect(neco_start(co_cancel_context_child, 1, &canceled), NECO_OK);
+    }
+    expect(neco_context_make(&child, INT64_MAX), NECO_OK);
+    expect(neco_context_set(child), NECO_OK);
+    for (int i = 0; i < 3; i++) {
+        expect(neco_start(co_cancel_context_child, 1, &canceled), NECO_OK);
+    }
+    expect(neco_context_get(&ctx), NECO_OK);
+    assert(ctx == child);
+    expect(neco_context_set(0), NECO_OK);
+    expect(neco_context_release(child), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    assert(canceled == 0);
+    expect(neco_context_cancel(root), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    assert(canceled == 6);
+    expect(neco_context_cancel(root), NECO_OK);
+
+    // Coroutines started in a canceled context are canceled right away.
+    expect(neco_context_set(root), NECO_OK);
+    expect(neco_start(co_cancel_context_child, 1, &canceled), NECO_OK);
+    expect(neco_join(neco_lastid()), NECO_CANCELED);
+    expect(neco_context_set(0), NECO_OK);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(canceled == 7);
+    expect(neco_context_release(root), NECO_OK);
+
+#ifdef IS_FAIL_TARGET
+    neco_fail_neco_malloc_counter = 1;
+    expect(neco_context_make(&ctx, INT64_MAX), NECO_NOMEM);
+#endif
+}
+
+void test_cancel_context(void) {
+    neco_context *ctx;
+    expect(neco_context_make(&ctx, INT64_MAX), NECO_PERM);
+    expect(neco_context_cancel(0), NECO_INVAL);
+    expect(neco_context_set(0), NECO_PERM);
+    expect(neco_start(co_cancel_context, 0), NECO_OK);
+}
+
 int main(int argc, char **argv) {
     do_test(test_cancel_cleanup);
     do_test(test_cancel_early);
     do_test(test_cancel_errors);
     do_test(test_cancel_block);
+    do_test(test_cancel_context);
 }
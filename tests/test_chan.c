@@ -495,6 +495,410 @@ void test_chan_tryselect(void) {
     expect(neco_start(co_chan_tryselect, 0), NECO_OK);
 }
 
+void co_chan_timer(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_chan *tm;
+    int64_t when;
+    int64_t start = neco_now();
+    expect(neco_timer_make(&tm, NECO_MILLISECOND*50), NECO_OK);
+    expect(neco_chan_tryrecv(tm, &when), NECO_EMPTY);
+    expect(neco_chan_recv(tm, &when), NECO_OK);
+    assert(when - start >= NECO_MILLISECOND*50);
+    expect(neco_chan_recv_dl(tm, &when, neco_now()+NECO_MILLISECOND*50), 
+        NECO_TIMEDOUT);
+
+    // reset and stop
+    expect(neco_timer_reset(tm, NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_timer_stop(tm), NECO_OK);
+    expect(neco_chan_recv_dl(tm, &when, neco_now()+NECO_MILLISECOND*50), 
+        NECO_TIMEDOUT);
+    expect(neco_timer_reset(tm, NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND*30), NECO_OK);
+    expect(neco_chan_tryrecv(tm, &when), NECO_OK);
+
+    // timeout in a select
+    neco_chan *ch;
+    expect(neco_chan_make(&ch, sizeof(int), 0), NECO_OK);
+    expect(neco_timer_reset(tm, NECO_MILLISECOND*20), NECO_OK);
+    expect(neco_chan_select(2, ch, tm), 1);
+    expect(neco_chan_case(tm, &when), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+
+    expect(neco_timer_stop(ch), NECO_INVAL);
+    expect(neco_timer_make(0, 0), NECO_INVAL);
+    expect(neco_chan_release(tm), NECO_OK);
+
+    // released while armed
+    expect(neco_timer_make(&tm, NECO_SECOND), NECO_OK);
+    expect(neco_chan_release(tm), NECO_OK);
+}
+
+void co_chan_ticker_recv(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_chan *tk = argv[0];
+    int *count = argv[1];
+    int64_t when;
+    for (int i = 0; i < 5; i++) {
+        expect(neco_chan_recv(tk, &when), NECO_OK);
+        (*count)++;
+    }
+    expect(neco_chan_release(tk), NECO_OK);
+}
+
+void co_chan_ticker(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    expect(neco_ticker_make(&(neco_chan*){0}, 0), NECO_INVAL);
+
+    // Many tickers sharing the runtime deadline queue.
+    int N = 100;
+    int count = 0;
+    for (int i = 0; i < N; i++) {
+        neco_chan *tk;
+        expect(neco_ticker_make(&tk, NECO_MILLISECOND*(10+i%7)), NECO_OK);
+        expect(neco_start(co_chan_ticker_recv, 2, tk, &count), NECO_OK);
+    }
+    expect(neco_sleep(NECO_MILLISECOND*300), NECO_OK);
+    assert(count == N*5);
+
+    // Missed ticks are dropped.
+    neco_chan *tk;
+    int64_t when;
+    expect(neco_ticker_make(&tk, NECO_MILLISECOND*5), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND*50), NECO_OK);
+    expect(neco_chan_tryrecv(tk, &when), NECO_OK);
+    expect(neco_chan_tryrecv(tk, &when), NECO_EMPTY);
+    expect(neco_chan_release(tk), NECO_OK);
+}
+
+void test_chan_timer(void) {
+    neco_chan *tm;
+    expect(neco_timer_make(&tm, 0), NECO_PERM);
+    expect(neco_timer_stop(0), NECO_INVAL);
+    expect(neco_start(co_chan_timer, 0), NECO_OK);
+    expect(neco_start(co_chan_ticker, 0), NECO_OK);
+}
+
+void co_chan_unbounded_send(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_chan *ch = argv[0];
+    int i = *(int*)argv[1];
+    expect(neco_chan_send(ch, &i), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+}
+
+void chan_watermark(neco_chan *ch, bool high, void *udata) {
+    (void)ch;
+    int *state = udata;
+    assert(*state != (high ? 1 : 2));
+    *state = high ? 1 : 2;
+}
+
+void co_chan_unbounded(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_chan *ch;
+    int N = 10000;
+    int x;
+
+#ifdef IS_FAIL_TARGET
+    expect(neco_chan_make_unbounded(&ch, sizeof(int)), NECO_OK);
+    neco_fail_neco_malloc_counter = 1;
+    expect(neco_chan_send(ch, &(int){1}), NECO_NOMEM);
+    expect(neco_chan_release(ch), NECO_OK);
+    expect(neco_chan_make(&ch, sizeof(int), 1), NECO_OK);
+    expect(neco_chan_send(ch, &(int){1}), NECO_OK);
+    neco_fail_neco_malloc_counter = 1;
+    expect(neco_chan_setcap(ch, 2), NECO_NOMEM);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 1);
+    expect(neco_chan_release(ch), NECO_OK);
+#endif
+
+    // Messages are kept in order over many segments.
+    expect(neco_chan_make_unbounded(&ch, sizeof(int)), NECO_OK);
+    for (int i = 0; i < N; i++) {
+        expect(neco_chan_send(ch, &i), NECO_OK);
+    }
+    for (int i = 0; i < N; i++) {
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+        assert(x == i);
+    }
+    expect(neco_chan_tryrecv(ch, &x), NECO_EMPTY);
+    expect(neco_chan_send(ch, &(int){N}), NECO_OK);
+    expect(neco_chan_select(1, ch), 0);
+    expect(neco_chan_case(ch, &x), NECO_OK);
+    assert(x == N);
+    expect(neco_chan_close(ch), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+
+    // Zero sized and oversized messages.
+    expect(neco_chan_make_unbounded(&ch, 0), NECO_OK);
+    for (int i = 0; i < N; i++) {
+        expect(neco_chan_send(ch, 0), NECO_OK);
+    }
+    for (int i = 0; i < N; i++) {
+        expect(neco_chan_recv(ch, 0), NECO_OK);
+    }
+    expect(neco_chan_release(ch), NECO_OK);
+    char big[5000];
+    expect(neco_chan_make_unbounded(&ch, sizeof(big)), NECO_OK);
+    for (int i = 0; i < 10; i++) {
+        memset(big, i, sizeof(big));
+        expect(neco_chan_send(ch, big), NECO_OK);
+    }
+    for (int i = 0; i < 10; i++) {
+        expect(neco_chan_recv(ch, big), NECO_OK);
+        assert(big[0] == i && big[sizeof(big)-1] == i);
+    }
+    expect(neco_chan_release(ch), NECO_OK);
+}
+
+void co_chan_setcap(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_chan *ch;
+    int x;
+    expect(neco_chan_setcap(0, 1), NECO_INVAL);
+    expect(neco_chan_make(&ch, sizeof(int), 2), NECO_OK);
+    expect(neco_chan_setcap(ch, (size_t)INT_MAX+1), NECO_INVAL);
+
+    // Fill the ring with wrapped messages, then have two waiting senders.
+    expect(neco_chan_send(ch, &(int){0}), NECO_OK);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    expect(neco_chan_send(ch, &(int){1}), NECO_OK);
+    expect(neco_chan_send(ch, &(int){2}), NECO_OK);
+    for (int i = 3; i < 5; i++) {
+        expect(neco_chan_retain(ch), NECO_OK);
+        expect(neco_start(co_chan_unbounded_send, 2, ch, &i), NECO_OK);
+    }
+    neco_stats stats;
+    expect(neco_getstats(&stats), NECO_OK);
+    assert(stats.senders == 2);
+
+    // Grow the channel. The waiting senders are woken up.
+    expect(neco_chan_setcap(ch, 100), NECO_OK);
+    expect(neco_getstats(&stats), NECO_OK);
+    assert(stats.senders == 0);
+    for (int i = 5; i <= 100; i++) {
+        expect(neco_chan_send(ch, &i), NECO_OK);
+    }
+    expect(neco_chan_send_dl(ch, &x, neco_now()+NECO_MILLISECOND), 
+        NECO_TIMEDOUT);
+
+    // Shrink the channel. Buffered messages are kept.
+    expect(neco_chan_setcap(ch, 1), NECO_OK);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 1);
+    expect(neco_chan_send_dl(ch, &x, neco_now()+NECO_MILLISECOND), 
+        NECO_TIMEDOUT);
+    for (int i = 2; i <= 100; i++) {
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+        assert(x == i);
+    }
+    expect(neco_chan_setcap(ch, NECO_CHAN_UNBOUNDED), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+
+    // Watermarks
+    int state = 0;
+    expect(neco_chan_make_unbounded(&ch, sizeof(int)), NECO_OK);
+    expect(neco_chan_setwatermarks(ch, 10, 10, chan_watermark, &state), 
+        NECO_INVAL);
+    expect(neco_chan_setwatermarks(ch, 10, 100, chan_watermark, &state), 
+        NECO_OK);
+    for (int i = 0; i < 99; i++) {
+        expect(neco_chan_send(ch, &i), NECO_OK);
+    }
+    assert(state == 0);
+    expect(neco_chan_send(ch, &x), NECO_OK);
+    assert(state == 1);
+    for (int i = 0; i < 89; i++) {
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+    }
+    assert(state == 1);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(state == 2);
+    expect(neco_chan_release(ch), NECO_OK);
+}
+
+void test_chan_unbounded(void) {
+    expect(neco_chan_make_unbounded(0, 0), NECO_INVAL);
+    expect(neco_chan_setcap((neco_chan*)1, 0), NECO_PERM);
+    expect(neco_start(co_chan_unbounded, 0), NECO_OK);
+    expect(neco_start(co_chan_setcap, 0), NECO_OK);
+}
+
+int chan_priority_compare(const void *a, const void *b, void *udata) {
+    assert(udata == (void*)1);
+    int ia = *(int*)a;
+    int ib = *(int*)b;
+    return ia < ib ? -1 : ia > ib;
+}
+
+void co_chan_priority(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_chan *ch;
+    int x;
+    expect(neco_chan_make_priority(&ch, sizeof(int), 0, 
+        chan_priority_compare, (void*)1), NECO_INVAL);
+    expect(neco_chan_make_priority(&ch, 0, 10, 
+        chan_priority_compare, (void*)1), NECO_INVAL);
+    expect(neco_chan_make_priority(&ch, sizeof(int), 10, 0, 0), NECO_INVAL);
+
+    int N = 1000;
+    expect(neco_chan_make_priority(&ch, sizeof(int), N, 
+        chan_priority_compare, (void*)1), NECO_OK);
+    for (int i = 0; i < N; i++) {
+        int v = (i * 7919) % N;
+        expect(neco_chan_send(ch, &v), NECO_OK);
+    }
+    for (int i = 0; i < N/2; i++) {
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+        assert(x == i);
+    }
+    // Interleave sends and receives
+    for (int i = 0; i < N/2; i++) {
+        expect(neco_chan_send(ch, &(int){-1}), NECO_OK);
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+        assert(x == -1);
+    }
+    for (int i = N/2; i < N; i++) {
+        expect(neco_chan_recv(ch, &x), NECO_OK);
+        assert(x == i);
+    }
+
+    // Waiting senders are added to the heap as room is made.
+    expect(neco_chan_setcap(ch, N+1), NECO_PERM);
+    expect(neco_chan_setcap(ch, 2), NECO_OK);
+    expect(neco_chan_send(ch, &(int){5}), NECO_OK);
+    expect(neco_chan_send(ch, &(int){4}), NECO_OK);
+    for (int i = 3; i > 0; i--) {
+        expect(neco_chan_retain(ch), NECO_OK);
+        expect(neco_start(co_chan_unbounded_send, 2, ch, &i), NECO_OK);
+    }
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 4);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 3);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 2);
+    expect(neco_chan_select(1, ch), 0);
+    expect(neco_chan_case(ch, &x), NECO_OK);
+    assert(x == 1);
+    expect(neco_chan_recv(ch, &x), NECO_OK);
+    assert(x == 5);
+    expect(neco_chan_release(ch), NECO_OK);
+}
+
+void test_chan_priority(void) {
+    expect(neco_chan_make_priority(&(neco_chan*){0}, sizeof(int), 1, 
+        chan_priority_compare, 0), NECO_PERM);
+    expect(neco_start(co_chan_priority, 0), NECO_OK);
+}
+
+void co_chan_unified_writer(int argc, void *argv[]) {
+    assert(argc == 1);
+    int fd = *(int*)argv[0];
+    expect(neco_sleep(NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_write(fd, "x", 1), 1);
+}
+
+void co_chan_unified_sender(int argc, void *argv[]) {
+    assert(argc == 1);
+    neco_chan *ch = argv[0];
+    expect(neco_sleep(NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_chan_send(ch, &(int){42}), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+}
+
+void co_chan_unified(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int fds[2];
+    expect(neco_pipe(fds), NECO_OK);
+    neco_chan *ch;
+    expect(neco_chan_make(&ch, sizeof(int), 0), NECO_OK);
+    neco_selectcase cases[] = {
+        { .kind = NECO_SELECT_RECV, .chan = ch },
+        { .kind = NECO_SELECT_READ, .fd = fds[0] },
+    };
+    int x;
+    char c;
+
+    // file event wins
+    expect(neco_start(co_chan_unified_writer, 1, &fds[1]), NECO_OK);
+    expect(neco_select(2, cases), 1);
+    expect(neco_read(fds[0], &c, 1), 1);
+
+    // channel wins
+    expect(neco_chan_retain(ch), NECO_OK);
+    expect(neco_start(co_chan_unified_sender, 1, ch), NECO_OK);
+    expect(neco_select(2, cases), 0);
+    expect(neco_chan_case(ch, &x), NECO_OK);
+    assert(x == 42);
+
+    // channel only
+    expect(neco_chan_retain(ch), NECO_OK);
+    expect(neco_start(co_chan_unified_sender, 1, ch), NECO_OK);
+    expect(neco_select(1, cases), 0);
+    expect(neco_chan_case(ch, &x), NECO_OK);
+    assert(x == 42);
+
+    // deadline
+    expect(neco_select_dl(2, cases, neco_now()+NECO_MILLISECOND*10), 
+        NECO_TIMEDOUT);
+
+    // timer channel
+    neco_chan *tm;
+    expect(neco_timer_make(&tm, NECO_MILLISECOND*10), NECO_OK);
+    neco_selectcase cases2[] = {
+        { .kind = NECO_SELECT_READ, .fd = fds[0] },
+        { .kind = NECO_SELECT_RECV, .chan = ch },
+        { .kind = NECO_SELECT_RECV, .chan = tm },
+        { .kind = NECO_SELECT_WRITE, .fd = fds[1] },
+    };
+    expect(neco_select(3, cases2), 2);
+    expect(neco_select(4, cases2), 3);
+
+    // many cases and a ready channel
+    neco_chan *chs[20];
+    neco_selectcase cases3[21];
+    for (int i = 0; i < 20; i++) {
+        expect(neco_chan_make(&chs[i], sizeof(int), 1), NECO_OK);
+        cases3[i] = (neco_selectcase){ .kind = NECO_SELECT_RECV, .chan = chs[i] };
+    }
+    cases3[20] = (neco_selectcase){ .kind = NECO_SELECT_READ, .fd = fds[0] };
+    expect(neco_select_dl(21, cases3, neco_now()+NECO_MILLISECOND), 
+        NECO_TIMEDOUT);
+    expect(neco_chan_send(chs[15], &(int){15}), NECO_OK);
+    expect(neco_select(21, cases3), 15);
+    expect(neco_chan_case(chs[15], &x), NECO_OK);
+    assert(x == 15);
+    expect(neco_chan_close(chs[3]), NECO_OK);
+    expect(neco_select(21, cases3), 3);
+    expect(neco_chan_case(chs[3], &x), NECO_CLOSED);
+    for (int i = 0; i < 20; i++) {
+        expect(neco_chan_release(chs[i]), NECO_OK);
+    }
+
+    // invalid
+    expect(neco_select(-1, 0), NECO_INVAL);
+    expect(neco_select(1, 0), NECO_INVAL);
+    expect(neco_select(1, &(neco_selectcase){ .kind = 9 }), NECO_INVAL);
+    expect(neco_select(1, &(neco_selectcase){ .kind = NECO_SELECT_READ, 
+        .fd = -1 }), NECO_INVAL);
+    expect(neco_select(1, &(neco_selectcase){ .kind = NECO_SELECT_RECV }), 
+        NECO_INVAL);
+    expect(neco_cancel(neco_getid()), NECO_OK);
+    expect(neco_select(2, cases), NECO_CANCELED);
+
+    expect(neco_chan_release(tm), NECO_OK);
+    expect(neco_chan_release(ch), NECO_OK);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_chan_unified(void) {
+    expect(neco_select(0, 0), NECO_PERM);
+    expect(neco_start(co_chan_unified, 0), NECO_OK);
+}
+
 int main(int argc, char **argv) {
     do_test(test_chan_order);
     do_test(test_chan_select);
@@ -508,4 +912,8 @@ int main(int argc, char **argv) {
     do_test(test_chan_cancel);
     do_test(test_chan_zchanpool);
     do_test(test_chan_fail);
+    do_test(test_chan_timer);
+    do_test(test_chan_unbounded);
+    do_test(test_chan_priority);
+    do_test(test_chan_unified);
 }
@@ -73,6 +73,123 @@ void test_join(void) {
 }
 
 
+void co_join_group_member(int argc, void *argv[]) {
+    assert(argc == 2);
+    int64_t delay = *(int64_t*)argv[0];
+    int *count = argv[1];
+    if (neco_sleep(delay) == NECO_OK) {
+        (*count)++;
+    }
+}
+
+void co_join_group_toggler(int argc, void *argv[]) {
+    assert(argc == 1);
+    int *count = argv[0];
+    // The group is canceled while canceling is disabled.
+    expect(neco_setcancelstate(NECO_CANCEL_DISABLE, 0), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_setcancelstate(NECO_CANCEL_ENABLE, 0), NECO_OK);
+    if (neco_sleep(NECO_HOUR) == NECO_OK) {
+        (*count)++;
+    }
+}
+
+void co_join_group_failer(int argc, void *argv[]) {
+    assert(argc == 1);
+    neco_group *group = argv[0];
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    expect(neco_group_seterr(group, -100), NECO_OK);
+    expect(neco_group_seterr(group, -200), NECO_OK);
+}
+
+void co_join_group(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_group *group;
+    expect(neco_group_make(&group), NECO_OK);
+    expect(neco_group_start(group, 0, 0), NECO_INVAL);
+    expect(neco_group_joinany(group, 0), NECO_EMPTY);
+    expect(neco_group_join(group), NECO_OK);
+    expect(neco_group_seterr(group, NECO_OK), NECO_INVAL);
+
+    // Join all
+    int count = 0;
+    int64_t delays[10];
+    for (int i = 0; i < 10; i++) {
+        delays[i] = NECO_MILLISECOND * (i+1);
+        expect(neco_group_start(group, co_join_group_member, 2, &delays[i], 
+            &count), NECO_OK);
+    }
+    expect(neco_group_join_dl(group, neco_now()+NECO_MILLISECOND/2), 
+        NECO_TIMEDOUT);
+    expect(neco_group_join(group), NECO_OK);
+    assert(count == 10);
+    expect(neco_group_joinany(group, 0), NECO_EMPTY);
+
+    // Join any, then cancel the stragglers
+    count = 0;
+    int64_t first = 0;
+    for (int i = 0; i < 10; i++) {
+        delays[i] = i == 5 ? NECO_MILLISECOND : NECO_HOUR;
+        expect(neco_group_start(group, co_join_group_member, 2, &delays[i], 
+            &count), NECO_OK);
+        if (i == 5) {
+            first = neco_lastid();
+        }
+    }
+    int64_t id;
+    expect(neco_group_joinany(group, &id), NECO_OK);
+    assert(id == first && count == 1);
+    expect(neco_group_cancel(group), NECO_OK);
+    assert(count == 1);
+    for (int i = 0; i < 9; i++) {
+        expect(neco_group_joinany(group, &id), NECO_OK);
+        assert(id != first);
+    }
+    expect(neco_group_joinany(group, &id), NECO_EMPTY);
+
+    // First error cancels the others
+    count = 0;
+    for (int i = 0; i < 5; i++) {
+        delays[i] = NECO_HOUR;
+        expect(neco_group_start(group, co_join_group_member, 2, &delays[i], 
+            &count), NECO_OK);
+    }
+    expect(neco_group_start(group, co_join_group_failer, 1, group), NECO_OK);
+    expect(neco_group_join(group), -100);
+    assert(count == 0);
+
+    // Members that disable canceling are canceled once they enable it again
+    expect(neco_group_start(group, co_join_group_toggler, 1, &count), NECO_OK);
+    expect(neco_group_cancel_dl(group, neco_now()+NECO_SECOND), NECO_OK);
+    assert(count == 0);
+
+    expect(neco_group_release(group), NECO_OK);
+
+    // Running members are detached on release
+    expect(neco_group_make(&group), NECO_OK);
+    delays[0] = NECO_MILLISECOND;
+    expect(neco_group_start(group, co_join_group_member, 2, &delays[0], 
+        &count), NECO_OK);
+    expect(neco_group_release(group), NECO_OK);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(count == 1);
+
+#ifdef IS_FAIL_TARGET
+    neco_fail_neco_malloc_counter = 1;
+    expect(neco_group_make(&group), NECO_NOMEM);
+#endif
+}
+
+void test_join_group(void) {
+    neco_group *group;
+    expect(neco_group_make(&group), NECO_PERM);
+    expect(neco_group_make(0), NECO_INVAL);
+    expect(neco_group_join(0), NECO_INVAL);
+    expect(neco_start(co_join_group, 0), NECO_OK);
+}
+
+
 int main(int argc, char **argv) {
     do_test(test_join);
+    do_test(test_join_group);
 }
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE // for struct mmsghdr
+#endif
 #include "tests.h"
 
 #if defined(_WIN32)
@@ -7,6 +10,7 @@ DISABLED("test_net", "Emscripten")
 #else
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <netdb.h>
@@ -209,6 +213,94 @@ void test_net_getaddrinfo(void) {
     expect(neco_start(co_net_getaddrinfo, 0), NECO_OK);
 }
 
+#if defined(__GLIBC__) && !defined(NECO_NOGAICACHE)
+static void getaddrinfo_localhost(const char *service) {
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *ainfo = NULL;
+    int ret = neco_getaddrinfo("localhost", service, &hints, &ainfo);
+    assert(ret == 0 && ainfo && ainfo->ai_family == AF_INET);
+    struct sockaddr_in *addr = (struct sockaddr_in*)ainfo->ai_addr;
+    assert(ntohs(addr->sin_port) == atoi(service));
+    freeaddrinfo(ainfo);
+}
+
+void co_net_getaddrinfo_shared_child(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_waitgroup *wg = argv[0];
+    getaddrinfo_localhost(argv[1]);
+    expect(neco_waitgroup_done(wg), NECO_OK);
+}
+
+void co_net_getaddrinfo_shared_canceled(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    expect(neco_setcanceltype(NECO_CANCEL_INLINE, 0), NECO_OK);
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *ainfo = NULL;
+    int ret = neco_getaddrinfo("localhost", "19787", &hints, &ainfo);
+    assert(ret == EAI_SYSTEM && errno == ECANCELED);
+}
+
+void co_net_getaddrinfo_shared(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    int n = neco_getaddrinfo_nlookups();
+
+    // Concurrent lookups for the same query share one lookup.
+    neco_waitgroup wg;
+    expect(neco_waitgroup_init(&wg), NECO_OK);
+    for (int i = 0; i < 10; i++) {
+        expect(neco_waitgroup_add(&wg, 1), NECO_OK);
+        expect(neco_start(co_net_getaddrinfo_shared_child, 2, &wg, "19785"),
+            NECO_OK);
+    }
+    expect(neco_waitgroup_wait(&wg), NECO_OK);
+    assert(neco_getaddrinfo_nlookups() == n+1);
+
+    // Then the result is cached.
+    getaddrinfo_localhost("19785");
+    assert(neco_getaddrinfo_nlookups() == n+1);
+
+    // A different query is not.
+    getaddrinfo_localhost("19786");
+    assert(neco_getaddrinfo_nlookups() == n+2);
+
+    // A canceled caller leaves the lookup running for the others.
+    atomic_store(&neco_gai_delay, NECO_MILLISECOND*100);
+    expect(neco_start(co_net_getaddrinfo_shared_canceled, 0), NECO_OK);
+    int64_t canceled = neco_lastid();
+    expect(neco_waitgroup_add(&wg, 1), NECO_OK);
+    expect(neco_start(co_net_getaddrinfo_shared_child, 2, &wg, "19787"),
+        NECO_OK);
+    expect(neco_cancel(canceled), NECO_OK);
+    expect(neco_waitgroup_wait(&wg), NECO_OK);
+    atomic_store(&neco_gai_delay, 0);
+    getaddrinfo_localhost("19787");
+    assert(neco_getaddrinfo_nlookups() == n+3);
+
+    // An expired result is looked up again.
+    neco_gai_cachettl = NECO_MILLISECOND*10;
+    getaddrinfo_localhost("19788");
+    assert(neco_getaddrinfo_nlookups() == n+4);
+    expect(neco_sleep(NECO_MILLISECOND*20), NECO_OK);
+    getaddrinfo_localhost("19788");
+    assert(neco_getaddrinfo_nlookups() == n+5);
+    neco_gai_cachettl = NECO_SECOND*10;
+}
+
+void test_net_getaddrinfo_shared(void) {
+    expect(neco_start(co_net_getaddrinfo_shared, 0), NECO_OK);
+}
+#else
+void test_net_getaddrinfo_shared(void) {
+    // The results are only shared for known system resolvers.
+}
+#endif
+
 void co_net_dial_client(int argc, void *argv[]) {
     assert(argc == 0);
     (void)argv;
@@ -311,13 +403,13 @@ void co_net_getaddrinfo_fail(int argc, void *argv[]) {
     ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
     assert(ret != 0);
 
-    // cause NOMEM errors at six different positions
-    for (int i = 1; i <= 4; i++) {
+    // cause NOMEM errors at five different positions
+    for (int i = 1; i <= 5; i++) {
         neco_fail_neco_malloc_counter = i;
         ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
         assert(ret == EAI_MEMORY);
     }
-    
+
     neco_fail_pipe_counter = 1;
     ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
     assert(ret == EAI_SYSTEM && errno == EMFILE);
@@ -326,9 +418,11 @@ void co_net_getaddrinfo_fail(int argc, void *argv[]) {
     ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
     assert(ret == EAI_SYSTEM && errno == EBADF);
 
+#ifdef NECO_NOWORKERS
     neco_fail_pthread_create_counter = 1;
     ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
     assert(ret == EAI_SYSTEM && errno == EPERM);
+#endif
 
     neco_fail_read_counter = 1;
     ret = neco_getaddrinfo("i1o2293405", "9999", &hints, &ainfo);
@@ -342,6 +436,28 @@ void test_net_getaddrinfo_fail(void) {
     expect(neco_start(co_net_getaddrinfo_fail, 0), NECO_OK);
 }
 
+void co_net_getaddrinfo_abandon(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *ainfo = NULL;
+    atomic_store(&neco_gai_delay, NECO_SECOND);
+    int ret = neco_getaddrinfo_dl("localhost", "19789", &hints, &ainfo, 
+        neco_now()+NECO_MILLISECOND*10);
+    assert(ret == EAI_SYSTEM && errno == ETIMEDOUT);
+    atomic_store(&neco_gai_delay, 0);
+}
+
+void test_net_getaddrinfo_abandon(void) {
+    // The runtime does not wait for a lookup that every caller gave up on.
+    int64_t start = getnow();
+    expect(neco_start(co_net_getaddrinfo_abandon, 0), NECO_OK);
+    assert(getnow()-start < NECO_SECOND/2);
+    assert(neco_getaddrinfo_nthreads() == 1);
+}
+
 void co_net_serve_fail(int argc, void *argv[]) {
     assert(argc == 0);
     (void)argv;
@@ -467,6 +583,15 @@ void co_net_write_errors(int argc, void *argv[]) {
     assert(neco_accept(sock, 0, 0) == -1 && errno == ECANCELED);
     assert(neco_accept_dl(sock, 0, 0, 1) == -1 && errno == ETIMEDOUT);
 
+#ifdef __linux__
+    neco_fail_sys_accept4_counter = 1;
+    neco_fail_sys_accept4_error = EBADF;
+    assert(neco_accept(sock, 0, 0) == -1 && errno == EBADF);
+    // The reader expects its first connection to be dropped.
+    int fd0 = neco_accept(sock, 0, 0);
+    assert(fd0 > 0);
+    close(fd0);
+#else
     neco_fail_accept_counter = 1;
     neco_fail_accept_error = EBADF;
     assert(neco_accept(sock, 0, 0) == -1 && errno == EBADF);
@@ -475,6 +600,7 @@ void co_net_write_errors(int argc, void *argv[]) {
     neco_fail_fcntl_counter = 1;
     neco_fail_fcntl_error = EBADF;
     assert(neco_accept(sock, 0, 0) == -1 && errno == EBADF);
+#endif
 
     int fd = neco_accept(sock, 0, 0);
     // printf(">>> %d\n", neco_fail_fcntl_counter);
@@ -549,6 +675,521 @@ void test_net_setnonblock(void) {
     close(fds[1]);
 }
 
+#ifdef __linux__
+void co_net_mmsg_reader(int argc, void *argv[]) {
+    assert(argc == 2);
+    int fd = *(int*)argv[0];
+    int N = *(int*)argv[1];
+    int vals[64];
+    struct iovec iovs[64];
+    struct mmsghdr msgs[64];
+    int next = 0;
+    while (next < N) {
+        for (int i = 0; i < 64; i++) {
+            iovs[i] = (struct iovec){ &vals[i], sizeof(int) };
+            memset(&msgs[i], 0, sizeof(struct mmsghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = neco_recvmmsg(fd, msgs, 64, 0);
+        assert(n > 0);
+        for (int i = 0; i < n; i++) {
+            assert(msgs[i].msg_len == sizeof(int));
+            assert(vals[i] == next);
+            next++;
+        }
+    }
+}
+#endif
+
+void co_net_msg(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+    expect(neco_setnonblock(fds[0], true, 0), NECO_OK);
+    expect(neco_setnonblock(fds[1], true, 0), NECO_OK);
+
+    char hdr[] = "HDR:";
+    char body[] = "hello";
+    struct iovec iov[2] = { { hdr, 4 }, { body, 5 } };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+    assert(neco_sendmsg(fds[0], &msg, 0) == 9);
+    char buf[64];
+    struct iovec riov[1] = { { buf, sizeof(buf) } };
+    struct msghdr rmsg = { .msg_iov = riov, .msg_iovlen = 1 };
+    assert(neco_recvmsg(fds[1], &rmsg, 0) == 9);
+    assert(memcmp(buf, "HDR:hello", 9) == 0);
+    ssize_t n = neco_recvmsg_dl(fds[1], &rmsg, 0, neco_now()+NECO_MILLISECOND);
+    assert(n == -1 && errno == ETIMEDOUT);
+    neco_fail_sendmsg_counter = 1;
+    assert(neco_sendmsg(fds[0], &msg, 0) == -1 && errno == EIO);
+    neco_fail_recvmsg_counter = 1;
+    assert(neco_recvmsg(fds[1], &rmsg, 0) == -1 && errno == EIO);
+
+#ifdef __linux__
+    // Send more datagrams than the socket buffer holds, which requires 
+    // waiting on the receiver.
+    int N = 2000;
+    struct mmsghdr *msgs = malloc(sizeof(struct mmsghdr)*(size_t)N);
+    struct iovec *iovs = malloc(sizeof(struct iovec)*(size_t)N);
+    int *vals = malloc(sizeof(int)*(size_t)N);
+    assert(msgs && iovs && vals);
+    for (int i = 0; i < N; i++) {
+        vals[i] = i;
+        iovs[i] = (struct iovec){ &vals[i], sizeof(int) };
+        memset(&msgs[i], 0, sizeof(struct mmsghdr));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    expect(neco_start(co_net_mmsg_reader, 2, &fds[1], &N), NECO_OK);
+    int64_t reader = neco_lastid();
+    expect(neco_sendmmsg(fds[0], msgs, (unsigned)N, 0), N);
+    expect(neco_join(reader), NECO_OK);
+    for (int i = 0; i < N; i++) {
+        assert(msgs[i].msg_len == sizeof(int));
+    }
+    int ret = neco_recvmmsg_dl(fds[1], msgs, 1, 0, 
+        neco_now()+NECO_MILLISECOND);
+    assert(ret == -1 && errno == ETIMEDOUT);
+    neco_fail_sys_sendmmsg_counter = 1;
+    ret = neco_sendmmsg(fds[0], msgs, 1, 0);
+    assert(ret == -1 && errno == EIO);
+    neco_fail_sys_recvmmsg_counter = 1;
+    ret = neco_recvmmsg(fds[1], msgs, 1, 0);
+    assert(ret == -1 && errno == EIO);
+    free(msgs);
+    free(iovs);
+    free(vals);
+#endif
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_net_msg(void) {
+    struct msghdr msg = { 0 };
+    assert(neco_sendmsg(0, &msg, 0) == -1 && errno == EPERM);
+    assert(neco_recvmsg(0, &msg, 0) == -1 && errno == EPERM);
+#ifdef __linux__
+    assert(neco_sendmmsg(0, 0, 0, 0) == -1 && errno == EPERM);
+    assert(neco_recvmmsg(0, 0, 0, 0) == -1 && errno == EPERM);
+#endif
+    expect(neco_start(co_net_msg, 0), NECO_OK);
+}
+
+void co_net_dgram_server(int argc, void *argv[]) {
+    assert(argc == 1);
+    int fd = *(int*)argv[0];
+    // Echo a single datagram back to whoever sent it.
+    struct sockaddr_storage from;
+    char buf[64];
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg = { .msg_name = &from, .msg_namelen = sizeof(from),
+        .msg_iov = &iov, .msg_iovlen = 1 };
+    ssize_t n = neco_recvmsg(fd, &msg, 0);
+    assert(n == 6 && memcmp(buf, "+PING\n", 6) == 0);
+    memcpy(buf, "+PONG\n", 6);
+    iov.iov_len = (size_t)n;
+    assert(neco_sendmsg(fd, &msg, 0) == 6);
+}
+
+void co_net_dgram(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int sockfd = neco_serve("udp4", "127.0.0.1:19780");
+    assert(sockfd > 0);
+    expect(neco_start(co_net_dgram_server, 1, &sockfd), NECO_OK);
+    int fd = neco_dial("udp4", "127.0.0.1:19780");
+    assert(fd > 0);
+    assert(neco_write(fd, "+PING\n", 6) == 6);
+    char buf[64];
+    assert(neco_read(fd, buf, sizeof(buf)) == 6);
+    assert(memcmp(buf, "+PONG\n", 6) == 0);
+    ssize_t n = neco_read_dl(fd, buf, sizeof(buf), neco_now()+NECO_MILLISECOND);
+    assert(n == -1 && errno == ETIMEDOUT);
+    close(fd);
+    close(sockfd);
+
+    unlink("dgram.sock");
+    sockfd = neco_serve("unixgram", "dgram.sock");
+    assert(sockfd > 0);
+    fd = neco_dial("unixgram", "dgram.sock");
+    assert(fd > 0);
+    assert(neco_write(fd, "hello", 5) == 5);
+    assert(neco_write(fd, "world", 5) == 5);
+    // Message boundaries are preserved.
+    assert(neco_read(sockfd, buf, sizeof(buf)) == 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+    assert(neco_read(sockfd, buf, sizeof(buf)) == 5);
+    assert(memcmp(buf, "world", 5) == 0);
+    close(fd);
+    close(sockfd);
+    unlink("dgram.sock");
+
+    expect(neco_dial("udp", "127.0.0.1"), NECO_INVAL);
+    expect(neco_serve("udp9", "127.0.0.1:19780"), NECO_INVAL);
+}
+
+void test_net_dgram(void) {
+    expect(neco_dial("udp", "127.0.0.1:19780"), NECO_PERM);
+    expect(neco_serve("unixgram", "dgram.sock"), NECO_PERM);
+    expect(neco_start(co_net_dgram, 0), NECO_OK);
+}
+
+void co_net_serve_opts(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    neco_serve_opts opts = { 
+        .backlog = 8,
+        .reuseport = true,
+        .nodelay = true,
+        .fastopen = 16,
+        .defer_accept = 1,
+    };
+    int sockfd = neco_serve_with("tcp4", "127.0.0.1:19781", &opts);
+    assert(sockfd > 0);
+    // A second listener can share the port.
+    int sockfd2 = neco_serve_with("tcp4", "127.0.0.1:19781", &opts);
+    assert(sockfd2 > 0);
+    close(sockfd2);
+    int fd = neco_dial("tcp4", "127.0.0.1:19781");
+    assert(fd > 0);
+    assert(neco_write(fd, "+PING\r\n", 7) == 7);
+    int cfd = neco_accept(sockfd, 0, 0);
+    assert(cfd > 0);
+    int val = 0;
+    socklen_t len = sizeof(int);
+    assert(getsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &val, &len) == 0);
+    assert(val != 0);
+    assert((fcntl(cfd, F_GETFL) & O_NONBLOCK) == O_NONBLOCK);
+#ifdef __linux__
+    assert((fcntl(cfd, F_GETFD) & FD_CLOEXEC) == FD_CLOEXEC);
+#endif
+    char buf[16];
+    assert(neco_read(cfd, buf, sizeof(buf)) == 7);
+    close(cfd);
+    close(fd);
+    close(sockfd);
+
+    // Without reuseport the port is taken.
+    sockfd = neco_serve_with("tcp4", "127.0.0.1:19781", 0);
+    assert(sockfd > 0);
+    fd = neco_serve_with("tcp4", "127.0.0.1:19781", 0);
+    assert(fd == -1 && errno == EADDRINUSE);
+    close(sockfd);
+
+    neco_fail_setsockopt_counter = 2;
+    fd = neco_serve_with("tcp4", "127.0.0.1:19781", &opts);
+    assert(fd == -1 && errno == EBADF);
+
+    unlink("socket");
+    sockfd = neco_serve_with("unix", "socket", &(neco_serve_opts){ 
+        .backlog = 1 });
+    assert(sockfd > 0);
+    close(sockfd);
+    unlink("socket");
+}
+
+void test_net_serve_opts(void) {
+    expect(neco_serve_with("tcp", ":19781", 0), NECO_PERM);
+    expect(neco_start(co_net_serve_opts, 0), NECO_OK);
+}
+
+void co_net_accept_many_client(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int fd = neco_dial("unix", "socket");
+    assert(fd > 0);
+    char buf[16];
+    assert(neco_read(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+}
+
+void co_net_accept_many(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    unlink("socket");
+    int sockfd = neco_serve("unix", "socket");
+    assert(sockfd > 0);
+    int fds[8];
+    expect(neco_accept_many_dl(sockfd, fds, 8, neco_now()+NECO_MILLISECOND), 
+        NECO_ERROR, NECO_TIMEDOUT);
+    int N = 20;
+    for (int i = 0; i < N; i++) {
+        expect(neco_start(co_net_accept_many_client, 0), NECO_OK);
+    }
+    // All clients have connected before the server runs again, so each call
+    // fills the array until the queue is drained.
+    int total = 0;
+    while (total < N) {
+        int n = neco_accept_many(sockfd, fds, 8);
+        assert(n > 0 && n <= 8);
+        assert(n == 8 || total+n == N);
+        for (int i = 0; i < n; i++) {
+            assert(fds[i] > 0);
+            assert((fcntl(fds[i], F_GETFL) & O_NONBLOCK) == O_NONBLOCK);
+            close(fds[i]);
+        }
+        total += n;
+    }
+    expect(neco_accept_many(sockfd, 0, 8), NECO_ERROR, NECO_INVAL);
+    expect(neco_accept_many(sockfd, fds, 0), NECO_ERROR, NECO_INVAL);
+    neco_cancel(neco_getid());
+    expect(neco_accept_many(sockfd, fds, 8), NECO_ERROR, NECO_CANCELED);
+    close(sockfd);
+    expect(neco_accept_many(sockfd, fds, 8), NECO_ERROR, NECO_ERROR);
+    unlink("socket");
+}
+
+void test_net_accept_many(void) {
+    assert(neco_accept_many(0, 0, 0) == -1 && errno == EPERM);
+    expect(neco_start(co_net_accept_many, 0), NECO_OK);
+}
+
+void co_net_pool_handler(int argc, void *argv[]) {
+    assert(argc == 1);
+    int fd = *(int*)argv[0];
+    char buf[64];
+    while (1) {
+        ssize_t n = neco_read(fd, buf, sizeof(buf));
+        if (n <= 0 || (n == 4 && memcmp(buf, "QUIT", 4) == 0)) {
+            break;
+        }
+        assert(neco_write(fd, buf, (size_t)n) == n);
+    }
+    close(fd);
+}
+
+void co_net_pool_server(int argc, void *argv[]) {
+    assert(argc == 1);
+    int sockfd = *(int*)argv[0];
+    while (1) {
+        int fd = neco_accept(sockfd, 0, 0);
+        if (fd == -1) {
+            assert(errno == ECANCELED);
+            break;
+        }
+        expect(neco_start(co_net_pool_handler, 1, &fd), NECO_OK);
+    }
+}
+
+void co_net_pool_waiter(int argc, void *argv[]) {
+    assert(argc == 1);
+    int *fd = argv[0];
+    *fd = neco_pool_dial("unix", "socket");
+    assert(*fd > 0);
+}
+
+void co_net_pool_late(int argc, void *argv[]) {
+    assert(argc == 1);
+    int64_t deadline = *(int64_t*)argv[0];
+    expect(neco_pool_dial_dl("unix", "socket", deadline), NECO_TIMEDOUT);
+}
+
+static void net_pool_ping(int fd) {
+    char buf[16];
+    assert(neco_write(fd, "PING", 4) == 4);
+    assert(neco_read(fd, buf, sizeof(buf)) == 4);
+    assert(memcmp(buf, "PING", 4) == 0);
+}
+
+void co_net_pool(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    unlink("socket");
+    int sockfd = neco_serve("unix", "socket");
+    assert(sockfd > 0);
+    expect(neco_start(co_net_pool_server, 1, &sockfd), NECO_OK);
+    int64_t server = neco_lastid();
+
+    expect(neco_pool_setopts(&(neco_pool_opts){ .max_idle = -1 }), 
+        NECO_INVAL);
+    expect(neco_pool_setopts(&(neco_pool_opts){
+        .max_idle = 2,
+        .max_active = 2,
+        .idle_timeout = NECO_MILLISECOND*50,
+    }), NECO_OK);
+    expect(neco_pool_dial(0, "socket"), NECO_INVAL);
+    expect(neco_pool_put(-1), NECO_INVAL);
+    expect(neco_pool_put(sockfd), NECO_INVAL);
+
+    // A connection that is put back is reused.
+    int fd1 = neco_pool_dial("unix", "socket");
+    assert(fd1 > 0);
+    net_pool_ping(fd1);
+    expect(neco_pool_put(fd1), NECO_OK);
+    expect(neco_pool_put(fd1), NECO_INVAL);
+    int fd2 = neco_pool_dial("unix", "socket");
+    assert(fd2 == fd1);
+    net_pool_ping(fd2);
+
+    // A connection closed by the peer is discarded on checkout.
+    assert(neco_write(fd2, "QUIT", 4) == 4);
+    neco_sleep(NECO_MILLISECOND*10);
+    expect(neco_pool_put(fd2), NECO_OK);
+    fd1 = neco_pool_dial("unix", "socket");
+    assert(fd1 > 0);
+    net_pool_ping(fd1);
+
+    // No more than max_active connections can be checked out.
+    fd2 = neco_pool_dial("unix", "socket");
+    assert(fd2 > 0 && fd2 != fd1);
+    expect(neco_pool_dial_dl("unix", "socket", neco_now()+NECO_MILLISECOND),
+        NECO_TIMEDOUT);
+    int fd3 = 0;
+    expect(neco_start(co_net_pool_waiter, 1, &fd3), NECO_OK);
+    int64_t waiter = neco_lastid();
+    assert(fd3 == 0);
+    expect(neco_pool_put(fd2), NECO_OK);
+    expect(neco_join(waiter), NECO_OK);
+    assert(fd3 == fd2);
+    net_pool_ping(fd3);
+
+    // A waiter that is notified after its deadline passes the slot on.
+    int64_t deadline = neco_now()+NECO_MILLISECOND*5;
+    expect(neco_start(co_net_pool_late, 1, &deadline), NECO_OK);
+    int64_t late = neco_lastid();
+    fd2 = 0;
+    expect(neco_start(co_net_pool_waiter, 1, &fd2), NECO_OK);
+    waiter = neco_lastid();
+    while (neco_now() <= deadline) { }
+    expect(neco_pool_put(fd3), NECO_OK);
+    expect(neco_join(late), NECO_OK);
+    expect(neco_join(waiter), NECO_OK);
+    assert(fd2 == fd3);
+
+    // Idle connections are closed after the idle timeout.
+    expect(neco_pool_put(fd1), NECO_OK);
+    expect(neco_pool_put(fd3), NECO_OK);
+    assert(fcntl(fd1, F_GETFD) != -1);
+    neco_sleep(NECO_MILLISECOND*100);
+    assert(fcntl(fd1, F_GETFD) == -1 && errno == EBADF);
+    assert(fcntl(fd3, F_GETFD) == -1 && errno == EBADF);
+
+    fd1 = neco_pool_dial("unix", "socket");
+    assert(fd1 > 0);
+    expect(neco_pool_close(fd1), NECO_OK);
+    assert(fcntl(fd1, F_GETFD) == -1 && errno == EBADF);
+    expect(neco_pool_close(fd1), NECO_INVAL);
+    expect(neco_pool_dial("unix", "nosocket"), NECO_ERROR, NECO_ERROR);
+
+    expect(neco_pool_setopts(0), NECO_OK);
+    neco_cancel(server);
+    expect(neco_join(server), NECO_OK);
+    close(sockfd);
+    unlink("socket");
+}
+
+void test_net_pool(void) {
+    expect(neco_pool_dial("unix", "socket"), NECO_PERM);
+    expect(neco_pool_put(1), NECO_PERM);
+    expect(neco_pool_setopts(0), NECO_PERM);
+    expect(neco_start(co_net_pool, 0), NECO_OK);
+}
+
+static struct sockaddr_in net_race_addr(int port) {
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+static int64_t net_race_dial(int port1, int port2, int64_t timeout, int *fd) {
+    struct sockaddr_in addrs[2] = { 
+        net_race_addr(port1), net_race_addr(port2)
+    };
+    struct addrinfo ais[2] = { 0 };
+    for (int i = 0; i < 2; i++) {
+        ais[i].ai_family = AF_INET;
+        ais[i].ai_socktype = SOCK_STREAM;
+        ais[i].ai_protocol = IPPROTO_TCP;
+        ais[i].ai_addr = (struct sockaddr*)&addrs[i];
+        ais[i].ai_addrlen = sizeof(struct sockaddr_in);
+    }
+    ais[0].ai_next = &ais[1];
+    neco_dial_addrinfo = &ais[0];
+    int64_t start = neco_now();
+    *fd = neco_dial_dl("tcp", "127.0.0.1:19783", neco_now()+timeout);
+    neco_dial_addrinfo = NULL;
+    return neco_now() - start;
+}
+
+void co_net_dial_race_canceled(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int fd;
+    net_race_dial(19782, 19782, NECO_SECOND*5, &fd);
+    assert(fd == NECO_CANCELED);
+}
+
+void co_net_dial_race(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    // A listener with a full accept queue drops new connection attempts,
+    // which is the same as a black-holed address.
+    int bhfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(bhfd > 0);
+    assert(setsockopt(bhfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, 
+        sizeof(int)) == 0);
+    struct sockaddr_in bhaddr = net_race_addr(19782);
+    assert(bind(bhfd, (struct sockaddr*)&bhaddr, sizeof(bhaddr)) == 0);
+    assert(listen(bhfd, 0) == 0);
+    int fillfd = socket(AF_INET, SOCK_STREAM, 0);
+    expect(neco_setnonblock(fillfd, true, 0), NECO_OK);
+    assert(connect(fillfd, (struct sockaddr*)&bhaddr, sizeof(bhaddr)) == -1);
+    expect(neco_wait(fillfd, NECO_WAIT_WRITE), NECO_OK);
+
+    int sockfd = neco_serve("tcp4", "127.0.0.1:19783");
+    assert(sockfd > 0);
+    neco_stats stats;
+    expect(neco_getstats(&stats), NECO_OK);
+    size_t ncoroutines = stats.coroutines;
+
+    // The black-holed address is passed over after the attempt delay.
+    int fd;
+    int64_t elapsed = net_race_dial(19782, 19783, NECO_SECOND*5, &fd);
+    assert(fd > 0);
+    assert(elapsed >= NECO_MILLISECOND*200 && elapsed < NECO_SECOND);
+    int cfd = neco_accept(sockfd, 0, 0);
+    assert(cfd > 0);
+    close(cfd);
+    close(fd);
+    expect(neco_getstats(&stats), NECO_OK);
+    assert(stats.coroutines == ncoroutines);
+
+    // A refused address is passed over right away.
+    elapsed = net_race_dial(19784, 19783, NECO_SECOND*5, &fd);
+    assert(fd > 0);
+    assert(elapsed < NECO_MILLISECOND*200);
+    cfd = neco_accept(sockfd, 0, 0);
+    assert(cfd > 0);
+    close(cfd);
+    close(fd);
+
+    // The first address wins when it connects.
+    elapsed = net_race_dial(19783, 19782, NECO_SECOND*5, &fd);
+    assert(fd > 0);
+    assert(elapsed < NECO_MILLISECOND*200);
+    cfd = neco_accept(sockfd, 0, 0);
+    assert(cfd > 0);
+    close(cfd);
+    close(fd);
+
+    net_race_dial(19782, 19782, NECO_MILLISECOND*400, &fd);
+    assert(fd == NECO_TIMEDOUT);
+    net_race_dial(19784, 19784, NECO_SECOND*5, &fd);
+    assert(fd == NECO_ERROR && errno == ECONNREFUSED);
+    expect(neco_start(co_net_dial_race_canceled, 0), NECO_OK);
+    int64_t dialer = neco_lastid();
+    neco_sleep(NECO_MILLISECOND*300);
+    expect(neco_cancel(dialer), NECO_OK);
+    expect(neco_join(dialer), NECO_OK);
+    // Let the last attempt finish exiting.
+    neco_yield();
+    expect(neco_getstats(&stats), NECO_OK);
+    assert(stats.coroutines == ncoroutines);
+
+    close(sockfd);
+    close(fillfd);
+    close(bhfd);
+}
+
+void test_net_dial_race(void) {
+    expect(neco_start(co_net_dial_race, 0), NECO_OK);
+}
+
 int main(int argc, char **argv) {
     do_test(test_net_unix);
     do_test(test_net_tcp_auto);
@@ -562,10 +1203,18 @@ int main(int argc, char **argv) {
     do_test(test_net_cancel);
     do_test(test_net_getaddrinfo);
     do_test(test_net_getaddrinfo_fail);
+    do_test(test_net_getaddrinfo_shared);
+    do_test(test_net_getaddrinfo_abandon);
     do_test(test_net_serve_fail);
     do_test(test_net_autoclose_queue);
     do_test(test_net_write_errors);
     do_test(test_net_connect_errors);
     do_test(test_net_setnonblock);
+    do_test(test_net_msg);
+    do_test(test_net_dgram);
+    do_test(test_net_serve_opts);
+    do_test(test_net_accept_many);
+    do_test(test_net_pool);
+    do_test(test_net_dial_race);
 }
 #endif
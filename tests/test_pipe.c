@@ -55,9 +55,288 @@ void test_pipe(void) {
     expect(neco_start(co_pipe, 0), NECO_OK);
 }
 
+void co_pipe_readv(int argc, void *argv[]) {
+    assert(argc == 2);
+    int fd = *(int*)argv[0];
+    size_t total = *(size_t*)argv[1];
+    char hdr[8];
+    char *body = malloc(total-8);
+    assert(body);
+    size_t nread = 0;
+    while (nread < total) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (nread < 8) {
+            iov[iovcnt++] = (struct iovec){ hdr+nread, 8-nread };
+            iov[iovcnt++] = (struct iovec){ body, total-8 };
+        } else {
+            iov[iovcnt++] = (struct iovec){ body+(nread-8), total-nread };
+        }
+        ssize_t n = neco_readv(fd, iov, iovcnt);
+        assert(n > 0);
+        nread += (size_t)n;
+    }
+    assert(memcmp(hdr, "HEADER:\n", 8) == 0);
+    for (size_t i = 0; i < total-8; i++) {
+        assert(body[i] == (char)('a'+(i%26)));
+    }
+    free(body);
+}
+
+void co_pipe_vectored(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    int fds[2];
+    expect(neco_pipe(fds), NECO_OK);
+
+    // Timeout when there's nothing to read.
+    char buf[16];
+    struct iovec riov[1] = { { buf, sizeof(buf) } };
+    ssize_t n = neco_readv_dl(fds[0], riov, 1, neco_now()+NECO_MILLISECOND);
+    assert(n == -1 && errno == ETIMEDOUT);
+
+    // Write more than what fits in the pipe using many buffers.
+    size_t bodylen = 1024*1024;
+    char *body = malloc(bodylen);
+    assert(body);
+    for (size_t i = 0; i < bodylen; i++) {
+        body[i] = (char)('a'+(i%26));
+    }
+    int niov = 101;
+    struct iovec iov[101];
+    iov[0] = (struct iovec){ "HEADER:\n", 8 };
+    iov[1] = (struct iovec){ 0, 0 };
+    size_t chunk = bodylen/(size_t)(niov-2);
+    for (int i = 2; i < niov; i++) {
+        size_t off = chunk*(size_t)(i-2);
+        size_t len = i == niov-1 ? bodylen-off : chunk;
+        iov[i] = (struct iovec){ body+off, len };
+    }
+    size_t total = 8+bodylen;
+    expect(neco_start(co_pipe_readv, 2, &fds[0], &total), NECO_OK);
+    n = neco_writev(fds[1], iov, niov);
+    assert(n == (ssize_t)total);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    free(body);
+
+    assert(neco_writev(fds[1], iov, 0) == 0);
+    n = neco_writev(fds[1], 0, 1);
+    assert(n == -1 && errno == EINVAL);
+    neco_fail_writev_counter = 1;
+    n = neco_writev(fds[1], iov, 1);
+    assert(n == -1 && errno == EIO);
+    neco_fail_readv_counter = 1;
+    n = neco_readv(fds[0], riov, 1);
+    assert(n == -1 && errno == EIO);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    // Canceled
+    expect(neco_cancel(neco_getid()), NECO_OK);
+    n = neco_readv(fds[0], riov, 1);
+    assert(n == -1 && errno == ECANCELED);
+}
+
+void test_pipe_vectored(void) {
+    char buf[1];
+    struct iovec iov[1] = { { buf, 1 } };
+    assert(neco_readv(0, iov, 1) == -1 && errno == EPERM);
+    assert(neco_writev(1, iov, 1) == -1 && errno == EPERM);
+    expect(neco_start(co_pipe_vectored, 0), NECO_OK);
+}
+
+void co_pipe_sendfile_reader(int argc, void *argv[]) {
+    assert(argc == 2);
+    int fd = *(int*)argv[0];
+    size_t total = *(size_t*)argv[1];
+    char buf[4096];
+    size_t nread = 0;
+    while (nread < total) {
+        ssize_t n = neco_read(fd, buf, sizeof(buf));
+        assert(n > 0);
+        for (ssize_t i = 0; i < n; i++) {
+            assert(buf[i] == (char)('a'+((nread+(size_t)i)%26)));
+        }
+        nread += (size_t)n;
+    }
+}
+
+void co_pipe_sendfile_late(int argc, void *argv[]) {
+    assert(argc == 1);
+    expect(neco_sleep(NECO_MILLISECOND*10), NECO_OK);
+    expect(neco_write(*(int*)argv[0], "hello", 5), 5);
+}
+
+void co_pipe_sendfile(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    char path[] = "/tmp/neco_sendfile_XXXXXX";
+    int ffd = mkstemp(path);
+    assert(ffd != -1);
+    unlink(path);
+    size_t size = 1024*1024;
+    char *data = malloc(size);
+    assert(data);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (char)('a'+(i%26));
+    }
+    assert(write(ffd, data, size) == (ssize_t)size);
+    free(data);
+
+    int fds[2];
+    expect(neco_pipe(fds), NECO_OK);
+
+    // Send the entire file from an offset, file position is unchanged.
+    off_t off = 0;
+    expect(neco_start(co_pipe_sendfile_reader, 2, &fds[0], &size), NECO_OK);
+    assert(neco_sendfile(fds[1], ffd, &off, size+100) == (ssize_t)size);
+    assert(off == (off_t)size);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(lseek(ffd, 0, SEEK_CUR) == (off_t)size);
+
+    // Send from the file position.
+    assert(lseek(ffd, 0, SEEK_SET) == 0);
+    size_t half = size/2;
+    expect(neco_start(co_pipe_sendfile_reader, 2, &fds[0], &half), NECO_OK);
+    assert(neco_sendfile(fds[1], ffd, 0, half) == (ssize_t)half);
+    expect(neco_join(neco_lastid()), NECO_OK);
+    assert(lseek(ffd, 0, SEEK_CUR) == (off_t)half);
+    
+    // End of file
+    off = (off_t)size;
+    assert(neco_sendfile(fds[1], ffd, &off, 100) == 0);
+
+    // Timeout when the output is full.
+    off = 0;
+    ssize_t n = neco_sendfile_dl(fds[1], ffd, &off, size, 
+        neco_now()+NECO_MILLISECOND*10);
+    assert(n == -1 && errno == ETIMEDOUT);
+    assert(off > 0 && off < (off_t)size);
+
+#ifdef __linux__
+    neco_fail_sendfile_counter = 1;
+    n = neco_sendfile(fds[1], ffd, &off, 100);
+    assert(n == -1 && errno == EIO);
+#endif
+    n = neco_sendfile(fds[1], -1, &off, 100);
+    assert(n == -1 && errno == EBADF);
+
+    // Input that does not support sendfile(2) is copied instead.
+    int fds2[2];
+    expect(neco_pipe(fds2), NECO_OK);
+    expect(neco_write(fds2[1], "hello", 5), 5);
+    int fds3[2];
+    expect(neco_pipe(fds3), NECO_OK);
+    assert(neco_sendfile(fds3[1], fds2[0], 0, 5) == 5);
+    char buf[5];
+    expect(neco_read(fds3[0], buf, 5), 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+
+    // Waits for an empty input instead of the output.
+    expect(neco_start(co_pipe_sendfile_late, 1, &fds2[1]), NECO_OK);
+    assert(neco_sendfile_dl(fds3[1], fds2[0], 0, 5, 
+        neco_now()+NECO_SECOND) == 5);
+    expect(neco_read(fds3[0], buf, 5), 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+    n = neco_sendfile_dl(fds3[1], fds2[0], 0, 5, 
+        neco_now()+NECO_MILLISECOND*10);
+    assert(n == -1 && errno == ETIMEDOUT);
+    close(fds2[0]);
+    close(fds2[1]);
+    close(fds3[0]);
+    close(fds3[1]);
+    close(ffd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_pipe_sendfile(void) {
+    assert(neco_sendfile(1, 0, 0, 1) == -1 && errno == EPERM);
+    expect(neco_start(co_pipe_sendfile, 0), NECO_OK);
+}
+
+void co_pipe_copy_writer(int argc, void *argv[]) {
+    assert(argc == 2);
+    int fd = *(int*)argv[0];
+    size_t total = *(size_t*)argv[1];
+    char buf[4096];
+    size_t nwritten = 0;
+    while (nwritten < total) {
+        size_t len = total-nwritten < sizeof(buf) ? total-nwritten : sizeof(buf);
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = (char)('a'+((nwritten+i)%26));
+        }
+        expect(neco_write(fd, buf, len), (int)len);
+        nwritten += len;
+    }
+    close(fd);
+}
+
+void pipe_copy(size_t total, size_t max, size_t expect_copied) {
+    int src[2], dst[2];
+    expect(neco_pipe(src), NECO_OK);
+    expect(neco_pipe(dst), NECO_OK);
+    expect(neco_start(co_pipe_copy_writer, 2, &src[1], &total), NECO_OK);
+    int64_t writer = neco_lastid();
+    expect(neco_start(co_pipe_sendfile_reader, 2, &dst[0], &expect_copied), 
+        NECO_OK);
+    int64_t reader = neco_lastid();
+    ssize_t n = neco_copy(dst[1], src[0], max);
+    assert(n == (ssize_t)expect_copied);
+    expect(neco_join(reader), NECO_OK);
+    if (expect_copied < total) {
+        // Drain the rest so the writer can finish.
+        char buf[4096];
+        while (neco_read(src[0], buf, sizeof(buf)) > 0) { }
+    }
+    expect(neco_join(writer), NECO_OK);
+    close(src[0]);
+    close(dst[0]);
+    close(dst[1]);
+}
+
+void co_pipe_copy(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    size_t MB = 1024*1024;
+    pipe_copy(MB, SIZE_MAX, MB);
+    pipe_copy(MB, SIZE_MAX, MB); // reuses the pipe
+    pipe_copy(1000, 10, 10);
+    pipe_copy(0, SIZE_MAX, 0);
+#ifdef __linux__
+    // Fallback to a buffered copy.
+    neco_fail_sys_splice_counter = 1;
+    neco_fail_sys_splice_error = EINVAL;
+    pipe_copy(MB, SIZE_MAX, MB);
+#endif
+
+    int src[2], dst[2];
+    expect(neco_pipe(src), NECO_OK);
+    expect(neco_pipe(dst), NECO_OK);
+    ssize_t n = neco_copy_dl(dst[1], src[0], SIZE_MAX, 
+        neco_now()+NECO_MILLISECOND);
+    assert(n == -1 && errno == ETIMEDOUT);
+#ifdef __linux__
+    neco_fail_sys_splice_counter = 1;
+    n = neco_copy(dst[1], src[0], SIZE_MAX);
+    assert(n == -1 && errno == EIO);
+#endif
+    n = neco_copy(dst[1], -1, SIZE_MAX);
+    assert(n == -1 && errno == EBADF);
+    close(src[0]);
+    close(src[1]);
+    close(dst[0]);
+    close(dst[1]);
+}
+
+void test_pipe_copy(void) {
+    assert(neco_copy(1, 0, 1) == -1 && errno == EPERM);
+    expect(neco_start(co_pipe_copy, 0), NECO_OK);
+}
 
 int main(int argc, char **argv) {
     do_test(test_pipe);
+    do_test(test_pipe_vectored);
+    do_test(test_pipe_sendfile);
+    do_test(test_pipe_copy);
 }
 
 #endif
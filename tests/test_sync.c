@@ -273,6 +273,55 @@ void test_sync_cond_signal_cancel(void) {
     expect(neco_start(co_sync_cond_signal_cancel, 0), NECO_OK);
 }
 
+void co_sync_cond_context_holder(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_mutex *mutex = argv[0];
+    bool *held = argv[1];
+    expect(neco_mutex_lock(mutex), NECO_OK);
+    *held = true;
+    expect(neco_sleep(NECO_MILLISECOND*10), NECO_OK);
+    *held = false;
+    expect(neco_mutex_unlock(mutex), NECO_OK);
+}
+
+void co_sync_cond_context(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    neco_mutex mutex;
+    expect(neco_mutex_init(&mutex), NECO_OK);
+    neco_cond cond;
+    expect(neco_cond_init(&cond), NECO_OK);
+    // The mutex is relocked, even when it's held by another coroutine and 
+    // the context is canceled or past its deadline.
+    for (int i = 0; i < 2; i++) {
+        bool held = false;
+        expect(neco_mutex_lock(&mutex), NECO_OK);
+        expect(neco_start(co_sync_cond_context_holder, 2, &mutex, &held), 
+            NECO_OK);
+        neco_context *ctx;
+        expect(neco_context_make(&ctx, i == 0 ? INT64_MAX : 
+            neco_now()+NECO_MILLISECOND), NECO_OK);
+        expect(neco_context_set(ctx), NECO_OK);
+        if (i == 0) {
+            expect(neco_context_cancel(ctx), NECO_OK);
+            expect(neco_cond_wait(&cond, &mutex), NECO_CANCELED);
+        } else {
+            expect(neco_cond_wait(&cond, &mutex), NECO_TIMEDOUT);
+        }
+        assert(!held);
+        expect(neco_context_set(0), NECO_OK);
+        expect(neco_context_release(ctx), NECO_OK);
+        expect(neco_mutex_trylock(&mutex), NECO_BUSY);
+        expect(neco_mutex_unlock(&mutex), NECO_OK);
+    }
+    expect(neco_cond_destroy(&cond), NECO_OK);
+    expect(neco_mutex_destroy(&mutex), NECO_OK);
+}
+
+void test_sync_cond_context(void) {
+    expect(neco_start(co_sync_cond_context, 0), NECO_OK);
+}
+
 void co_sync_cond_broadcast_child(int argc, void *argv[]) {
     assert(argc == 3);
     neco_cond *cond = argv[0];
@@ -421,6 +470,96 @@ void test_sync_mutex_deadline(void) {
     expect(neco_start(co_sync_mutex_deadline, 0), NECO_OK);
 }
 
+void co_sync_mutex_mode_counter(int argc, void *argv[]) {
+    assert(argc == 2);
+    int *counter = argv[0];
+    bool *done = argv[1];
+    while (!*done) {
+        (*counter)++;
+        expect(neco_yield(), NECO_OK);
+    }
+}
+
+void co_sync_mutex_mode_waiter(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_mutex *mutex = argv[0];
+    int *locked = argv[1];
+    expect(neco_mutex_lock(mutex), NECO_OK);
+    (*locked)++;
+    expect(neco_mutex_unlock(mutex), NECO_OK);
+}
+
+void co_sync_mutex_mode(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    neco_mutex mutex;
+    expect(neco_mutex_init(&mutex), NECO_OK);
+    expect(neco_mutex_setmode(&mutex, 4), NECO_INVAL);
+
+    // No yielding on unlock.
+    int counter = 0;
+    bool done = false;
+    expect(neco_start(co_sync_mutex_mode_counter, 2, &counter, &done), 
+        NECO_OK);
+    int start = counter;
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_NOYIELD), NECO_OK);
+    for (int i = 0; i < 100; i++) {
+        expect(neco_mutex_lock(&mutex), NECO_OK);
+        expect(neco_mutex_unlock(&mutex), NECO_OK);
+    }
+    assert(counter == start);
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_DEFAULT), NECO_OK);
+    for (int i = 0; i < 100; i++) {
+        expect(neco_mutex_lock(&mutex), NECO_OK);
+        expect(neco_mutex_unlock(&mutex), NECO_OK);
+    }
+    assert(counter > start);
+    done = true;
+
+    // Direct handoff. With a waiter the unlock still yields, and the waiter
+    // owns the lock when it runs.
+    int locked = 0;
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_NOYIELD), NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    expect(neco_start(co_sync_mutex_mode_waiter, 2, &mutex, &locked), 
+        NECO_OK);
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    assert(locked == 1);
+
+    // Barging. A running coroutine may take the lock before the woken waiter,
+    // but unlocking with a waiter yields, so it is not starved.
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_NOYIELD|NECO_MUTEX_BARGING), 
+        NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    expect(neco_start(co_sync_mutex_mode_waiter, 2, &mutex, &locked), 
+        NECO_OK);
+    for (int i = 0; i < 10; i++) {
+        expect(neco_mutex_unlock(&mutex), NECO_OK);
+        expect(neco_mutex_lock(&mutex), NECO_OK);
+    }
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    assert(locked == 2);
+
+    // Barging with multiple waiters.
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_BARGING), NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    expect(neco_start(co_sync_mutex_mode_waiter, 2, &mutex, &locked), 
+        NECO_OK);
+    expect(neco_start(co_sync_mutex_mode_waiter, 2, &mutex, &locked), 
+        NECO_OK);
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    assert(locked == 4);
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    expect(neco_mutex_destroy(&mutex), NECO_OK);
+}
+
+void test_sync_mutex_mode(void) {
+    neco_mutex mutex;
+    expect(neco_mutex_setmode(&mutex, NECO_MUTEX_NOYIELD), NECO_PERM);
+    expect(neco_start(co_sync_mutex_mode, 0), NECO_OK);
+}
+
 void co_sync_mutex_fail(int argc, void *argv[]) {
     assert(argc == 0);
     (void)argv;
@@ -532,19 +671,231 @@ void test_sync_cond_fail(void) {
     expect(neco_start(co_sync_cond_fail, 0), NECO_OK);
 }
 
+void co_sync_sema_child(int argc, void *argv[]) {
+    assert(argc == 3);
+    neco_sema *sema = argv[0];
+    int64_t weight = *(int64_t*)argv[1];
+    int *order = argv[2];
+    expect(neco_sema_acquire(sema, weight), NECO_OK);
+    order[order[0]+1] = (int)weight;
+    order[0]++;
+    expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    expect(neco_sema_release(sema, weight), NECO_OK);
+}
+
+void co_sync_sema(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    neco_sema sema;
+    expect(neco_sema_init(&sema, 0), NECO_INVAL);
+    expect(neco_sema_init(&sema, 10), NECO_OK);
+    expect(neco_sema_acquire(&sema, 0), NECO_INVAL);
+    expect(neco_sema_acquire(&sema, 11), NECO_INVAL);
+    expect(neco_sema_release(&sema, 1), NECO_INVAL);
+    expect(neco_sema_acquire(&sema, 6), NECO_OK);
+    expect(neco_sema_tryacquire(&sema, 5), NECO_BUSY);
+    expect(neco_sema_tryacquire(&sema, 4), NECO_OK);
+    expect(neco_sema_acquire_dl(&sema, 1, neco_now()+NECO_MILLISECOND), 
+        NECO_TIMEDOUT);
+    expect(neco_cancel(neco_getid()), NECO_OK);
+    expect(neco_sema_acquire(&sema, 1), NECO_CANCELED);
+    expect(neco_sema_destroy(&sema), NECO_BUSY);
+    expect(neco_sema_release(&sema, 10), NECO_OK);
+
+    // Waiters are served in order, and a large waiter blocks smaller ones.
+    int order[8] = { 0 };
+    expect(neco_sema_acquire(&sema, 10), NECO_OK);
+    expect(neco_start(co_sync_sema_child, 3, &sema, &(int64_t){8}, order), 
+        NECO_OK);
+    expect(neco_start(co_sync_sema_child, 3, &sema, &(int64_t){3}, order), 
+        NECO_OK);
+    expect(neco_start(co_sync_sema_child, 3, &sema, &(int64_t){2}, order), 
+        NECO_OK);
+    expect(neco_sema_release(&sema, 10), NECO_OK);
+    while (order[0] < 3) {
+        expect(neco_sleep(NECO_MILLISECOND), NECO_OK);
+    }
+    assert(order[1] == 8 && order[2] == 3 && order[3] == 2);
+    expect(neco_sema_acquire(&sema, 10), NECO_OK);
+    expect(neco_sema_release(&sema, 10), NECO_OK);
+    expect(neco_sema_destroy(&sema), NECO_OK);
+}
+
+void test_sync_sema(void) {
+    neco_sema sema;
+    expect(neco_sema_init(0, 1), NECO_INVAL);
+    expect(neco_sema_init(&sema, 1), NECO_PERM);
+    expect(neco_start(co_sync_sema, 0), NECO_OK);
+}
+
+void co_sync_ratelimiter_waiter(int argc, void *argv[]) {
+    assert(argc == 1);
+    neco_ratelimiter_acquire(argv[0]);
+}
+
+void co_sync_ratelimiter(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    neco_ratelimiter rl;
+    expect(neco_ratelimiter_init(&rl, 0, 1), NECO_INVAL);
+    expect(neco_ratelimiter_init(&rl, 1, 0), NECO_INVAL);
+    expect(neco_ratelimiter_init(&rl, 100, 5), NECO_OK);
+    for (int i = 0; i < 5; i++) {
+        expect(neco_ratelimiter_tryacquire(&rl), NECO_OK);
+    }
+    expect(neco_ratelimiter_tryacquire(&rl), NECO_BUSY);
+    expect(neco_ratelimiter_acquire_dl(&rl, neco_now()+NECO_MILLISECOND),
+        NECO_TIMEDOUT);
+    expect(neco_cancel(neco_getid()), NECO_OK);
+    expect(neco_ratelimiter_acquire(&rl), NECO_CANCELED);
+    int64_t start = neco_now();
+    for (int i = 0; i < 5; i++) {
+        expect(neco_ratelimiter_acquire(&rl), NECO_OK);
+    }
+    int64_t elapsed = neco_now() - start;
+    assert(elapsed >= NECO_MILLISECOND*40 && elapsed < NECO_SECOND);
+
+    // A canceled waiter does not give back its token when a later waiter
+    // has reserved the one after it.
+    expect(neco_ratelimiter_init(&rl, 100, 1), NECO_OK);
+    start = neco_now();
+    expect(neco_ratelimiter_tryacquire(&rl), NECO_OK);
+    expect(neco_start(co_sync_ratelimiter_waiter, 1, &rl), NECO_OK);
+    int64_t first = neco_lastid();
+    expect(neco_start(co_sync_ratelimiter_waiter, 1, &rl), NECO_OK);
+    int64_t second = neco_lastid();
+    expect(neco_cancel(first), NECO_OK);
+    expect(neco_ratelimiter_acquire_dl(&rl, start+NECO_MILLISECOND*25),
+        NECO_TIMEDOUT);
+    expect(neco_join(second), NECO_OK);
+}
+
+void test_sync_ratelimiter(void) {
+    neco_ratelimiter rl;
+    expect(neco_ratelimiter_init(0, 1, 1), NECO_INVAL);
+    expect(neco_ratelimiter_init(&rl, 1, 1), NECO_PERM);
+    expect(neco_start(co_sync_ratelimiter, 0), NECO_OK);
+}
+
+void co_sync_contention_child(int argc, void *argv[]) {
+    assert(argc == 2);
+    neco_mutex *mutex = argv[0];
+    neco_chan *chan = argv[1];
+    expect(neco_mutex_lock(mutex), NECO_OK);
+    expect(neco_mutex_unlock(mutex), NECO_OK);
+    expect(neco_sleep(NECO_MILLISECOND*2), NECO_OK);
+    expect(neco_chan_send(chan, &(int){1}), NECO_OK);
+}
+
+struct contention_totals {
+    int64_t mutex_acquisitions;
+    int64_t mutex_contended;
+    int64_t recv_contended;
+    int64_t recv_waittime;
+    int count;
+};
+
+bool contention_iter(const neco_contention *ct, void *udata) {
+    struct contention_totals *totals = udata;
+    totals->count++;
+    assert(ct->callsite);
+    int64_t hist = 0;
+    for (int i = 0; i < NECO_CONTENTION_NBUCKETS; i++) {
+        hist += ct->histogram[i];
+    }
+    assert(hist == ct->contended);
+    if (ct->kind == NECO_CONTENTION_MUTEX) {
+        totals->mutex_acquisitions += ct->acquisitions;
+        totals->mutex_contended += ct->contended;
+    } else if (ct->kind == NECO_CONTENTION_RECV) {
+        totals->recv_contended += ct->contended;
+        totals->recv_waittime += ct->waittime;
+    }
+    return true;
+}
+
+void co_sync_contention(int argc, void *argv[]) {
+    assert(argc == 0);
+    (void)argv;
+    expect(neco_contention_foreach(0, 0), NECO_INVAL);
+    expect(neco_contention_enable(true), NECO_OK);
+    neco_mutex mutex;
+    expect(neco_mutex_init(&mutex), NECO_OK);
+    neco_chan *chan;
+    expect(neco_chan_make(&chan, sizeof(int), 0), NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    expect(neco_start(co_sync_contention_child, 2, &mutex, chan), NECO_OK);
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    int x;
+    expect(neco_chan_recv(chan, &x), NECO_OK);
+    struct contention_totals totals = { 0 };
+    expect(neco_contention_foreach(contention_iter, &totals), NECO_OK);
+    assert(totals.mutex_acquisitions == 2);
+    assert(totals.mutex_contended == 1);
+    assert(totals.recv_contended == 1);
+    assert(totals.recv_waittime >= NECO_MILLISECOND);
+    // The sender has not yet returned from its send.
+    assert(totals.count == 3);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    expect(neco_contention_dump(fds[1]), NECO_OK);
+    char buf[4096];
+    ssize_t n = read(fds[0], buf, sizeof(buf)-1);
+    assert(n > 0);
+    buf[n] = '\0';
+    assert(strstr(buf, "mutex") && strstr(buf, "recv"));
+    close(fds[0]);
+    close(fds[1]);
+
+    // A failed operation does not charge its callsite to the next one.
+    expect(neco_contention_reset(), NECO_OK);
+    for (int i = 0; i < 2; i++) {
+        if (i == 0) {
+            expect(neco_mutex_lock(0), NECO_INVAL);
+        }
+        expect(neco_mutex_lock_dl(&mutex, INT64_MAX), NECO_OK);
+        expect(neco_mutex_unlock(&mutex), NECO_OK);
+    }
+    totals = (struct contention_totals){ 0 };
+    expect(neco_contention_foreach(contention_iter, &totals), NECO_OK);
+    assert(totals.count == 1 && totals.mutex_acquisitions == 2);
+
+    expect(neco_contention_reset(), NECO_OK);
+    totals = (struct contention_totals){ 0 };
+    expect(neco_contention_enable(false), NECO_OK);
+    expect(neco_mutex_lock(&mutex), NECO_OK);
+    expect(neco_mutex_unlock(&mutex), NECO_OK);
+    expect(neco_contention_foreach(contention_iter, &totals), NECO_OK);
+    assert(totals.count == 0);
+    expect(neco_chan_release(chan), NECO_OK);
+}
+
+void test_sync_contention(void) {
+    expect(neco_contention_enable(true), NECO_PERM);
+    expect(neco_contention_reset(), NECO_PERM);
+    expect(neco_contention_dump(1), NECO_PERM);
+    expect(neco_start(co_sync_contention, 0), NECO_OK);
+}
+
 int main(int argc, char **argv) {
     do_test(test_sync_mutex);
     do_test(test_sync_mutex_rw);
     do_test(test_sync_mutex_rw_order);
     do_test(test_sync_mutex_deadline);
     do_test(test_sync_mutex_fail);
+    do_test(test_sync_mutex_mode);
     do_test(test_sync_waitgroup_one);
     do_test(test_sync_waitgroup_multi);
     do_test(test_sync_waitgroup_cancel);
     do_test(test_sync_waitgroup_fail);
     do_test(test_sync_cond_signal);
     do_test(test_sync_cond_signal_cancel);
+    do_test(test_sync_cond_context);
     do_test(test_sync_cond_broadcast);
     do_test(test_sync_cond_deadline);
     do_test(test_sync_cond_fail);
+    do_test(test_sync_sema);
+    do_test(test_sync_ratelimiter);
+    do_test(test_sync_contention);
 }
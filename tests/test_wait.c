@@ -29,7 +29,55 @@ void test_wait_fd(void) {
     expect(neco_start(co_wait_fd, 0), NECO_OK);
 }
 
+void co_wait_many(int argc, void *argv[]) {
+    (void)argc;
+    (void)argv;
+    int N = 10;
+    int pipes[N][2];
+    int fds[N];
+    int modes[N];
+    int ready[N];
+    for (int i = 0; i < N; i++) {
+        assert(pipe(pipes[i]) == 0);
+        fds[i] = pipes[i][0];
+        modes[i] = NECO_WAIT_READ;
+    }
+    expect(neco_waitmany_dl(fds, modes, ready, N, 
+        neco_now()+NECO_MILLISECOND), NECO_TIMEDOUT);
+    assert(write(pipes[3][1], "a", 1) == 1);
+    assert(write(pipes[7][1], "b", 1) == 1);
+    expect(neco_waitmany(fds, modes, ready, N), 2);
+    for (int i = 0; i < N; i++) {
+        assert(ready[i] == (i == 3 || i == 7 ? NECO_WAIT_READ : 0));
+    }
+
+    // read and write on the same fd
+    fds[0] = pipes[3][1];
+    modes[0] = NECO_WAIT_READ|NECO_WAIT_WRITE;
+    expect(neco_waitmany(fds, modes, ready, 1), 1);
+    assert(ready[0] == NECO_WAIT_WRITE);
+
+    fds[0] = -10;
+    modes[0] = NECO_WAIT_READ;
+    int ret = neco_waitmany(fds, modes, ready, 1);
+    assert(ret == NECO_ERROR && errno == EBADF);
+    modes[0] = 4;
+    expect(neco_waitmany(fds, modes, ready, 1), NECO_INVAL);
+    expect(neco_waitmany(0, 0, 0, 1), NECO_INVAL);
+    expect(neco_waitmany(0, 0, 0, -1), NECO_INVAL);
+    for (int i = 0; i < N; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+}
+
+void test_wait_many(void) {
+    expect(neco_waitmany(0, 0, 0, 0), NECO_PERM);
+    expect(neco_start(co_wait_many, 0), NECO_OK);
+}
+
 int main(int argc, char **argv) {
     do_test(test_wait_fd);
+    do_test(test_wait_many);
 }
 #endif
@@ -209,6 +209,8 @@ int neco_errconv_from_sys(void);
 void neco_errconv_to_sys(int err);
 int neco_errconv_from_gai(int errnum);
 int neco_getaddrinfo_nthreads(void);
+int neco_getaddrinfo_nlookups(void);
+extern _Atomic(int64_t) neco_gai_delay;
 int neco_mutex_fastlock(neco_mutex *mutex, int64_t deadline);
 void neco_setcanceled(void);
 int neco_pipe(int pipefd[2]);
@@ -221,6 +223,7 @@ int neco_stream_make_buffered_size(neco_stream **buf, int fd, size_t buffer_size
 int neco_mutex_destroy(neco_mutex *mutex);
 int neco_waitgroup_destroy(neco_waitgroup *waitgroup);
 int neco_cond_destroy(neco_cond *cond);
+int neco_sema_destroy(neco_sema *sema);
 
 #define FAIL_EXTERN(name) \
 extern __thread volatile int neco_fail_ ## name ## _counter; \
@@ -240,6 +243,17 @@ FAIL_EXTERN(evqueue)
 FAIL_EXTERN(pthread_create)
 FAIL_EXTERN(pthread_detach)
 FAIL_EXTERN(pipe)
+FAIL_EXTERN(readv)
+FAIL_EXTERN(writev)
+FAIL_EXTERN(recvmsg)
+FAIL_EXTERN(sendmsg)
+#ifdef __linux__
+FAIL_EXTERN(sendfile)
+FAIL_EXTERN(sys_accept4)
+FAIL_EXTERN(sys_splice)
+FAIL_EXTERN(sys_recvmmsg)
+FAIL_EXTERN(sys_sendmmsg)
+#endif
 FAIL_EXTERN(neco_malloc)
 FAIL_EXTERN(neco_realloc)
 FAIL_EXTERN(stack_get)
@@ -248,6 +262,12 @@ extern __thread bool neco_fail_cowait;
 extern __thread bool neco_last_panic;
 extern __thread bool neco_connect_dl_canceled;
 extern __thread int neco_partial_write;
+#ifndef _WIN32
+extern __thread struct addrinfo *neco_dial_addrinfo;
+#endif
+#if defined(__GLIBC__) && !defined(NECO_NOGAICACHE)
+extern __thread int64_t neco_gai_cachettl;
+#endif
 
 #define expect(op, ...) { \
     int args[] = {__VA_ARGS__,0,0}; \